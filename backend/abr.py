@@ -0,0 +1,145 @@
+# abr.py — per-viewer resolution / frame-rate ladder driven by RTCP and client-reported stats
+import threading
+import time
+from typing import Callable, Dict, Optional, Tuple
+
+# (height scale, frame divisor); index 0 is full quality. Detection always runs
+# on the full-resolution frame; only what each viewer is sent steps down.
+LAYERS = [
+    (1.0, 1),
+    (0.75, 1),
+    (0.5, 1),
+    (0.5, 2),
+    (0.33, 2),
+    (0.25, 3),
+]
+
+
+class BitrateController:
+    """
+    Picks a LAYERS index for one viewer. Steps down after `down_after`
+    consecutive congested ticks (RTCP fraction lost, or the client receiving
+    far fewer fps than sent); steps up one layer after `up_after` clean ticks.
+    "Sent" is `source_rate()` (the pipeline's measured output fps) over the
+    layer's divisor, so a camera running below its nominal `fps` is not
+    mistaken for a starved viewer.
+    """
+
+    def __init__(self, fps: float, down_loss: float = 0.05, up_loss: float = 0.01,
+                 down_after: int = 2, up_after: int = 5, min_height: int = 120,
+                 source_rate: Optional[Callable[[], float]] = None):
+        self.fps = fps
+        self.source_rate = source_rate
+        self.down_loss = down_loss
+        self.up_loss = up_loss
+        self.down_after = down_after
+        self.up_after = up_after
+        self.min_height = min_height
+        self.layer = 0
+        self.changes = 0
+        self._bad = 0
+        self._good = 0
+        self.rtcp: Dict[str, float] = {}
+        self.client: Dict[str, float] = {}
+        self._client_at = 0.0
+
+    # ----- inputs -----
+    def report_rtcp(self, fraction_lost: Optional[float], rtt: Optional[float]):
+        if fraction_lost is not None:
+            self.rtcp["fraction_lost"] = float(fraction_lost)
+        if rtt is not None:
+            self.rtcp["rtt"] = float(rtt)
+
+    def report_client(self, msg: dict):
+        """{"kbps", "fps", "packetsLost", "packetsReceived", "freezeCount"} from webrtc.js."""
+        prev = self.client
+        cur = {k: float(msg[k]) for k in ("kbps", "fps", "packetsLost", "packetsReceived", "freezeCount")
+               if isinstance(msg.get(k), (int, float))}
+        # loss over the last interval from the cumulative counters
+        if "packetsLost" in cur and "packetsReceived" in cur and "packetsLost" in prev:
+            lost = cur["packetsLost"] - prev["packetsLost"]
+            got = cur["packetsReceived"] - prev.get("packetsReceived", 0.0)
+            cur["interval_loss"] = lost / (lost + got) if (lost + got) > 0 else 0.0
+        if "freezeCount" in cur and "freezeCount" in prev:
+            cur["new_freezes"] = cur["freezeCount"] - prev["freezeCount"]
+        self.client = cur
+        self._client_at = time.monotonic()
+
+    # ----- decision -----
+    def sent_fps(self) -> float:
+        rate = self.source_rate() if self.source_rate is not None else self.fps
+        return rate / LAYERS[self.layer][1]
+
+    def _congested(self) -> Tuple[bool, bool]:
+        """(congested, clean), each judged on whichever signals are present."""
+        loss = max(self.rtcp.get("fraction_lost", 0.0), self.client.get("interval_loss", 0.0))
+        fresh = time.monotonic() - self._client_at < 10.0
+        fps = self.client.get("fps") if fresh else None
+        starved = fps is not None and fps < 0.6 * self.sent_fps()
+        freezes = fresh and self.client.get("new_freezes", 0.0) > 0
+        congested = loss > self.down_loss or starved or freezes
+        clean = loss < self.up_loss and not freezes and (fps is None or fps >= 0.9 * self.sent_fps())
+        return congested, clean
+
+    def tick(self, source_height: int = 0) -> int:
+        congested, clean = self._congested()
+        if congested:
+            self._bad += 1
+            self._good = 0
+        elif clean:
+            self._good += 1
+            self._bad = 0
+        else:
+            self._bad = self._good = 0
+        lowest = len(LAYERS) - 1
+        if source_height:
+            # never go below min_height
+            while lowest > 0 and source_height * LAYERS[lowest][0] < self.min_height:
+                lowest -= 1
+        if self._bad >= self.down_after and self.layer < lowest:
+            self.layer += 1
+            self._bad = 0
+            self.changes += 1
+        elif self._good >= self.up_after and self.layer > 0:
+            self.layer -= 1
+            self._good = 0
+            self.changes += 1
+        return self.layer
+
+    def stats(self):
+        scale, div = LAYERS[self.layer]
+        return {"layer": self.layer, "scale": scale, "fps": round(self.sent_fps(), 2),
+                "changes": self.changes, "rtcp": dict(self.rtcp), "client": dict(self.client)}
+
+
+class LayerCache:
+    """
+    Downscaled copies of the shared annotated frame per scale, made once per
+    frame no matter how many viewers sit on that layer (simulcast-style).
+    """
+
+    def __init__(self):
+        self._frame = None
+        self._scaled: Dict[float, object] = {}
+        self._lock = threading.Lock()   # viewers scale from worker threads
+
+    def get(self, frame, scale: float):
+        if scale >= 1.0:
+            return frame
+        with self._lock:
+            return self._get(frame, scale)
+
+    def _get(self, frame, scale: float):
+        if frame is not self._frame:
+            self._frame = frame
+            self._scaled = {}
+        out = self._scaled.get(scale)
+        if out is None:
+            # even dimensions for yuv420p
+            w = max(2, int(frame.width * scale) & ~1)
+            h = max(2, int(frame.height * scale) & ~1)
+            out = frame.reformat(width=w, height=h, format="yuv420p")
+            out.pts = frame.pts
+            out.time_base = frame.time_base
+            self._scaled[scale] = out
+        return out
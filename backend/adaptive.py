@@ -0,0 +1,107 @@
+# adaptive.py — motion-gated, variable-interval inference scheduling per camera
+from typing import Optional
+
+import cv2
+import numpy as np
+
+
+class MotionGate:
+    """
+    Cheap motion measure: downscale to `width` px grey, compare against a
+    running-average background and return the fraction of changed pixels.
+    All buffers are allocated once for the source's frame size.
+    """
+
+    def __init__(self, width: int = 160, pixel_delta: int = 25, learn_rate: float = 0.05):
+        self.width = width
+        self.pixel_delta = pixel_delta
+        self.learn_rate = learn_rate
+        self._src_shape = None
+        self._size = None
+        self._small = self._gray = self._bg = self._bg_u8 = self._diff = None
+
+    def _alloc(self, shape):
+        h, w = shape[:2]
+        sw = min(self.width, w)
+        sh = max(1, int(round(h * sw / float(w))))
+        self._src_shape = (h, w)
+        self._size = (sw, sh)
+        self._small = np.empty((sh, sw, 3), dtype=np.uint8)
+        self._gray = np.empty((sh, sw), dtype=np.uint8)
+        self._bg = None
+        self._bg_u8 = np.empty((sh, sw), dtype=np.uint8)
+        self._diff = np.empty((sh, sw), dtype=np.uint8)
+
+    def motion(self, frame) -> float:
+        if self._src_shape != frame.shape[:2]:
+            self._alloc(frame.shape)
+        cv2.resize(frame, self._size, dst=self._small, interpolation=cv2.INTER_AREA)
+        cv2.cvtColor(self._small, cv2.COLOR_BGR2GRAY, dst=self._gray)
+        if self._bg is None:
+            self._bg = self._gray.astype(np.float32)
+            return 1.0   # first frame: treat as motion so we run inference once
+        cv2.convertScaleAbs(self._bg, dst=self._bg_u8)
+        cv2.absdiff(self._gray, self._bg_u8, dst=self._diff)
+        cv2.accumulateWeighted(self._gray, self._bg, self.learn_rate)
+        return float(np.count_nonzero(self._diff > self.pixel_delta)) / self._diff.size
+
+
+class AdaptiveScheduler:
+    """
+    Decides per frame whether to run the detector:
+
+    - motion above `motion_thresh`, or a HIGH/MEDIUM label in the last
+      inference -> every frame, and stay hot for `hold_frames` afterwards
+    - quiet scene that still has objects -> every `stable_interval` frames
+    - quiet and empty -> every `idle_interval` frames (safety net)
+
+    Callers carry the last boxes forward (tracker prediction) on skipped frames.
+    """
+
+    def __init__(self, motion_thresh: float = 0.004, stable_interval: int = 5,
+                 idle_interval: int = 30, hold_frames: int = 30, gate: Optional[MotionGate] = None):
+        self.gate = gate or MotionGate()
+        self.motion_thresh = motion_thresh
+        self.stable_interval = max(1, stable_interval)
+        self.idle_interval = max(1, idle_interval)
+        self.hold_frames = hold_frames
+        self._since_infer = 1 << 30  # force inference on the first frame
+        self._hot = 0
+        self._has_objects = False
+        self.last_motion = 0.0
+        self.frames = 0
+        self.inferred = 0
+
+    def should_infer(self, frame) -> bool:
+        self.frames += 1
+        self.last_motion = self.gate.motion(frame)
+        if self.last_motion >= self.motion_thresh:
+            self._hot = self.hold_frames
+        if self._hot > 0:
+            self._hot -= 1
+            interval = 1
+        elif self._has_objects:
+            interval = self.stable_interval
+        else:
+            interval = self.idle_interval
+        self._since_infer += 1
+        if self._since_infer >= interval:
+            self._since_infer = 0
+            self.inferred += 1
+            return True
+        return False
+
+    def observe(self, num_objects: int, threat: bool):
+        """Feed back the result of an inference that ran."""
+        self._has_objects = num_objects > 0
+        if threat:
+            self._hot = self.hold_frames
+
+    def stats(self):
+        return {
+            "frames": self.frames,
+            "inferred": self.inferred,
+            "skip_ratio": (1.0 - self.inferred / self.frames) if self.frames else 0.0,
+            "mode": "hot" if self._hot > 0 else ("stable" if self._has_objects else "idle"),
+            "motion": round(self.last_motion, 4),
+        }
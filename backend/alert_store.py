@@ -0,0 +1,557 @@
+# alert_store.py — append-only alert segments with a byte-offset index and tail cache
+import json
+import os
+import queue
+import threading
+import time
+from array import array
+from bisect import bisect_left
+from collections import deque
+from datetime import datetime, timezone
+from pathlib import Path
+from typing import Callable, Dict, Hashable, List, Optional
+
+LEVEL_CODES = {"low": 0, "medium": 1, "high": 2}
+SEGMENT_GLOB = "alerts-*.jsonl"
+PATCHES_FILE = "patches.jsonl"   # {"id": alert id, "fields": {...}} merged into reads
+LEGACY_FILE = "legacy.json"      # {"path", "size"}: the byte length the legacy file is frozen at
+
+
+# ---------- record helpers (mirror alerts-page.js) ----------
+def _parse_time(value) -> Optional[float]:
+    if value is None or value == "":
+        return None
+    if isinstance(value, (int, float)):
+        return float(value)
+    try:
+        return float(value)
+    except (TypeError, ValueError):
+        pass
+    try:
+        dt = datetime.fromisoformat(str(value).replace("Z", "+00:00"))
+    except ValueError:
+        return None
+    if dt.tzinfo is None:
+        dt = dt.astimezone()   # naive timestamps are local time
+    return dt.timestamp()
+
+def parse_since(value) -> Optional[float]:
+    """`since` query param: epoch seconds or ISO-8601."""
+    return _parse_time(value)
+
+def alert_timestamp(rec: dict) -> Optional[float]:
+    return _parse_time(rec.get("timestamp") or rec.get("created_at"))
+
+def alert_level(rec: dict) -> str:
+    ns = rec.get("neuralseek") if isinstance(rec.get("neuralseek"), dict) else {}
+    level = rec.get("frame_level") or rec.get("danger_level") or rec.get("severity") \
+        or ns.get("escalation_level") or "low"
+    return str(level).strip().lower()
+
+def alert_labels(rec: dict) -> List[str]:
+    labels = rec.get("labels") or rec.get("weapons_detected") or []
+    if isinstance(labels, str):
+        labels = [labels]
+    return [str(l).strip().lower() for l in labels if l]
+
+
+class _Segment:
+    """
+    One JSONL file plus its in-memory index: byte offset, timestamp and severity
+    per line, and label -> line numbers. Lines are numbered from `base_seq`.
+    """
+
+    def __init__(self, path: Path, base_seq: int, limit: Optional[int] = None):
+        self.path = path
+        self.base_seq = base_seq
+        self.limit = limit            # index at most this many bytes (frozen legacy file)
+        self.offsets = array("q")
+        self.times = array("d")
+        self.levels = bytearray()
+        self.labels = {}
+        self.size = 0                 # bytes indexed so far
+        self._last_ts = 0.0
+
+    def __len__(self):
+        return len(self.offsets)
+
+    def index(self, offset: int, rec: dict):
+        line_no = len(self.offsets)
+        # records are appended in time order; untimestamped ones inherit the previous time
+        ts = alert_timestamp(rec)
+        ts = self._last_ts if ts is None else max(ts, self._last_ts)
+        self._last_ts = ts
+        self.offsets.append(offset)
+        self.times.append(ts)
+        self.levels.append(LEVEL_CODES.get(alert_level(rec), 0))
+        for lab in alert_labels(rec):
+            self.labels.setdefault(lab, array("I")).append(line_no)
+        return ts
+
+    def refresh(self, on_record: Callable[[int, float, dict], None]):
+        """Index bytes appended since the last call (also picks up external writers)."""
+        try:
+            size = os.path.getsize(self.path)
+        except OSError:
+            return
+        if self.limit is not None:
+            size = min(size, self.limit)
+        if size <= self.size:
+            return
+        with open(self.path, "rb") as f:
+            f.seek(self.size)
+            data = f.read(size - self.size)
+        pos = 0
+        while pos < len(data):
+            nl = data.find(b"\n", pos)
+            end = len(data) if nl < 0 else nl
+            line = data[pos:end]
+            if line.strip():
+                try:
+                    rec = json.loads(line)
+                except Exception:
+                    if nl < 0:
+                        break      # partial trailing line; index it once it is complete
+                    rec = None
+                if isinstance(rec, dict):
+                    ts = self.index(self.size + pos, rec)
+                    on_record(self.base_seq + len(self) - 1, ts, rec)
+            pos = end + 1 if nl >= 0 else end
+        self.size += pos
+
+    def terminate(self) -> bytes:
+        """
+        Called before appending: returns b"\n" when the file ends in a torn line
+        (a crash mid-write), so that line stays one unparseable, skipped line
+        instead of swallowing the next record. Advances `size` to the file end.
+        """
+        try:
+            size = os.path.getsize(self.path)
+        except OSError:
+            return b""
+        if size == 0:
+            return b""
+        with open(self.path, "rb") as f:
+            f.seek(size - 1)
+            last = f.read(1)
+        if size > self.size:
+            print(f"[WARN] {self.path}: skipping {size - self.size} bytes of a torn last line")
+        self.size = size
+        return b"" if last == b"\n" else b"\n"
+
+    def read(self, f, line_no: int) -> dict:
+        f.seek(self.offsets[line_no])
+        rec = json.loads(f.readline())
+        rec.setdefault("id", self.base_seq + line_no)
+        return rec
+
+    def candidate_lines(self, lo: int, hi: int, label: Optional[str]):
+        """Line numbers in [lo, hi), newest first, optionally via the label index."""
+        if not label:
+            return range(hi - 1, lo - 1, -1)
+        hits = set()
+        for key, lines in self.labels.items():
+            if label in key:
+                hits.update(i for i in lines if lo <= i < hi)
+        return sorted(hits, reverse=True)
+
+
+class AlertStore:
+    """
+    Alerts live in day-partitioned segments `alerts-YYYYMMDD.jsonl` under
+    `directory` (the legacy single JSONL file, if present, is read as the
+    oldest segment). Every record gets a monotonically increasing `id`, which
+    doubles as a cursor.
+
+    Ids are positional (segment base + line number), so only the newest
+    segment may grow. The legacy file is frozen at the size it had when
+    first loaded (kept in LEGACY_FILE); lines appended to it later are
+    ignored rather than shifting the ids of every segment after it. A torn
+    last line (crash mid-write) is closed off before the next append and
+    skipped, like any line that does not parse.
+
+    Queries walk newest-first: first through the in-memory tail cache, then
+    through segment indexes, reading only the matching lines, so cost scales
+    with the result rather than the history.
+
+    Segments are never rewritten; `annotate` appends late fields (e.g. async
+    NeuralSeek results) to a patch log that is merged into records on read.
+    """
+
+    def __init__(self, directory: str, legacy_path: Optional[str] = None, tail_size: int = 1000):
+        self.dir = Path(directory)
+        self.dir.mkdir(parents=True, exist_ok=True)
+        self.legacy_path = Path(legacy_path) if legacy_path else None
+        self._lock = threading.RLock()
+        self._segments: List[_Segment] = []
+        self._tail = deque(maxlen=max(1, tail_size))   # (seq, ts, level_code, labels, rec)
+        self.next_seq = 0
+        self.listeners: List[Callable[[List[dict]], None]] = []   # called after each append
+        self.patch_listeners: List[Callable[[int, dict], None]] = []
+        self._patches: Dict[int, dict] = {}
+        self._load()
+
+    # ----- loading / indexing -----
+    def _cache(self, seq: int, ts: float, rec: dict):
+        rec.setdefault("id", seq)
+        if seq in self._patches:
+            rec.update(self._patches[seq])
+        self._tail.append((seq, ts, LEVEL_CODES.get(alert_level(rec), 0), alert_labels(rec), rec))
+
+    def _add_segment(self, path: Path, limit: Optional[int] = None) -> _Segment:
+        seg = _Segment(path, self.next_seq, limit)
+        self._segments.append(seg)
+        seg.refresh(self._cache)
+        self.next_seq = seg.base_seq + len(seg)
+        return seg
+
+    def _legacy_limit(self) -> int:
+        """Frozen byte length of the legacy file, recorded on first load."""
+        meta_path = self.dir / LEGACY_FILE
+        size = os.path.getsize(self.legacy_path)
+        try:
+            with open(meta_path, "r", encoding="utf-8") as f:
+                meta = json.load(f)
+            if meta.get("path") == str(self.legacy_path):
+                frozen = int(meta["size"])
+                if size > frozen:
+                    print(f"[WARN] {self.legacy_path} grew past its frozen size; "
+                          f"{size - frozen} new bytes are not indexed (write to {self.dir} instead)")
+                return frozen
+        except (OSError, ValueError, KeyError):
+            pass
+        with open(meta_path, "w", encoding="utf-8") as f:
+            json.dump({"path": str(self.legacy_path), "size": size}, f)
+        return size
+
+    def _load(self):
+        if self.legacy_path and self.legacy_path.exists():
+            self._add_segment(self.legacy_path, self._legacy_limit())
+        for p in sorted(p for p in self.dir.glob(SEGMENT_GLOB) if p != self.legacy_path):
+            self._add_segment(p)
+        patch_path = self.dir / PATCHES_FILE
+        if patch_path.exists():
+            with open(patch_path, "r", encoding="utf-8") as f:
+                for line in f:
+                    try:
+                        row = json.loads(line)
+                        self._patches.setdefault(int(row["id"]), {}).update(row["fields"])
+                    except Exception:
+                        continue
+            for seq, _ts, _lvl, _labels, rec in self._tail:
+                if seq in self._patches:
+                    rec.update(self._patches[seq])
+
+    def _refresh_tail_segment(self):
+        # only the newest day segment can grow (external writers included); the legacy file is frozen
+        if self._segments and self._segments[-1].limit is None:
+            seg = self._segments[-1]
+            seg.refresh(self._cache)
+            self.next_seq = seg.base_seq + len(seg)
+
+    def _segment_for_now(self) -> _Segment:
+        name = f"alerts-{datetime.now(timezone.utc).strftime('%Y%m%d')}.jsonl"
+        path = self.dir / name
+        if self._segments and self._segments[-1].path == path:
+            return self._segments[-1]
+        return self._add_segment(path)
+
+    # ----- writes -----
+    def append_many(self, records: List[dict], fsync: bool = False) -> List[dict]:
+        """Append records in one write; assigns `id` (and `timestamp` when missing)."""
+        if not records:
+            return []
+        with self._lock:
+            self._refresh_tail_segment()
+            seg = self._segment_for_now()
+            chunks = [seg.terminate()]
+            offset = seg.size + len(chunks[0])
+            for rec in records:
+                rec.setdefault("timestamp", datetime.now().astimezone().isoformat())
+                rec["id"] = self.next_seq
+                line = (json.dumps(rec, ensure_ascii=False) + "\n").encode("utf-8")
+                chunks.append(line)
+                ts = seg.index(offset, rec)
+                self._cache(self.next_seq, ts, rec)
+                offset += len(line)
+                self.next_seq += 1
+            with open(seg.path, "ab") as f:
+                f.write(b"".join(chunks))
+                if fsync:
+                    f.flush()
+                    os.fsync(f.fileno())
+            seg.size = offset
+        for fn in list(self.listeners):
+            try:
+                fn(records)
+            except Exception as e:
+                print(f"[WARN] alert listener failed: {e}")
+        return records
+
+    def append(self, record: dict, fsync: bool = False) -> dict:
+        return self.append_many([record], fsync=fsync)[0]
+
+    def annotate(self, alert_id: int, fields: dict):
+        """Attach `fields` to a stored alert without rewriting its segment."""
+        alert_id = int(alert_id)
+        with self._lock:
+            with open(self.dir / PATCHES_FILE, "a", encoding="utf-8") as f:
+                f.write(json.dumps({"id": alert_id, "fields": fields}, ensure_ascii=False) + "\n")
+            self._patches.setdefault(alert_id, {}).update(fields)
+            for seq, _ts, _lvl, _labels, rec in reversed(self._tail):
+                if seq == alert_id:
+                    rec.update(fields)
+                    break
+        for fn in list(self.patch_listeners):
+            try:
+                fn(alert_id, fields)
+            except Exception as e:
+                print(f"[WARN] alert patch listener failed: {e}")
+
+    # ----- reads -----
+    def query(self, limit: Optional[int] = None, since: Optional[float] = None,
+              severity: Optional[str] = None, label: Optional[str] = None,
+              after: Optional[int] = None, before: Optional[int] = None) -> List[dict]:
+        """
+        Newest-first alerts matching every given filter:
+        since (epoch s), severity (low/medium/high), label (case-insensitive
+        substring of any label), after (only ids > after) and before (only
+        ids < before). Ids are contiguous, so after/before select an exact
+        id window, e.g. the oldest unsent batch.
+        """
+        limit = limit if limit and limit > 0 else None
+        code = LEVEL_CODES.get(severity.lower()) if severity and severity.lower() != "all" else None
+        label = label.strip().lower() if label else None
+        floor = -1 if after is None else int(after)
+        ceil = None if before is None else int(before)
+        out: List[dict] = []
+
+        with self._lock:
+            self._refresh_tail_segment()
+
+            # fast path: tail cache
+            for seq, ts, lvl, labels, rec in reversed(self._tail):
+                if seq <= floor or (since is not None and ts < since):
+                    return out
+                if ceil is not None and seq >= ceil:
+                    continue
+                if code is not None and lvl != code:
+                    continue
+                if label and not any(label in l for l in labels):
+                    continue
+                out.append(rec)
+                if limit and len(out) >= limit:
+                    return out
+            upto = self._tail[0][0] if self._tail else self.next_seq
+            if ceil is not None:
+                upto = min(upto, ceil)
+            if upto <= floor + 1:
+                return out
+
+            # slow path: walk indexed segments backwards, reading matching lines only
+            for seg in reversed(self._segments):
+                if seg.base_seq >= upto or not len(seg):
+                    continue
+                hi = min(len(seg), upto - seg.base_seq)
+                lo = max(0, floor + 1 - seg.base_seq)
+                if since is not None:
+                    lo = max(lo, bisect_left(seg.times, since, 0, hi))
+                with open(seg.path, "rb") as f:
+                    for i in seg.candidate_lines(lo, hi, label):
+                        if code is not None and seg.levels[i] != code:
+                            continue
+                        try:
+                            rec = seg.read(f, i)
+                        except Exception:
+                            continue
+                        patch = self._patches.get(rec["id"])
+                        if patch:
+                            rec.update(patch)
+                        out.append(rec)
+                        if limit and len(out) >= limit:
+                            return out
+                if lo > 0:
+                    break   # older segments are entirely before since/after
+        return out
+
+    def stats(self):
+        with self._lock:
+            return {
+                "segments": len(self._segments),
+                "alerts": self.next_seq,
+                "tail_cached": len(self._tail),
+            }
+
+
+class AlertSink:
+    """
+    Non-blocking front door for alert producers (frame loops).
+
+    `submit` never touches disk: repeats of the same `key` (e.g. camera +
+    labels) inside `coalesce_sec` are folded into the first alert, and the
+    rest go onto a bounded queue (dropped and counted when full). Once that
+    first alert is stored, the writer thread attaches `repeat_count` and
+    `last_seen` to it through store.annotate(); `clip_done` does the same for
+    clip status on every alert that carries that clip path. A writer
+    thread group-commits the queue to the store with one write + fsync per
+    `batch_size` records or `flush_sec`, whichever comes first. With no store
+    it only coalesces (submit still reports whether an alert is new).
+    """
+
+    def __init__(self, store: Optional[AlertStore], max_queue: int = 1024, batch_size: int = 64,
+                 flush_sec: float = 0.5, coalesce_sec: float = 10.0, fsync: bool = True):
+        self.store = store
+        self.batch_size = max(1, batch_size)
+        self.flush_sec = flush_sec
+        self.coalesce_sec = coalesce_sec
+        self.fsync = fsync
+        self._q: "queue.Queue[dict]" = queue.Queue(maxsize=max(1, max_queue))
+        self._recent: Dict[Hashable, list] = {}   # key -> [first submit time, first record, repeats, last_seen]
+        self._dirty: Dict[Hashable, list] = {}    # runs with repeats not yet annotated
+        self._clips: Dict[str, List[dict]] = {}   # clip path -> submitted records carrying it
+        self._late: List[tuple] = []              # (record, fields, deadline) waiting for its id
+        self._lock = threading.Lock()
+        self._stop = threading.Event()
+        self._thread: Optional[threading.Thread] = None
+
+        self.submitted = 0
+        self.coalesced = 0
+        self.dropped = 0
+        self.commits = 0
+        self.committed = 0
+        self.max_depth = 0
+        self.last_commit_ms = 0.0
+
+    def start(self):
+        if self._thread is None or not self._thread.is_alive():
+            self._stop.clear()
+            self._thread = threading.Thread(target=self._run, name="alert-sink", daemon=True)
+            self._thread.start()
+        return self
+
+    def close(self, timeout: float = 5.0):
+        """Stop the writer after flushing whatever is queued."""
+        self._stop.set()
+        if self._thread is not None and self._thread.is_alive():
+            self._thread.join(timeout)
+        self._thread = None
+
+    def submit(self, record: dict, key: Optional[Hashable] = None, now: Optional[float] = None) -> bool:
+        """
+        True if queued; False if coalesced into a recent alert or dropped.
+        `now` is the clock coalescing runs on (default monotonic; offline
+        passes media time) and must be the same clock for every call.
+        """
+        now = time.monotonic() if now is None else now
+        run = None
+        with self._lock:
+            self.submitted += 1
+            if key is not None:
+                run = self._recent.get(key)
+                if run is not None and now - run[0] < self.coalesce_sec:
+                    self.coalesced += 1
+                    run[2] += 1
+                    run[3] = record.get("timestamp") or datetime.now().astimezone().isoformat()
+                    if self.store is not None:
+                        self._dirty[key] = run
+                    return False
+                run = self._recent[key] = [now, record, 0, None]
+                if len(self._recent) > 4096:
+                    cutoff = now - self.coalesce_sec
+                    self._recent = {k: r for k, r in self._recent.items() if r[0] >= cutoff}
+                    self._dirty = {k: r for k, r in self._dirty.items() if k in self._recent}
+        if self.store is None:
+            return True
+        try:
+            self._q.put_nowait(record)
+        except queue.Full:
+            with self._lock:
+                self.dropped += 1
+                # never stored: repeats must start a new run, not fold into this one
+                if run is not None and self._recent.get(key) is run:
+                    del self._recent[key]
+                    self._dirty.pop(key, None)
+            return False
+        if record.get("clip"):
+            with self._lock:
+                self._clips.setdefault(record["clip"], []).append(record)
+                if len(self._clips) > 1024:   # clips that never finished
+                    self._clips.pop(next(iter(self._clips)))
+        depth = self._q.qsize()
+        if depth > self.max_depth:
+            self.max_depth = depth
+        return True
+
+    def _drain(self, first: dict) -> List[dict]:
+        batch = [first]
+        deadline = time.monotonic() + self.flush_sec
+        while len(batch) < self.batch_size:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                break
+            try:
+                batch.append(self._q.get(timeout=remaining))
+            except queue.Empty:
+                break
+        return batch
+
+    def clip_done(self, path: str, fields: dict):
+        """Attach `fields` (clip status) to the alerts submitted with record["clip"] == path."""
+        if self.store is None:
+            return
+        deadline = time.monotonic() + 30.0
+        with self._lock:
+            self._late.extend((rec, fields, deadline) for rec in self._clips.pop(path, ()))
+
+    def _annotate_pending(self):
+        """Write repeats and clip status onto alerts that are already stored."""
+        now = time.monotonic()
+        with self._lock:
+            ready = [(k, r) for k, r in self._dirty.items() if "id" in r[1]]
+            for k, _r in ready:
+                del self._dirty[k]
+            updates = [(r[1]["id"], {"repeat_count": r[2], "last_seen": r[3]}) for _k, r in ready]
+            updates += [(rec["id"], fields) for rec, fields, _d in self._late if "id" in rec]
+            # records that never got an id (dropped by a failed commit) give up at their deadline
+            self._late = [e for e in self._late if "id" not in e[0] and e[2] > now]
+        for alert_id, fields in updates:
+            try:
+                self.store.annotate(alert_id, fields)
+            except Exception as e:
+                print(f"[WARN] could not annotate alert {alert_id}: {e}")
+
+    def _run(self):
+        while not (self._stop.is_set() and self._q.empty()):
+            try:
+                first = self._q.get(timeout=0.25)
+            except queue.Empty:
+                self._annotate_pending()
+                continue
+            batch = self._drain(first)
+            t0 = time.perf_counter()
+            try:
+                self.store.append_many(batch, fsync=self.fsync)
+                self.commits += 1
+                self.committed += len(batch)
+            except Exception as e:
+                with self._lock:
+                    self.dropped += len(batch)
+                print(f"[WARN] alert commit failed ({len(batch)} alerts): {e}")
+            self.last_commit_ms = (time.perf_counter() - t0) * 1000.0
+            self._annotate_pending()
+        self._annotate_pending()
+
+    def stats(self):
+        depth = self._q.qsize()
+        return {
+            "queued": depth,
+            "max_queue": self._q.maxsize,
+            "backpressure": depth / float(self._q.maxsize),
+            "max_depth": self.max_depth,
+            "submitted": self.submitted,
+            "coalesced": self.coalesced,
+            "dropped": self.dropped,
+            "commits": self.commits,
+            "committed": self.committed,
+            "last_commit_ms": round(self.last_commit_ms, 3),
+        }
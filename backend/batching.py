@@ -0,0 +1,184 @@
+# batching.py — one inference thread batching the newest frame of every camera
+import threading
+import time
+from typing import Any, Callable, List, Optional
+
+SKIPPED = object()   # `result` for frames `admit` declined to run through the model
+
+
+class LatestSlot:
+    """
+    Single-value handoff: producer overwrites, consumer waits for something
+    newer. `listeners` are called (on the producer thread) after every put,
+    e.g. to wake an asyncio consumer without parking a thread in get_newer().
+    """
+
+    def __init__(self):
+        self._cond = threading.Condition()
+        self._value = None
+        self._seq = 0
+        self._closed = False
+        self.listeners: List[Callable[[], None]] = []
+
+    def put(self, value):
+        with self._cond:
+            self._value = value
+            self._seq += 1
+            self._cond.notify_all()
+        for fn in list(self.listeners):
+            try:
+                fn()
+            except Exception:
+                pass
+
+    def get_newer(self, seq: int, timeout: float = 1.0):
+        """Returns (value, seq) once seq has advanced past `seq`, else None."""
+        with self._cond:
+            self._cond.wait_for(lambda: self._closed or self._seq > seq, timeout)
+            if self._seq <= seq:
+                return None
+            return self._value, self._seq
+
+    def close(self):
+        with self._cond:
+            self._closed = True
+            self._cond.notify_all()
+
+
+class BatchScheduler:
+    """
+    Collects at most one (newest) frame per registered source and runs them
+    through a single `infer(images, sources) -> results` call.
+
+    A batch is dispatched as soon as every source has contributed, `max_batch`
+    frames are collected, or `max_wait` seconds have passed since the first
+    frame of the batch arrived. `handle(source, image, ts, result)` is then
+    called per frame on this thread; `result` is the exception instead when
+    inference failed. Sources only need a `.ring` (FrameRing).
+
+    `admit(source, image) -> bool`, if given, can decline a frame (e.g. idle
+    camera); it is then handled right away with `result=SKIPPED`.
+    `batch_started` (wall clock) is set just before each infer() call.
+    """
+
+    def __init__(self, infer: Callable[[List[Any], List[Any]], List[Any]],
+                 handle: Callable[[Any, Any, float, Any], None],
+                 max_batch: int = 16, max_wait: float = 0.010,
+                 admit: Optional[Callable[[Any, Any], bool]] = None):
+        self._infer = infer
+        self._handle = handle
+        self._admit = admit
+        self.max_batch = max(1, int(max_batch))
+        self.max_wait = max(0.0, float(max_wait))
+        self._sources: List[Any] = []
+        self._lock = threading.Lock()
+        self.wake = threading.Event()      # set by every ring commit
+        self._stop = threading.Event()
+        self._thread: Optional[threading.Thread] = None
+
+        self.batches = 0
+        self.frames = 0
+        self.skipped = 0
+        self.largest_batch = 0
+        self.batch_started = 0.0
+
+    # ----- registry -----
+    def add(self, src):
+        with self._lock:
+            if src not in self._sources:
+                self._sources.append(src)
+        src.ring.listener = self.wake
+        self.wake.set()
+
+    def remove(self, src):
+        with self._lock:
+            if src in self._sources:
+                self._sources.remove(src)
+
+    # ----- lifecycle -----
+    def start(self):
+        if self._thread is None or not self._thread.is_alive():
+            self._stop.clear()
+            self._thread = threading.Thread(target=self._run, name="batch-infer", daemon=True)
+            self._thread.start()
+        return self
+
+    def stop(self, timeout: float = 2.0):
+        self._stop.set()
+        self.wake.set()
+        if self._thread is not None and self._thread.is_alive():
+            self._thread.join(timeout)
+        self._thread = None
+
+    def stats(self):
+        return {
+            "batches": self.batches,
+            "frames": self.frames,
+            "skipped": self.skipped,
+            "avg_batch": (self.frames / self.batches) if self.batches else 0.0,
+            "largest_batch": self.largest_batch,
+            "max_batch": self.max_batch,
+            "max_wait_ms": self.max_wait * 1000.0,
+        }
+
+    # ----- loop -----
+    def _collect(self):
+        batch = []
+        taken = set()      # sources in this batch or already handled as SKIPPED
+        deadline = None
+        while not self._stop.is_set():
+            # clear before scanning so a commit racing the scan re-arms the wait
+            self.wake.clear()
+            with self._lock:
+                sources = list(self._sources)
+            for src in sources:
+                if id(src) in taken or len(batch) >= self.max_batch:
+                    continue
+                got = src.ring.acquire_latest(0)
+                if got is None:
+                    continue
+                taken.add(id(src))
+                if self._admit is not None and not self._admit(src, got[0]):
+                    self._dispatch(src, got[0], got[2], SKIPPED)
+                    self.skipped += 1
+                    continue
+                batch.append((src,) + tuple(got))
+            if len(batch) >= self.max_batch or (batch and len(taken) >= len(sources)):
+                break
+            if not batch:
+                if taken:
+                    return batch   # only skipped frames this round; start a fresh one
+                self.wake.wait(0.1)
+                continue
+            if deadline is None:
+                deadline = time.monotonic() + self.max_wait
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                break
+            self.wake.wait(remaining)
+        return batch
+
+    def _run(self):
+        while not self._stop.is_set():
+            batch = self._collect()
+            if not batch:
+                continue
+            images = [item[1] for item in batch]
+            self.batch_started = time.time()
+            try:
+                results = list(self._infer(images, [item[0] for item in batch]))
+            except Exception as e:
+                results = [e] * len(batch)
+            self.batches += 1
+            self.frames += len(batch)
+            self.largest_batch = max(self.largest_batch, len(batch))
+            for (src, img, _seq, ts), res in zip(batch, results):
+                self._dispatch(src, img, ts, res)
+
+    def _dispatch(self, src, img, ts, res):
+        try:
+            self._handle(src, img, ts, res)
+        except Exception as e:
+            print(f"[WARN] batch handler failed: {e}")
+        finally:
+            src.ring.release()
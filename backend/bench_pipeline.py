@@ -0,0 +1,321 @@
+#!/usr/bin/env python3
+"""
+bench_pipeline.py — offline, headless benchmark of the detection pipeline.
+
+Replays recorded clips (no pacing, no windows) through the same per-frame
+stages as the live code and sweeps IMG_SIZE x backend x batch size x camera
+count:
+
+  server  decode -> batched predict -> detections -> draw -> I420 VideoFrame
+          (server.py: BatchScheduler + _publish_annotated feeding VideoTrack.recv)
+  live    decode -> batched detect -> SimpleTracker -> extract_features -> score
+          (danger_yolo_live.py main loop with --realtime 0)
+
+Each camera replays one clip (clips are reused round-robin and loop at EOF).
+Per-frame latency runs from the start of that frame's decode to the end of its
+last stage, so batching delay is included. Results are JSON, one entry per
+configuration: latency_ms {p50,p95,p99,mean,max}, throughput_fps, per-stage
+p50/p95 ms, peak_rss_mb and peak_gpu_mb.
+
+Example:
+  python bench_pipeline.py --clips lobby.mp4 atm.mp4 --img-sizes 320,640 \\
+      --backends torch,onnx --batch-sizes 1,4,8 --cameras 1,4 --frames 300 --out bench.json
+"""
+
+import argparse
+import itertools
+import json
+import os
+import platform
+import sys
+import tempfile
+import threading
+import time
+from collections import defaultdict
+from types import SimpleNamespace
+from typing import Dict, List
+
+import cv2
+import numpy as np
+
+from inference_backends import load_backend
+
+
+def _csv(value: str, cast=str) -> List:
+    return [cast(v) for v in str(value).split(",") if v.strip()]
+
+
+# -------------------------
+# Inputs / measurement
+# -------------------------
+class ClipReader:
+    """Endless decode of one clip into a reused buffer; media time from frame index / fps."""
+
+    def __init__(self, path: str):
+        self.path = path
+        self.cap = cv2.VideoCapture(path)
+        if not self.cap.isOpened():
+            raise SystemExit(f"Failed to open clip: {path}")
+        fps = self.cap.get(cv2.CAP_PROP_FPS)
+        self.fps = fps if fps and fps > 0 else 30.0
+        self.index = 0
+        self._buf = None
+
+    def read(self):
+        ok, img = self.cap.read(self._buf)
+        if not ok:
+            self.cap.set(cv2.CAP_PROP_POS_FRAMES, 0)
+            ok, img = self.cap.read(self._buf)
+            if not ok:
+                raise SystemExit(f"Clip has no decodable frames: {self.path}")
+        self._buf = img
+        self.index += 1
+        return img, self.index / self.fps
+
+    def close(self):
+        self.cap.release()
+
+
+def _rss_bytes() -> int:
+    try:
+        with open("/proc/self/statm") as f:
+            return int(f.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+    except Exception:
+        import resource
+        scale = 1 if sys.platform == "darwin" else 1024   # ru_maxrss: bytes on macOS, KiB on Linux
+        return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss * scale
+
+
+class PeakMemory:
+    """Samples process RSS every `interval` s (and torch's CUDA peak, if torch is loaded)."""
+
+    def __init__(self, interval: float = 0.01):
+        self.interval = interval
+        self.peak = 0
+        self._stop = threading.Event()
+        self._thread = None
+
+    def __enter__(self):
+        self.peak = _rss_bytes()
+        torch = sys.modules.get("torch")
+        if torch is not None and torch.cuda.is_available():
+            torch.cuda.reset_peak_memory_stats()
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+        return self
+
+    def _run(self):
+        while not self._stop.wait(self.interval):
+            self.peak = max(self.peak, _rss_bytes())
+
+    def __exit__(self, *exc):
+        self._stop.set()
+        self._thread.join()
+        self.peak = max(self.peak, _rss_bytes())
+
+    @staticmethod
+    def gpu_peak():
+        torch = sys.modules.get("torch")
+        if torch is None or not torch.cuda.is_available():
+            return None
+        return max(torch.cuda.max_memory_allocated(i) for i in range(torch.cuda.device_count()))
+
+
+def _summary_ms(values) -> Dict[str, float]:
+    if not values:
+        return {}
+    a = np.asarray(values, dtype=np.float64) * 1000.0
+    p50, p95, p99 = np.percentile(a, [50, 95, 99])
+    return {"p50": round(p50, 3), "p95": round(p95, 3), "p99": round(p99, 3),
+            "mean": round(float(a.mean()), 3), "max": round(float(a.max()), 3)}
+
+
+# -------------------------
+# Pipelines
+# -------------------------
+def _import_server():
+    # keep the import from touching the real alert store
+    tmp = tempfile.mkdtemp(prefix="bench-alerts-")
+    os.environ.setdefault("ALERTS_DIR", tmp)
+    os.environ.setdefault("ALERTS_JSONL", os.path.join(tmp, "alerts.jsonl"))
+    import server
+    return server
+
+
+class ServerStages:
+    """server.py post-inference path for one camera."""
+
+    def __init__(self, server, model, imgsz: int, conf: float):
+        self.server = server
+        self.model = model
+        self.imgsz = imgsz
+        self.conf = conf
+
+    def new_camera(self, cam_id: str):
+        return SimpleNamespace(cam_id=cam_id, yuv=None)
+
+    def process(self, frames, cams, ts_list, timings):
+        t0 = time.perf_counter()
+        results = self.model.predict(list(frames), imgsz=self.imgsz, conf=self.conf)
+        per = (time.perf_counter() - t0) / len(frames)
+        for img, cam, res in zip(frames, cams, results):
+            timings["inference"].append(per)
+            t1 = time.perf_counter()
+            detections, error = self.server._extract_detections(res)
+            t2 = time.perf_counter()
+            img, _level = self.server._draw_detections(img, detections, error)
+            t3 = time.perf_counter()
+            self.server._to_video_frame(img, cam)
+            t4 = time.perf_counter()
+            timings["postprocess"].append(t2 - t1)
+            timings["draw"].append(t3 - t2)
+            timings["convert"].append(t4 - t3)
+
+
+class LiveStages:
+    """danger_yolo_live.py loop body for one camera (no display, no alert I/O)."""
+
+    def __init__(self, live, model, imgsz: int, camera_type: str):
+        self.live = live
+        self.detector = live.Yolo10Detector(backend=model, device=model.device, imgsz=imgsz)
+        self.camera_type = camera_type
+        self.scorer = live.BatchScorer(capacity=1024)
+
+    def new_camera(self, cam_id: str):
+        return SimpleNamespace(cam_id=cam_id, tracker=self.live.SimpleTracker())
+
+    def process(self, frames, cams, ts_list, timings):
+        t0 = time.perf_counter()
+        all_dets = self.detector.detect_batch(frames, max_batch=len(frames))
+        per = (time.perf_counter() - t0) / len(frames)
+        live = self.live
+        for cam, dets, ts in zip(cams, all_dets, ts_list):
+            timings["inference"].append(per)
+            t1 = time.perf_counter()
+            tracks = cam.tracker.update(dets, ts, self.camera_type)
+            t2 = time.perf_counter()
+            features = live.extract_features(live.SceneState(timestamp=ts, camera_type=self.camera_type,
+                                                              tracks=tracks, zones=cam.tracker.zones))
+            t3 = time.perf_counter()
+            self.scorer.add(features)
+            timings["tracker"].append(t2 - t1)
+            timings["features"].append(t3 - t2)
+        # the whole chunk of cameras is scored in one call
+        t4 = time.perf_counter()
+        self.scorer.score()
+        per_score = (time.perf_counter() - t4) / len(frames)
+        timings["scoring"].extend([per_score] * len(frames))
+
+
+# -------------------------
+# Runner
+# -------------------------
+def run_config(stages, clips: List[str], cameras: int, batch: int, frames: int, warmup: int):
+    readers = [ClipReader(clips[i % len(clips)]) for i in range(cameras)]
+    cams = [stages.new_camera(f"cam-{i + 1}") for i in range(cameras)]
+    timings = defaultdict(list)
+    latencies = []
+    done = 0
+    ticks = 0
+    start = None
+    with PeakMemory() as mem:
+        while done < frames:
+            if ticks == warmup:
+                timings.clear()
+                latencies.clear()
+                start = time.perf_counter()
+            # one frame per camera per tick, processed in chunks of `batch`
+            decoded = []
+            for reader, cam in zip(readers, cams):
+                t0 = time.perf_counter()
+                img, media_ts = reader.read()
+                timings["decode"].append(time.perf_counter() - t0)
+                decoded.append((t0, img, cam, media_ts))
+            for i in range(0, len(decoded), batch):
+                chunk = decoded[i:i + batch]
+                stages.process([c[1] for c in chunk], [c[2] for c in chunk], [c[3] for c in chunk], timings)
+                end = time.perf_counter()
+                latencies.extend(end - c[0] for c in chunk)
+            ticks += 1
+            if ticks > warmup:
+                done += len(decoded)
+        elapsed = time.perf_counter() - start
+    for r in readers:
+        r.close()
+    gpu = PeakMemory.gpu_peak()
+    return {
+        "frames": len(latencies),
+        "elapsed_sec": round(elapsed, 3),
+        "throughput_fps": round(len(latencies) / elapsed, 2) if elapsed > 0 else None,
+        "per_camera_fps": round(len(latencies) / elapsed / cameras, 2) if elapsed > 0 else None,
+        "latency_ms": _summary_ms(latencies),
+        "stages_ms": {k: {kk: v for kk, v in _summary_ms(vals).items() if kk in ("p50", "p95")}
+                      for k, vals in timings.items()},
+        "peak_rss_mb": round(mem.peak / 2**20, 1),
+        "peak_gpu_mb": round(gpu / 2**20, 1) if gpu is not None else None,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Offline detection pipeline benchmark")
+    parser.add_argument("--clips", nargs="+", required=True, help="Recorded video files to replay")
+    parser.add_argument("--weights", default=os.getenv("YOLO_WEIGHTS", "yolo11n.pt"))
+    parser.add_argument("--device", default=os.getenv("YOLO_DEVICE", None), help="cpu, cuda, mps or index")
+    parser.add_argument("--pipeline", choices=["server", "live", "both"], default="both")
+    parser.add_argument("--img-sizes", default="640", help="Comma-separated IMG_SIZE values")
+    parser.add_argument("--backends", default="torch", help="Comma-separated inference backends")
+    parser.add_argument("--batch-sizes", default="1", help="Comma-separated max batch sizes")
+    parser.add_argument("--cameras", default="1", help="Comma-separated camera counts")
+    parser.add_argument("--frames", type=int, default=300, help="Measured frames per configuration")
+    parser.add_argument("--warmup", type=int, default=10, help="Unmeasured ticks per configuration")
+    parser.add_argument("--conf", type=float, default=0.25)
+    parser.add_argument("--camera-type", choices=["ATM", "PARKING"], default="ATM")
+    parser.add_argument("--out", default=None, help="Write JSON here instead of stdout")
+    args = parser.parse_args()
+
+    pipelines = ["server", "live"] if args.pipeline == "both" else [args.pipeline]
+    server = _import_server() if "server" in pipelines else None
+    live = None
+    if "live" in pipelines:
+        import danger_yolo_live as live
+
+    results = []
+    sweep = itertools.product(_csv(args.backends), _csv(args.img_sizes, int), _csv(args.batch_sizes, int))
+    for backend, imgsz, batch in sweep:
+        try:
+            model = load_backend(args.weights, backend, imgsz=imgsz, device=args.device, batch=batch)
+        except Exception as e:
+            print(f"[WARN] skipping backend={backend} imgsz={imgsz} batch={batch}: {e}", file=sys.stderr)
+            continue
+        for cameras in _csv(args.cameras, int):
+            for name in pipelines:
+                stages = ServerStages(server, model, imgsz, args.conf) if name == "server" \
+                    else LiveStages(live, model, imgsz, args.camera_type)
+                config = {"pipeline": name, "backend": model.name, "requested_backend": backend,
+                          "img_size": imgsz, "batch": batch, "cameras": cameras}
+                print(f"[INFO] running {config}", file=sys.stderr)
+                out = run_config(stages, args.clips, cameras, max(1, batch), args.frames, args.warmup)
+                results.append(dict(config, **out))
+                print(f"[INFO]   p50={out['latency_ms'].get('p50')}ms p99={out['latency_ms'].get('p99')}ms "
+                      f"throughput={out['throughput_fps']} fps", file=sys.stderr)
+        del model
+
+    report = {
+        "host": {"platform": platform.platform(), "python": platform.python_version(),
+                 "cpu_count": os.cpu_count(), "device": args.device},
+        "clips": args.clips,
+        "weights": args.weights,
+        "results": results,
+    }
+    text = json.dumps(report, indent=2)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(text + "\n")
+        print(f"[INFO] wrote {args.out}", file=sys.stderr)
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,178 @@
+# capture.py — capture thread feeding a preallocated latest-frame ring
+import threading
+import time
+from typing import Callable, Optional, Tuple
+
+import cv2
+import numpy as np
+
+
+class FrameRing:
+    """
+    Small fixed set of frame slots shared by one writer (the capture thread)
+    and one reader (the inference stage).
+
+    The writer never touches the newest slot or the slot the reader has checked
+    out, so with >= 3 slots it always has somewhere to decode into and, once
+    the first frame has sized the buffers, never allocates again. The reader
+    always gets the newest frame; anything it never saw counts as dropped.
+    """
+
+    def __init__(self, slots: int = 3):
+        self._n = max(3, int(slots))
+        self._bufs = [None] * self._n
+        self._seqs = [0] * self._n
+        self._stamps = [0.0] * self._n
+        self._latest = -1          # slot holding the newest frame
+        self._busy = -1            # slot checked out by the reader
+        self._seq = 0              # seq of the newest frame
+        self._read_seq = 0         # seq of the last frame handed to the reader
+        self._closed = False
+        self._cond = threading.Condition()
+        self.listener: Optional[threading.Event] = None   # set on every commit
+
+        self.written = 0
+        self.dropped = 0
+
+    # ----- writer side -----
+    def begin_write(self) -> Tuple[int, Optional[np.ndarray]]:
+        """Pick a free slot; returns (slot, buffer-or-None) for `cap.read(buffer)`."""
+        with self._cond:
+            for off in range(1, self._n + 1):
+                i = (self._latest + off) % self._n
+                if i != self._latest and i != self._busy:
+                    return i, self._bufs[i]
+        raise RuntimeError("FrameRing has no free slot")  # unreachable with >= 3 slots
+
+    def commit(self, slot: int, img: np.ndarray, ts: float):
+        with self._cond:
+            # cap.read() only reallocates when the frame size changed
+            self._bufs[slot] = img
+            if self._latest >= 0 and self._seqs[self._latest] > self._read_seq:
+                self.dropped += 1   # previous newest frame was never consumed
+            self._seq += 1
+            self._seqs[slot] = self._seq
+            self._stamps[slot] = ts
+            self._latest = slot
+            self.written += 1
+            self._cond.notify_all()
+        if self.listener is not None:
+            self.listener.set()
+
+    def close(self):
+        with self._cond:
+            self._closed = True
+            self._cond.notify_all()
+
+    @property
+    def unread(self) -> int:
+        """1 while the newest frame has not been handed to the reader yet."""
+        return 1 if self._seq > self._read_seq else 0
+
+    # ----- reader side -----
+    def acquire_latest(self, timeout: float = 1.0):
+        """
+        Block until a frame newer than the last one read is available.
+        Returns (img, seq, ts) and keeps that slot checked out until `release()`,
+        or None on timeout/close. The image may be drawn on in place.
+        """
+        with self._cond:
+            ready = self._cond.wait_for(
+                lambda: self._closed or self._seq > self._read_seq, timeout
+            )
+            if not ready or self._seq <= self._read_seq:
+                return None
+            i = self._latest
+            self._busy = i
+            self._read_seq = self._seqs[i]
+            return self._bufs[i], self._seqs[i], self._stamps[i]
+
+    def release(self):
+        with self._cond:
+            self._busy = -1
+
+
+class CaptureThread:
+    """
+    Reads `cap` as fast as the source delivers into `ring` (keeps RTSP buffers
+    drained). `on_read(seconds)`, if given, gets the duration of every
+    successful read (source wait + decode).
+
+    A file source stops at its end (`eof`): a failed read at or past
+    CAP_PROP_FRAME_COUNT, or `max_failures` failed reads in a row when the
+    position is unknown. A live source (no frame count) keeps retrying with
+    backoff and is flagged `stalled` after `max_failures` until a read works.
+    """
+
+    def __init__(self, cap: "cv2.VideoCapture", ring: FrameRing, name: str = "capture",
+                 on_read: Optional[Callable[[float], None]] = None, max_failures: int = 100):
+        self._cap = cap
+        self._ring = ring
+        self._on_read = on_read
+        self.max_failures = max(1, max_failures)
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, name=name, daemon=True)
+        self.frames = 0
+        self.read_errors = 0
+        self.eof = False
+        self.stalled = False
+        try:
+            self._length = int(cap.get(cv2.CAP_PROP_FRAME_COUNT) or 0)
+        except Exception:
+            self._length = 0
+
+    @property
+    def state(self) -> str:
+        return "eof" if self.eof else "stalled" if self.stalled else "running"
+
+    def _at_end(self, failures: int) -> bool:
+        if getattr(self._cap, "eof", False):   # hw_codec.PyAVCapture: demuxer hit the end
+            return True
+        if self._length <= 0:
+            return False   # live source
+        try:
+            if self._cap.get(cv2.CAP_PROP_POS_FRAMES) >= self._length:
+                return True
+        except Exception:
+            pass
+        return failures >= self.max_failures
+
+    def start(self):
+        try: self._cap.set(cv2.CAP_PROP_BUFFERSIZE, 1)
+        except Exception: pass
+        self._thread.start()
+        return self
+
+    def stop(self, timeout: float = 2.0):
+        self._stop.set()
+        self._ring.close()
+        if self._thread.is_alive():
+            self._thread.join(timeout)
+
+    def _run(self):
+        failures = 0
+        while not self._stop.is_set():
+            slot, buf = self._ring.begin_write()
+            t0 = time.perf_counter()
+            try:
+                ok, img = self._cap.read(buf) if buf is not None else self._cap.read()
+            except Exception:
+                ok, img = False, None
+            if not ok or img is None:
+                self.read_errors += 1
+                failures += 1
+                if self._at_end(failures):
+                    self.eof = True
+                    print(f"[INFO] {self._thread.name}: end of source after {self.frames} frames")
+                    return
+                if failures == self.max_failures:
+                    self.stalled = True
+                    print(f"[WARN] {self._thread.name}: {failures} failed reads in a row; still retrying")
+                self._stop.wait(min(1.0, 0.05 * (1 + failures // 20)))
+                continue
+            failures = 0
+            self.stalled = False
+            if self._on_read is not None:
+                self._on_read(time.perf_counter() - t0)
+            self._ring.commit(slot, img, time.time())
+            self.frames += 1
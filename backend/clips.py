@@ -0,0 +1,323 @@
+# clips.py — per-camera pre-roll ring of encoded packets; alert clips muxed to MP4 without re-encoding
+import os
+import queue
+import threading
+import time
+from collections import deque
+from datetime import datetime
+from fractions import Fraction
+from pathlib import Path
+from typing import Callable, Deque, List, Optional, Tuple
+
+import av
+from av import VideoFrame
+
+MS = Fraction(1, 1000)   # packet / stream time base
+Entry = Tuple[bytes, int, int, bool, float]   # data, pts, dts, keyframe, capture ts
+
+
+class _Clip:
+    def __init__(self, path: str, start_ts: float, end_ts: float, packets: List[Entry]):
+        self.path = path
+        self.start_ts = start_ts
+        self.end_ts = end_ts
+        self.packets = packets
+        self.records: List[dict] = []
+        self.size: Optional[Tuple[int, int]] = None   # encoder (w, h), set when finished
+        self.source: Optional[dict] = None            # passthrough stream parameters
+
+
+class ClipRecorder:
+    """
+    One camera's evidence recorder. `push` hands a throttled (`fps`) copy of
+    the annotated frame to an encoder thread, which keeps the last `preroll`
+    seconds as compressed packets (whole GOPs, so the ring always starts on a
+    keyframe; also capped at `max_bytes`). `trigger` opens a clip from the
+    ring and keeps appending until `postroll` seconds after the last
+    trigger (at most `max_sec`); a writer thread then muxes the packets
+    to MP4 as-is and calls `on_done(clip_path, records, ok, seconds)`.
+    Nothing touches disk unless something fires.
+
+    With `attach_source` (a PyAV-demuxed camera) the ring holds the camera's
+    own packets from `push_packet` instead, and nothing is encoded at all;
+    those clips show the raw picture without the overlay.
+    """
+
+    def __init__(self, cam_id: str, directory: str, preroll: float = 10.0, postroll: float = 5.0,
+                 fps: float = 10.0, codec: str = "libx264", bitrate: int = 1_000_000,
+                 gop_sec: float = 1.0, max_sec: float = 60.0, max_bytes: int = 64 << 20,
+                 on_done: Optional[Callable[[str, List[dict], bool, float], None]] = None):
+        self.cam_id = cam_id
+        self.dir = Path(directory)
+        self.preroll = preroll
+        self.postroll = postroll
+        self.fps = max(1.0, fps)
+        self.codec = codec
+        self.bitrate = bitrate
+        self.gop_sec = gop_sec
+        self.max_sec = max_sec
+        self.max_bytes = max_bytes
+        self.on_done = on_done
+        self._interval = 1.0 / self.fps
+        self._last_push = 0.0
+        self._frames: "queue.Queue[Optional[tuple]]" = queue.Queue(maxsize=4)
+        self._writes: "queue.Queue[Optional[_Clip]]" = queue.Queue()
+        self._ring: Deque[Entry] = deque()
+        self._ring_bytes = 0
+        self._clip: Optional[_Clip] = None
+        self._lock = threading.Lock()
+        self._ctx = None
+        self._t0: Optional[float] = None
+        self._last_pts = -1
+        self._source: Optional[dict] = None   # attach_source() stream info: passthrough mode
+        self._last_dts = -1
+        self._error_logged = False
+        self.clips = 0
+        self.failed = 0
+        self.dropped = 0
+        self._threads = [threading.Thread(target=self._encode_loop, name=f"clip-enc-{cam_id}", daemon=True),
+                         threading.Thread(target=self._write_loop, name=f"clip-write-{cam_id}", daemon=True)]
+        for t in self._threads:
+            t.start()
+
+    # ----- producer side -----
+    def push(self, img, ts: float, format: str = "bgr24"):
+        """Frame (BGR, or I420 / yuv420p) from the pipeline thread; copied, so the caller may reuse `img`."""
+        if self._source is not None or ts - self._last_push < self._interval:
+            return
+        self._last_push = ts
+        frame = VideoFrame.from_ndarray(img, format=format)
+        try:
+            self._frames.put_nowait((frame, ts))
+        except queue.Full:
+            self.dropped += 1   # encoder behind; the ring just gets a gap
+
+    def attach_source(self, info: dict) -> bool:
+        """
+        Switch to passthrough of the camera's packets. `info` = {"codec", "width",
+        "height", "extradata", "rate"} of the demuxed stream. False (and frames
+        keep being encoded) if that codec can't be written to MP4 here.
+        """
+        try:
+            av.codec.Codec(info["codec"], "w")   # add_stream() needs the codec's writer side
+        except Exception:
+            return False
+        with self._lock:
+            if self._clip is not None:
+                self._finish_locked()
+            self._ring.clear()
+            self._ring_bytes = 0
+            self._source = dict(info)
+        return True
+
+    def push_packet(self, data: bytes, pts: Optional[int], dts: Optional[int], key: bool, ts: float):
+        """One demuxed packet (pts / dts in ms, None if unknown) from the capture thread."""
+        if self._t0 is None:
+            self._t0 = ts
+        if dts is None:
+            dts = pts if pts is not None else int((ts - self._t0) * 1000)
+        dts = max(self._last_dts + 1, dts)   # the MP4 muxer wants strictly increasing dts
+        self._last_dts = dts
+        pts = dts if pts is None else max(pts, dts)
+        with self._lock:
+            self._take_locked([(bytes(data), pts, dts, key, ts)], ts)
+
+    def reserve(self, ts: float) -> str:
+        """Path the next trigger at `ts` will write to (the open clip's, if any)."""
+        with self._lock:
+            if self._clip is not None:
+                return self._clip.path
+        stamp = datetime.fromtimestamp(ts).strftime("%Y%m%d-%H%M%S")
+        return str(self.dir / self.cam_id / f"{self.cam_id}-{stamp}-{int(ts * 1000) % 1000:03d}.mp4")
+
+    def trigger(self, ts: float, path: Optional[str] = None, record: Optional[dict] = None) -> str:
+        """Start a clip (pre-roll + post-roll) or extend the open one; returns its path."""
+        path = path or self.reserve(ts)
+        with self._lock:
+            clip = self._clip
+            if clip is None or clip.path != path:
+                if clip is not None:
+                    self._finish_locked()
+                clip = self._clip = _Clip(path, ts, ts + self.postroll, list(self._ring))
+            clip.end_ts = max(clip.end_ts, ts + self.postroll)
+            if record is not None:
+                clip.records.append(record)
+        return path
+
+    def extend(self, ts: float):
+        with self._lock:
+            if self._clip is not None:
+                self._clip.end_ts = max(self._clip.end_ts, ts + self.postroll)
+
+    def close(self, timeout: float = 5.0):
+        """Flush the open clip and stop both threads."""
+        self._frames.put(None)
+        self._threads[0].join(timeout)
+        with self._lock:
+            if self._clip is not None:
+                self._finish_locked()
+        self._writes.put(None)
+        self._threads[1].join(timeout)
+
+    # ----- encoder thread -----
+    def _configure(self, ctx, width: int, height: int):
+        # same settings for the ring encoder and the MP4 stream, so the header matches the packets
+        ctx.width, ctx.height = width, height
+        ctx.pix_fmt = "yuv420p"
+        ctx.time_base = MS
+        ctx.framerate = Fraction(self.fps).limit_denominator(1000)
+        ctx.bit_rate = self.bitrate
+        ctx.gop_size = max(1, int(round(self.fps * self.gop_sec)))
+        ctx.max_b_frames = 0   # pts == dts, packets mux in arrival order
+        if self.codec == "libx264":
+            ctx.options = {"preset": "ultrafast", "tune": "zerolatency"}
+
+    def _open(self, width: int, height: int):
+        ctx = av.CodecContext.create(self.codec, "w")
+        self._configure(ctx, width, height)
+        ctx.open()
+        return ctx
+
+    def _encode(self, frame: VideoFrame, ts: float) -> List[Entry]:
+        w, h = frame.width & ~1, frame.height & ~1
+        if self._ctx is None or (self._ctx.width, self._ctx.height) != (w, h):
+            with self._lock:
+                # resolution change: old packets can't continue the new stream
+                if self._clip is not None:
+                    self._finish_locked()
+                self._ring.clear()
+                self._ring_bytes = 0
+            self._ctx = self._open(w, h)
+        if self._t0 is None:
+            self._t0 = ts
+        pts = max(self._last_pts + 1, int((ts - self._t0) * 1000))
+        self._last_pts = pts
+        frame.pts, frame.time_base = pts, MS
+        return [(bytes(p), p.pts, p.dts, p.is_keyframe, ts) for p in self._ctx.encode(frame)]
+
+    def _append_locked(self, entry: Entry):
+        self._ring.append(entry)
+        self._ring_bytes += len(entry[0])
+        newest = entry[4]
+        while True:
+            # drop the oldest GOP while the rest still covers the pre-roll (and fits max_bytes)
+            nxt = next((i for i in range(1, len(self._ring)) if self._ring[i][3]), None)
+            if nxt is None:
+                break
+            if newest - self._ring[nxt][4] < self.preroll and self._ring_bytes <= self.max_bytes:
+                break
+            for _ in range(nxt):
+                self._ring_bytes -= len(self._ring.popleft()[0])
+
+    def _encode_loop(self):
+        while True:
+            item = self._frames.get()
+            if item is None:
+                return
+            frame, ts = item
+            try:
+                entries = self._encode(frame, ts)
+            except Exception as e:
+                if not self._error_logged:
+                    print(f"[WARN] clip encoder ({self.codec}) failed for {self.cam_id}: {e}")
+                    self._error_logged = True
+                self._ctx = None
+                continue
+            with self._lock:
+                self._take_locked(entries, ts)
+
+    def _take_locked(self, entries: List[Entry], ts: float):
+        for entry in entries:
+            self._append_locked(entry)
+        clip = self._clip
+        if clip is not None:
+            clip.packets.extend(entries)
+            if ts >= clip.end_ts or ts - clip.start_ts >= self.max_sec:
+                self._finish_locked()
+
+    def _finish_locked(self):
+        clip, self._clip = self._clip, None
+        if self._source is not None:
+            clip.source = self._source
+            clip.size = (self._source["width"], self._source["height"])
+        else:
+            clip.size = (self._ctx.width, self._ctx.height) if self._ctx is not None else None
+        self._writes.put(clip)
+
+    # ----- writer thread -----
+    def _mux(self, clip: _Clip) -> float:
+        packets = clip.packets
+        start = next((i for i, e in enumerate(packets) if e[3]), None)
+        if start is None or clip.size is None:
+            raise RuntimeError("no keyframe recorded")
+        packets = packets[start:]
+        Path(clip.path).parent.mkdir(parents=True, exist_ok=True)
+        tmp = clip.path + ".part"
+        base = packets[0][2]
+        with av.open(tmp, "w", format="mp4") as out:
+            if clip.source is not None:
+                src = clip.source
+                stream = out.add_stream(src["codec"], rate=src.get("rate") or Fraction(self.fps).limit_denominator(1000))
+                ctx = stream.codec_context
+                ctx.width, ctx.height = clip.size
+                ctx.time_base = MS
+                if src.get("extradata"):
+                    ctx.extradata = src["extradata"]   # SPS / PPS from the camera
+            else:
+                stream = out.add_stream(self.codec, rate=Fraction(self.fps).limit_denominator(1000))
+                self._configure(stream.codec_context, *clip.size)
+            stream.time_base = MS
+            for data, pts, dts, key, _ts in packets:
+                pkt = av.Packet(data)
+                pkt.pts, pkt.dts = pts - base, dts - base
+                pkt.time_base = MS
+                pkt.stream = stream
+                if key:
+                    pkt.is_keyframe = True
+                out.mux(pkt)
+        os.replace(tmp, clip.path)
+        return packets[-1][4] - packets[0][4]
+
+    def _write_loop(self):
+        while True:
+            clip = self._writes.get()
+            if clip is None:
+                return
+            t0 = time.perf_counter()
+            try:
+                seconds = self._mux(clip)
+                ok = True
+                self.clips += 1
+                print(f"[INFO] clip {clip.path}: {seconds:.1f}s, {len(clip.packets)} packets, "
+                      f"written in {time.perf_counter() - t0:.2f}s")
+            except Exception as e:
+                seconds, ok = 0.0, False
+                self.failed += 1
+                print(f"[WARN] clip {clip.path} failed: {e}")
+            if self.on_done is not None:
+                try:
+                    self.on_done(clip.path, clip.records, ok, seconds)
+                except Exception as e:
+                    print(f"[WARN] clip callback failed: {e}")
+
+    def stats(self):
+        with self._lock:
+            span = self._ring[-1][4] - self._ring[0][4] if len(self._ring) > 1 else 0.0
+            return {"preroll_sec": round(span, 2), "ring_bytes": self._ring_bytes,
+                    "recording": self._clip.path if self._clip is not None else None,
+                    "clips": self.clips, "failed": self.failed, "dropped_frames": self.dropped}
+
+
+def report_to_sink(get_sink: Callable[[], object]):
+    """
+    on_done callback: hand the clip status to the current alert sink by clip
+    path. AlertSink patches it onto the alerts carrying that path once they
+    are stored; a worker's forwarding sink passes it on to the supervisor.
+    The path itself is on each record before it is submitted, so matching by
+    path works wherever the records end up.
+    """
+    def on_done(path: str, records: List[dict], ok: bool, seconds: float):
+        sink = get_sink()
+        if sink is not None and hasattr(sink, "clip_done"):
+            sink.clip_done(path, {"clip_status": "ready" if ok else "failed", "clip_sec": round(seconds, 2)})
+    return on_done
@@ -0,0 +1,393 @@
+# cluster.py — coordinator (camera -> node assignment, room routing) and the node-side agent
+import asyncio
+import json
+import threading
+import time
+from pathlib import Path
+from collections import OrderedDict
+from typing import Awaitable, Callable, Dict, List, Optional, Tuple
+
+import httpx
+
+Spec = Tuple[str, object]   # (camera id, source)
+
+
+class NodeInfo:
+    def __init__(self, node_id: str, url: str):
+        self.node_id = node_id
+        self.url = url.rstrip("/")
+        self.capacity = 1
+        self.load: dict = {}
+        self.last_seen = 0.0
+        self.joined = time.time()
+        self.alive = True
+
+    @property
+    def ws_url(self) -> str:
+        base = self.url
+        if base.startswith("https://"):
+            return "wss://" + base[len("https://"):] + "/ws"
+        if base.startswith("http://"):
+            return "ws://" + base[len("http://"):] + "/ws"
+        return base + "/ws"
+
+    def lagging(self) -> bool:
+        # output fps well under what its cameras should produce
+        want = self.load.get("configured_fps", 0) * self.load.get("cameras", 0)
+        return want > 0 and self.load.get("output_fps", 0.0) < 0.8 * want
+
+
+class Coordinator:
+    """
+    Owns the camera list and which node runs each camera. Nodes heartbeat in
+    with their load and get back the cameras (and model settings) they should
+    run, so the coordinator never calls out to nodes. Unowned cameras go to
+    the node with the lowest load score (assigned / capacity, plus a penalty
+    while it reports lagging output); a node that misses heartbeats for
+    `node_timeout` is dropped and its cameras reassigned. Working
+    assignments are left alone when nodes join, so no stream is moved
+    without a reason.
+    """
+
+    def __init__(self, node_timeout: float = 10.0, state_path: Optional[str] = None):
+        self.node_timeout = node_timeout
+        self.state_path = Path(state_path) if state_path else None   # per-node high-water ids
+        self.nodes: Dict[str, NodeInfo] = {}
+        self.cameras: Dict[str, object] = {}     # cam id -> source, in start order
+        self.assignment: Dict[str, str] = {}     # cam id -> node id
+        self.model: dict = {}
+        self.rules: Optional[dict] = None          # RuleBook.to_dict() handed to every node
+        self.reassigned = 0
+        self._alert_hw: Dict[str, int] = {}       # node id -> last alert id stored (see restore_alerts)
+        # (node id, node alert id) -> id here, so later patches (clip status, NeuralSeek) find
+        # their alert; in memory only, patches for alerts stored before a restart are dropped
+        self._alert_ids: "OrderedDict[Tuple[str, int], int]" = OrderedDict()
+        self._lock = threading.Lock()
+        self._alert_lock = threading.Lock()
+
+    # ----- configuration -----
+    def set_cameras(self, specs: List[Spec]):
+        with self._lock:
+            self.cameras = dict(specs)
+            self.assignment = {c: n for c, n in self.assignment.items() if c in self.cameras}
+            self._assign_locked()
+
+    def set_model(self, weights: str, backend: str, conf: float):
+        with self._lock:
+            self.model = {"weights": weights, "backend": backend, "conf": conf}
+
+    # ----- node side -----
+    def heartbeat(self, node_id: str, url: str, capacity: int, load: dict) -> dict:
+        with self._lock:
+            node = self.nodes.get(node_id)
+            if node is None or not node.alive:
+                node = self.nodes[node_id] = NodeInfo(node_id, url)
+                print(f"[INFO] cluster: node {node_id} joined ({url}, capacity {capacity})")
+            node.url = url.rstrip("/")
+            node.capacity = max(1, int(capacity))
+            node.load = dict(load or {})
+            node.last_seen = time.monotonic()
+            self._reap_locked()
+            self._assign_locked()
+            mine = [{"id": cam, "source": self.cameras[cam]}
+                    for cam, owner in self.assignment.items() if owner == node_id]
+            return {"cameras": mine, "model": dict(self.model), "rules": self.rules}
+
+    def accept_alerts(self, node_id: str, alerts: List[dict],
+                      store: Callable[[List[dict]], object]) -> int:
+        """Stores alerts above the node's high-water id, tagged with their origin; returns the ack id."""
+        with self._alert_lock:
+            hw = self._alert_hw.get(node_id, -1)
+            fresh = []
+            for rec in sorted(alerts, key=lambda r: int(r.get("id", -1))):
+                rid = int(rec.get("id", -1))
+                if rid <= hw:
+                    continue   # resent after a lost ack
+                hw = rid
+                rec = dict(rec)
+                rec.pop("id", None)
+                rec["node"] = node_id
+                rec["node_alert_id"] = rid
+                fresh.append(rec)
+            if fresh:
+                store(fresh)   # raises -> no ack, the node resends; sets rec["id"] in place
+                for rec in fresh:
+                    if "id" in rec:
+                        self._alert_ids[(node_id, rec["node_alert_id"])] = rec["id"]
+                while len(self._alert_ids) > 100_000:
+                    self._alert_ids.popitem(last=False)
+            self._alert_hw[node_id] = hw
+            if fresh and "id" in fresh[-1]:
+                self._save_alert_state(fresh[-1]["id"] + 1)
+            return hw
+
+    def restore_alerts(self, query_after: Callable[[int], List[dict]]):
+        """
+        Rebuild the per-node high-water ids after a restart, so a batch resent
+        after a lost ack is not stored twice. `state_path` holds them as of some
+        store id; only alerts stored from that id on (query_after(id - 1), i.e.
+        ones whose state write a crash may have cut off) are scanned for their
+        node / node_alert_id. Without a readable state file the whole store is.
+        """
+        hw: Dict[str, int] = {}
+        since = 0
+        try:
+            state = json.loads(self.state_path.read_text(encoding="utf-8"))
+            hw = {str(n): int(i) for n, i in state["hw"].items()}
+            since = int(state["next_id"])
+        except (AttributeError, OSError, ValueError, KeyError, TypeError):
+            hw, since = {}, 0
+        last = since - 1
+        for rec in query_after(since - 1):
+            node, rid = rec.get("node"), rec.get("node_alert_id")
+            if node is not None and rid is not None:
+                hw[str(node)] = max(hw.get(str(node), -1), int(rid))
+            last = max(last, int(rec.get("id", last)))
+        with self._alert_lock:
+            self._alert_hw = hw
+            self._save_alert_state(last + 1)
+        if hw:
+            print(f"[INFO] cluster: restored alert high-water ids for {len(hw)} node(s)")
+
+    def _save_alert_state(self, next_id: int):
+        # caller holds _alert_lock; a torn or missing file only costs a full rescan
+        if self.state_path is None:
+            return
+        try:
+            tmp = self.state_path.with_suffix(".tmp")
+            tmp.write_text(json.dumps({"hw": self._alert_hw, "next_id": next_id}), encoding="utf-8")
+            tmp.replace(self.state_path)
+        except OSError as e:
+            print(f"[WARN] cluster: could not save alert high-water ids: {e}")
+
+    def accept_patches(self, node_id: str, patches: List[dict],
+                       annotate: Callable[[int, dict], None]) -> int:
+        """Applies node-side annotate() calls ({"id": node alert id, "fields"}); returns how many matched."""
+        applied = 0
+        for p in patches:
+            with self._alert_lock:
+                local = self._alert_ids.get((node_id, int(p.get("id", -1))))
+            if local is not None and isinstance(p.get("fields"), dict):
+                annotate(local, p["fields"])
+                applied += 1
+        return applied
+
+    def _reap_locked(self):
+        now = time.monotonic()
+        for node in self.nodes.values():
+            if node.alive and now - node.last_seen > self.node_timeout:
+                node.alive = False
+                lost = [cam for cam, owner in self.assignment.items() if owner == node.node_id]
+                for cam in lost:
+                    del self.assignment[cam]
+                self.reassigned += len(lost)
+                print(f"[WARN] cluster: node {node.node_id} missed heartbeats; "
+                      f"reassigning {len(lost)} camera(s)")
+
+    def _score(self, node: NodeInfo, counts: Dict[str, int]) -> float:
+        return counts.get(node.node_id, 0) / node.capacity + (0.5 if node.lagging() else 0.0)
+
+    def _assign_locked(self):
+        alive = [n for n in self.nodes.values() if n.alive]
+        if not alive:
+            return
+        counts: Dict[str, int] = {}
+        for owner in self.assignment.values():
+            counts[owner] = counts.get(owner, 0) + 1
+        for cam in self.cameras:
+            if cam in self.assignment:
+                continue
+            # prefer nodes with free capacity; overcommit the least loaded when all are full
+            free = [n for n in alive if counts.get(n.node_id, 0) < n.capacity] or alive
+            node = min(free, key=lambda n: (self._score(n, counts), n.joined))
+            self.assignment[cam] = node.node_id
+            counts[node.node_id] = counts.get(node.node_id, 0) + 1
+
+    # ----- viewer side -----
+    def owner(self, room: str) -> Optional[NodeInfo]:
+        """Node serving `room` (same room -> camera rule as a single server)."""
+        with self._lock:
+            self._reap_locked()
+            self._assign_locked()
+            cam = room if room in self.cameras else next(iter(self.cameras), None)
+            node_id = self.assignment.get(cam) if cam is not None else None
+            node = self.nodes.get(node_id) if node_id else None
+            return node if node is not None and node.alive else None
+
+    def stats(self):
+        with self._lock:
+            self._reap_locked()
+            now = time.monotonic()
+            return {
+                "nodes": {n.node_id: {"url": n.url, "alive": n.alive, "capacity": n.capacity,
+                                      "last_seen_sec": round(now - n.last_seen, 1),
+                                      "cameras": sorted(c for c, o in self.assignment.items()
+                                                        if o == n.node_id),
+                                      "lagging": n.lagging(), "load": n.load}
+                          for n in self.nodes.values()},
+                "unassigned": [c for c in self.cameras if c not in self.assignment],
+                "reassigned": self.reassigned,
+            }
+
+
+async def proxy_signaling(ws, node: NodeInfo, register_text: str):
+    """Pipe a viewer's /ws session (starting with its register message) to the owning node."""
+    import websockets   # ships with uvicorn[standard]
+    async with websockets.connect(node.ws_url, open_timeout=5) as upstream:
+        await upstream.send(register_text)
+
+        async def down():
+            async for msg in upstream:
+                await ws.send_text(msg if isinstance(msg, str) else msg.decode("utf-8"))
+
+        async def up():
+            while True:
+                await upstream.send(await ws.receive_text())
+
+        tasks = [asyncio.create_task(down()), asyncio.create_task(up())]
+        try:
+            await asyncio.wait(tasks, return_when=asyncio.FIRST_COMPLETED)
+        finally:
+            for t in tasks:
+                t.cancel()
+
+
+class NodeAgent:
+    """
+    Node side: heartbeats `load()` to the coordinator every `interval`,
+    applies the cameras / model / rules it hands back, and forwards new local
+    alerts by store id. The forwarded cursor is persisted, so alerts raised
+    while the coordinator is unreachable are sent once it is back, and a
+    restarted node doesn't resend old ones. Fields annotated onto already
+    forwarded alerts (clip status, NeuralSeek results) follow as patches.
+    """
+
+    def __init__(self, coordinator_url: str, node_id: str, node_url: str, capacity: int,
+                 token: str, store, load: Callable[[], dict],
+                 apply: Callable[[List[Spec], dict, Optional[dict]], Awaitable[None]],
+                 interval: float = 2.0, batch: int = 256):
+        self.coordinator_url = coordinator_url.rstrip("/")
+        self.node_id = node_id
+        self.node_url = node_url
+        self.capacity = capacity
+        self.token = token
+        self.store = store
+        self.load = load
+        self.apply = apply
+        self.interval = interval
+        self.batch = batch
+        self._cursor_path = Path(store.dir) / "forwarded.cursor"
+        self.cursor = self._read_cursor()
+        self.assigned: List[Spec] = []
+        self.connected = False
+        self.forwarded = 0
+        self.last_error: Optional[str] = None
+        self._task: Optional[asyncio.Task] = None
+        self._patches: List[Tuple[int, dict]] = []   # (alert id, fields) not yet sent
+        self._patch_lock = threading.Lock()
+
+    def _read_cursor(self) -> int:
+        try:
+            return int(self._cursor_path.read_text().strip())
+        except Exception:
+            return self.store.next_seq - 1   # first run: only alerts from now on
+
+    def _write_cursor(self):
+        tmp = self._cursor_path.with_suffix(".tmp")
+        tmp.write_text(str(self.cursor))
+        tmp.replace(self._cursor_path)
+
+    def _on_patch(self, alert_id: int, fields: dict):
+        # AlertStore patch listener (any thread)
+        with self._patch_lock:
+            self._patches.append((int(alert_id), fields))
+            if len(self._patches) > 10_000:
+                del self._patches[0]
+
+    def start(self):
+        self.store.patch_listeners.append(self._on_patch)
+        self._task = asyncio.create_task(self._run())
+        return self._task
+
+    async def stop(self):
+        if self._on_patch in self.store.patch_listeners:
+            self.store.patch_listeners.remove(self._on_patch)
+        if self._task is not None:
+            self._task.cancel()
+            try: await self._task
+            except (asyncio.CancelledError, Exception): pass
+
+    async def _run(self):
+        headers = {"X-Cluster-Token": self.token}
+        async with httpx.AsyncClient(timeout=5.0, headers=headers) as http:
+            while True:
+                try:
+                    await self._heartbeat(http)
+                    await self._forward_alerts(http)
+                    self.connected, self.last_error = True, None
+                except Exception as e:
+                    if self.connected or self.last_error is None:
+                        print(f"[WARN] cluster: coordinator unreachable: {e}")
+                    self.connected, self.last_error = False, f"{type(e).__name__}: {e}"
+                await asyncio.sleep(self.interval)
+
+    async def _heartbeat(self, http: httpx.AsyncClient):
+        body = {"node_id": self.node_id, "url": self.node_url,
+                "capacity": self.capacity, "load": self.load()}
+        r = await http.post(f"{self.coordinator_url}/cluster/heartbeat", json=body)
+        r.raise_for_status()
+        reply = r.json()
+        specs = [(str(c["id"]), c["source"]) for c in reply.get("cameras", [])]
+        await self.apply(specs, reply.get("model") or {}, reply.get("rules"))
+        self.assigned = specs
+
+    async def _forward_alerts(self, http: httpx.AsyncClient):
+        while True:
+            # the oldest unsent window (cursor, cursor + batch]; ids are contiguous
+            fresh = await asyncio.to_thread(self.store.query, self.batch, None, None, None,
+                                            self.cursor, self.cursor + self.batch + 1)
+            if not fresh:
+                break
+            fresh.reverse()   # oldest first
+            body = json.dumps({"node_id": self.node_id, "alerts": fresh}, ensure_ascii=False)
+            r = await http.post(f"{self.coordinator_url}/cluster/alerts", content=body,
+                                headers={"Content-Type": "application/json"})
+            r.raise_for_status()
+            ack = int(r.json().get("ack", self.cursor))
+            # advance only over the prefix of this batch the coordinator confirmed
+            sent = 0
+            for rec in fresh:
+                if int(rec["id"]) > ack:
+                    break
+                sent += 1
+            if sent:
+                self.cursor = max(self.cursor, int(fresh[sent - 1]["id"]))
+                self.forwarded += sent
+                await asyncio.to_thread(self._write_cursor)
+            if sent < len(fresh) or len(fresh) < self.batch:
+                break
+        await self._forward_patches(http)
+
+    async def _forward_patches(self, http: httpx.AsyncClient):
+        # only patches of alerts the coordinator has; later ones wait (or ride in the record itself)
+        with self._patch_lock:
+            ready = [p for p in self._patches if p[0] <= self.cursor]
+            self._patches = [p for p in self._patches if p[0] > self.cursor]
+        if not ready:
+            return
+        body = json.dumps({"node_id": self.node_id, "alerts": [],
+                           "patches": [{"id": i, "fields": f} for i, f in ready]}, ensure_ascii=False)
+        try:
+            r = await http.post(f"{self.coordinator_url}/cluster/alerts", content=body,
+                                headers={"Content-Type": "application/json"})
+            r.raise_for_status()
+        except Exception:
+            with self._patch_lock:
+                self._patches[:0] = ready   # retried next round
+            raise
+
+    def stats(self):
+        return {"coordinator": self.coordinator_url, "node_id": self.node_id,
+                "connected": self.connected, "last_error": self.last_error,
+                "cameras": [cam for cam, _ in self.assigned],
+                "alerts_forwarded": self.forwarded, "alert_cursor": self.cursor}
@@ -9,7 +9,7 @@ Features:
 - Treats video files as "fake live" by sleeping according to FPS
 - Feature collection mode (for training on artificial events)
 - Optional ML danger model (trained from collected features)
-- NEW: Automatic ATM ROI detection from the first frame (no manual clicking)
+- Automatic ATM ROI detection from a median background, re-estimated in the background
 """
 
 import argparse
@@ -18,17 +18,32 @@ from datetime import datetime, time as dtime
 from dataclasses import dataclass, field
 from typing import List, Tuple, Dict, Optional, Any
 import csv
+import json
 import os
+import queue
+import threading
+from collections import deque
 
 import cv2
 import numpy as np
-from ultralytics import YOLO
+
+from adaptive import AdaptiveScheduler
+from alert_store import AlertSink, AlertStore
+from inference_backends import load_backend
+from metrics import RateMeter, Registry, serve as serve_metrics
+from rules import RuleSet, RulesFile
+from zones import Zone, ZoneEngine, ZoneMap, bbox_center, load_zones
 
 try:
     import joblib
 except ImportError:
     joblib = None
 
+try:
+    from scipy.optimize import linear_sum_assignment
+except ImportError:
+    linear_sum_assignment = None
+
 
 # ------------------------- CONFIG SECTION -------------------------
 
@@ -40,17 +55,17 @@ BANK_CLOSE = dtime(17, 0, 0)  # 17:00
 # ATM_ROI will now be set automatically from the first frame.
 ATM_ROI: Tuple[float, float, float, float] = (200, 100, 450, 400)  # default, overwritten
 PARKING_ROI = (50, 200, 1200, 700)  # region for parking lot
+# Polygon zones from --zones; None = the two rectangles above as "atm" / "parking" zones
+ZONES: Optional[List[Zone]] = None
 
-# Class names for YOLOv10 COCO model (partial, only what we care about here)
-COCO_CLASSES = {
-    0: "person",
-    1: "bicycle",
-    2: "car",
-    3: "motorbike",
-    5: "bus",
-    7: "truck",
-    # add more if needed
-}
+# Per-track trajectory memory stays constant: at most HISTORY_CAPACITY points,
+# spaced at least HISTORY_MIN_INTERVAL seconds apart (0 = keep every frame).
+HISTORY_CAPACITY = 256
+HISTORY_MIN_INTERVAL = 0.0
+
+# Classes the tracker and features care about; --rules can replace this. Compiled
+# against the model's own names, so detection filtering is class-id indexing.
+TRACK_RULES = {"levels": {}, "track": ["person", "car", "truck", "bus", "motorbike"]}
 
 # Order of features used for ML model (keep in sync with training script)
 FEATURE_KEYS = [
@@ -69,6 +84,52 @@ FEATURE_KEYS = [
 
 # ------------------------- DATA STRUCTURES ------------------------
 
+class TrackHistory:
+    """
+    Fixed-capacity ring of (timestamp, center_x, center_y) rows.
+
+    Samples closer than `min_interval` to the previously stored one are not
+    stored, but `last()` always returns the newest sample so ROI timing stays
+    exact. `array()` gives the retained rows oldest-first for array features.
+    """
+
+    def __init__(self, capacity: Optional[int] = None, min_interval: Optional[float] = None):
+        capacity = HISTORY_CAPACITY if capacity is None else capacity
+        self._buf = np.zeros((max(1, capacity), 3), dtype=np.float64)
+        self._head = 0       # next write position
+        self._count = 0
+        self.min_interval = HISTORY_MIN_INTERVAL if min_interval is None else min_interval
+        self._last: Optional[Tuple[float, float, float]] = None
+
+    def append(self, ts: float, cx: float, cy: float):
+        self._last = (ts, cx, cy)
+        if self._count and ts - self._buf[self._head - 1, 0] < self.min_interval:
+            return
+        self._buf[self._head] = (ts, cx, cy)
+        self._head = (self._head + 1) % self._buf.shape[0]
+        self._count = min(self._count + 1, self._buf.shape[0])
+
+    def last(self) -> Optional[Tuple[float, float, float]]:
+        return self._last
+
+    def array(self) -> np.ndarray:
+        if self._count < self._buf.shape[0]:
+            return self._buf[:self._count]
+        return np.roll(self._buf, -self._head, axis=0)
+
+    def __len__(self):
+        return self._count
+
+    def __bool__(self):
+        return self._last is not None
+
+
+def new_history(ts: float, cx: float, cy: float) -> TrackHistory:
+    hist = TrackHistory()
+    hist.append(ts, cx, cy)
+    return hist
+
+
 @dataclass
 class TrackState:
     track_id: int
@@ -77,10 +138,11 @@ class TrackState:
     conf: float
     first_seen: float
     last_seen: float
-    # History of (timestamp, center_x, center_y)
-    history: List[Tuple[float, float, float]] = field(default_factory=list)
+    # Bounded history of (timestamp, center_x, center_y)
+    history: TrackHistory = field(default_factory=TrackHistory)
     time_in_atm_roi: float = 0.0
     time_in_parking_roi: float = 0.0
+    zone_time: Dict[str, float] = field(default_factory=dict)   # zone name -> seconds inside
 
 
 @dataclass
@@ -88,6 +150,26 @@ class SceneState:
     timestamp: float
     camera_type: str
     tracks: List[TrackState]
+    zones: Optional[ZoneEngine] = None   # tracker's live zone state; rebuilt from tracks if None
+
+
+_zone_maps: Dict[tuple, ZoneMap] = {}
+
+
+def zone_map_for(camera_type: str) -> ZoneMap:
+    """Rasterized zones for this process's camera (cached until ZONES / ATM_ROI change)."""
+    key = (camera_type, id(ZONES), ATM_ROI, PARKING_ROI)
+    zmap = _zone_maps.get(key)
+    if zmap is None:
+        if ZONES is not None:
+            zones = ZONES
+        else:
+            # dwell only counts in the camera's own ROI, as before zones existed
+            zones = [Zone.rect("atm", "atm", ATM_ROI, dwell=camera_type == "ATM"),
+                     Zone.rect("parking", "parking", PARKING_ROI, dwell=camera_type == "PARKING")]
+        _zone_maps.clear()
+        zmap = _zone_maps[key] = ZoneMap(zones)
+    return zmap
 
 
 # ------------------------- SIMPLE TRACKER -------------------------
@@ -109,35 +191,145 @@ def iou(boxA, boxB) -> float:
     return interArea / float(boxAArea + boxBArea - interArea)
 
 
+def iou_matrix(boxes_a, boxes_b) -> np.ndarray:
+    """
+    Pairwise IoU of (N,4) vs (M,4) xyxy boxes in one broadcast pass -> (N,M) float32.
+    """
+    a = np.asarray(boxes_a, dtype=np.float32).reshape(-1, 4)
+    b = np.asarray(boxes_b, dtype=np.float32).reshape(-1, 4)
+    x1 = np.maximum(a[:, None, 0], b[None, :, 0])
+    y1 = np.maximum(a[:, None, 1], b[None, :, 1])
+    x2 = np.minimum(a[:, None, 2], b[None, :, 2])
+    y2 = np.minimum(a[:, None, 3], b[None, :, 3])
+    inter = np.clip(x2 - x1, 0, None) * np.clip(y2 - y1, 0, None)
+    area_a = (a[:, 2] - a[:, 0]) * (a[:, 3] - a[:, 1])
+    area_b = (b[:, 2] - b[:, 0]) * (b[:, 3] - b[:, 1])
+    union = area_a[:, None] + area_b[None, :] - inter
+    return np.where(union > 0, inter / np.maximum(union, 1e-9), 0.0).astype(np.float32)
+
+
+def assign_max_iou(ious: np.ndarray, thresh: float) -> List[Tuple[int, int]]:
+    """
+    One-to-one (row, col) matches maximizing total IoU, keeping pairs >= thresh.
+    Hungarian via scipy when installed, otherwise greedy best-pair-first.
+    """
+    if ious.size == 0:
+        return []
+    if linear_sum_assignment is not None:
+        rows, cols = linear_sum_assignment(-ious)
+        keep = ious[rows, cols] >= thresh
+        return list(zip(rows[keep].tolist(), cols[keep].tolist()))
+
+    matches = []
+    used_r, used_c = set(), set()
+    order = np.argsort(-ious, axis=None)
+    for flat in order.tolist():
+        r, c = divmod(flat, ious.shape[1])
+        if ious[r, c] < thresh:
+            break
+        if r in used_r or c in used_c:
+            continue
+        used_r.add(r)
+        used_c.add(c)
+        matches.append((r, c))
+    return matches
+
+
 class SimpleTracker:
     """
-    Very naive IoU-based tracker just to get persistent IDs.
-    Good enough for hackathon / prototype.
+    IoU-based tracker just to get persistent IDs.
+
+    Live track geometry is kept in struct-of-arrays buffers (rows 0..n-1) so each
+    update is one IoU matrix + one assignment instead of a det x track Python
+    loop; `tracks` holds the matching TrackState objects returned to callers.
+    A per-track box velocity lets predict() carry tracks across frames that
+    skipped detection.
     """
 
-    def __init__(self, iou_thresh=0.3, max_age=2.0):
+    def __init__(self, iou_thresh=0.3, max_age=2.0, capacity=64):
         self.iou_thresh = iou_thresh
         self.max_age = max_age
         self.next_id = 1
         self.tracks: Dict[int, TrackState] = {}
+        self.zones: Optional[ZoneEngine] = None   # built on the first frame (needs camera_type)
+
+        self._n = 0
+        self._boxes = np.zeros((capacity, 4), dtype=np.float32)
+        self._cls = np.zeros(capacity, dtype=np.int32)
+        self._last_seen = np.zeros(capacity, dtype=np.float64)
+        self._ids = np.zeros(capacity, dtype=np.int64)
+        self._vel = np.zeros((capacity, 4), dtype=np.float32)   # box px/sec
+        self._class_ids: Dict[str, int] = {}
+
+    def _class_id(self, name: str) -> int:
+        cid = self._class_ids.get(name)
+        if cid is None:
+            cid = self._class_ids[name] = len(self._class_ids)
+        return cid
+
+    def _grow(self):
+        cap = self._boxes.shape[0] * 2
+        self._boxes = np.resize(self._boxes, (cap, 4))
+        self._cls = np.resize(self._cls, cap)
+        self._last_seen = np.resize(self._last_seen, cap)
+        self._ids = np.resize(self._ids, cap)
+        self._vel = np.resize(self._vel, (cap, 4))
+
+    def _compact(self, keep: np.ndarray):
+        n = int(keep.sum())
+        self._boxes[:n] = self._boxes[:self._n][keep]
+        self._cls[:n] = self._cls[:self._n][keep]
+        self._last_seen[:n] = self._last_seen[:self._n][keep]
+        self._ids[:n] = self._ids[:self._n][keep]
+        self._vel[:n] = self._vel[:self._n][keep]
+        self._n = n
+
+    def _zone_engine(self, camera_type: str) -> ZoneEngine:
+        zmap = zone_map_for(camera_type)
+        if self.zones is None:
+            self.zones = ZoneEngine(zmap)
+        elif self.zones.map is not zmap:
+            self.zones.set_map(zmap)
+        return self.zones
 
     def update_roi_times(self, track: TrackState, ts: float, camera_type: str):
-        if not track.history:
-            return
-
-        # Use last history point to approximate time in ROI since last_seen
-        last_ts, cx, cy = track.history[-1]
-
-        dt = ts - track.last_seen
-        if dt < 0:
-            dt = 0
-
-        if camera_type == "ATM":
-            if point_in_rect(cx, cy, ATM_ROI):
-                track.time_in_atm_roi += dt
-        elif camera_type == "PARKING":
-            if point_in_rect(cx, cy, PARKING_ROI):
-                track.time_in_parking_roi += dt
+        # time since last_seen is credited to the zones of the last known position
+        self._zone_engine(camera_type).advance(track, ts - track.last_seen)
+
+    def _age_out(self, timestamp: float) -> int:
+        n = self._n
+        if n:
+            alive = (timestamp - self._last_seen[:n]) <= self.max_age
+            if not alive.all():
+                for tid in self._ids[:n][~alive].tolist():
+                    del self.tracks[tid]
+                    if self.zones is not None:
+                        self.zones.exit(tid)
+                self._compact(alive)
+        return self._n
+
+    def _predicted(self, timestamp: float, n: int) -> np.ndarray:
+        """Boxes of rows 0..n-1 moved along their velocity from the last detected box."""
+        dt = (timestamp - self._last_seen[:n]).astype(np.float32)[:, None]
+        return self._boxes[:n] + self._vel[:n] * dt
+
+    def predict(self, timestamp: float, camera_type: str) -> List[TrackState]:
+        """
+        Frame without detections: move every live track along its velocity
+        (from its last detected box) and keep ROI timing running.
+        """
+        n = self._age_out(timestamp)
+        if n:
+            boxes = self._predicted(timestamp, n)
+            for row, tid in enumerate(self._ids[:n].tolist()):
+                tr = self.tracks[tid]
+                self.update_roi_times(tr, timestamp, camera_type)
+                tr.bbox = tuple(boxes[row].tolist())
+                tr.last_seen = timestamp
+                cx, cy = bbox_center(tr.bbox)
+                tr.history.append(timestamp, cx, cy)
+                self.zones.place(tr, cx, cy)
+        return list(self.tracks.values())
 
     def update(self, detections, timestamp: float, camera_type: str) -> List[TrackState]:
         """
@@ -145,40 +337,47 @@ class SimpleTracker:
         returns: list of TrackState
         """
         # Age out old tracks
-        to_delete = []
-        for tid, tr in self.tracks.items():
-            if timestamp - tr.last_seen > self.max_age:
-                to_delete.append(tid)
-        for tid in to_delete:
-            del self.tracks[tid]
-
-        unmatched_dets = []
-
-        for det in detections:
-            best_iou = 0
-            best_id = None
-            for tid, tr in self.tracks.items():
-                if tr.class_name != det["class_name"]:
-                    continue
-                cur_iou = iou(tr.bbox, det["bbox"])
-                if cur_iou > best_iou:
-                    best_iou = cur_iou
-                    best_id = tid
-
-            if best_id is not None and best_iou >= self.iou_thresh:
-                tr = self.tracks[best_id]
-                self.update_roi_times(tr, timestamp, camera_type)
-
-                tr.bbox = det["bbox"]
-                tr.conf = det["conf"]
-                tr.last_seen = timestamp
-                cx, cy = bbox_center(det["bbox"])
-                tr.history.append((timestamp, cx, cy))
-            else:
-                unmatched_dets.append(det)
+        n = self._age_out(timestamp)
+        zones = self._zone_engine(camera_type)
+
+        if not detections:
+            return list(self.tracks.values())
+
+        det_boxes = np.asarray([det["bbox"] for det in detections], dtype=np.float32).reshape(-1, 4)
+        det_cls = np.asarray([self._class_id(det["class_name"]) for det in detections], dtype=np.int32)
+
+        # Same-class pairs only, then optimal one-to-one matching. Tracks are matched where
+        # their velocity puts them now, not at their last detected box, which can be several
+        # skipped frames old; _boxes / _last_seen stay the last detection (velocity, ageing)
+        ious = iou_matrix(det_boxes, self._predicted(timestamp, n))
+        if n:
+            ious[det_cls[:, None] != self._cls[None, :n]] = 0.0
+        matches = assign_max_iou(ious, self.iou_thresh)
+
+        matched_dets = set()
+        for d, row in matches:
+            det = detections[d]
+            tr = self.tracks[int(self._ids[row])]
+            self.update_roi_times(tr, timestamp, camera_type)
+
+            tr.bbox = det["bbox"]
+            tr.conf = det["conf"]
+            tr.last_seen = timestamp
+            cx, cy = bbox_center(det["bbox"])
+            tr.history.append(timestamp, cx, cy)
+            self.zones.place(tr, cx, cy)
+            dt = timestamp - self._last_seen[row]
+            if dt > 0:
+                # smoothed so one jittery box doesn't throw predictions off
+                self._vel[row] = 0.5 * self._vel[row] + 0.5 * (det_boxes[d] - self._boxes[row]) / dt
+            self._boxes[row] = det_boxes[d]
+            self._last_seen[row] = timestamp
+            matched_dets.add(d)
 
         # Create new tracks for unmatched detections
-        for det in unmatched_dets:
+        for d, det in enumerate(detections):
+            if d in matched_dets:
+                continue
             cx, cy = bbox_center(det["bbox"])
             tr = TrackState(
                 track_id=self.next_id,
@@ -187,31 +386,89 @@ class SimpleTracker:
                 conf=det["conf"],
                 first_seen=timestamp,
                 last_seen=timestamp,
-                history=[(timestamp, cx, cy)],
+                history=new_history(timestamp, cx, cy),
             )
             self.tracks[self.next_id] = tr
+            zones.place(tr, cx, cy)
+            if self._n == self._boxes.shape[0]:
+                self._grow()
+            row = self._n
+            self._boxes[row] = det_boxes[d]
+            self._cls[row] = det_cls[d]
+            self._last_seen[row] = timestamp
+            self._vel[row] = 0.0
+            self._ids[row] = self.next_id
+            self._n += 1
             self.next_id += 1
 
         return list(self.tracks.values())
 
 
-# ------------------------- GEOMETRY HELPERS -----------------------
+# ------------------------- ROI / TILED INFERENCE ------------------
 
-def bbox_center(bbox):
-    x1, y1, x2, y2 = bbox
-    return (x1 + x2) / 2.0, (y1 + y2) / 2.0
+def _axis_starts(lo: int, hi: int, tile: int, step: int) -> List[int]:
+    if hi - lo <= tile:
+        return [lo]
+    n = int(np.ceil((hi - lo - tile) / float(step))) + 1
+    # spread evenly so the last tile ends exactly on the ROI edge
+    return np.linspace(lo, hi - tile, n).round().astype(int).tolist()
 
 
-def point_in_rect(x, y, rect):
-    x1, y1, x2, y2 = rect
-    return x1 <= x <= x2 and y1 <= y <= y2
+def roi_windows(roi, frame_shape, tile: int = 0, overlap: float = 0.2,
+                margin: float = 0.1) -> List[Tuple[int, int, int, int]]:
+    """
+    Crop windows (x1, y1, x2, y2) covering `roi` grown by `margin` (so people
+    straddling the edge keep their whole box), clipped to the frame. With
+    tile > 0 the region is split into tile x tile windows overlapping by
+    `overlap` so small objects are seen near native resolution.
+    """
+    h, w = frame_shape[:2]
+    x1, y1, x2, y2 = roi
+    mx, my = margin * (x2 - x1), margin * (y2 - y1)
+    x1, y1 = max(0, int(x1 - mx)), max(0, int(y1 - my))
+    x2, y2 = min(w, int(np.ceil(x2 + mx))), min(h, int(np.ceil(y2 + my)))
+    if x2 <= x1 or y2 <= y1:
+        return [(0, 0, w, h)]
+    if tile <= 0:
+        return [(x1, y1, x2, y2)]
+    step = max(1, int(tile * (1.0 - overlap)))
+    return [(tx, ty, min(tx + tile, x2), min(ty + tile, y2))
+            for ty in _axis_starts(y1, y2, tile, step)
+            for tx in _axis_starts(x1, x2, tile, step)]
+
+
+def inference_roi(camera_type: str):
+    """Region ROI inference covers: the camera's ROI, or the bounds of all --zones."""
+    if ZONES is not None:
+        return zone_map_for(camera_type).bounds() or PARKING_ROI
+    return ATM_ROI if camera_type == "ATM" else PARKING_ROI
+
+
+def merge_detections(detections, iou_thresh: float = 0.5):
+    """Class-aware NMS over detections gathered from overlapping windows."""
+    if len(detections) < 2:
+        return detections
+    boxes = np.asarray([d["bbox"] for d in detections], dtype=np.float32)
+    scores = np.asarray([d["conf"] for d in detections], dtype=np.float32)
+    classes = [d["class_name"] for d in detections]
+    ious = iou_matrix(boxes, boxes)
+    same = np.asarray(classes)[:, None] == np.asarray(classes)[None, :]
+    suppress = (ious > iou_thresh) & same
+    keep = []
+    alive = np.ones(len(detections), dtype=bool)
+    for i in np.argsort(-scores).tolist():
+        if not alive[i]:
+            continue
+        keep.append(i)
+        alive &= ~suppress[i]
+    return [detections[i] for i in sorted(keep)]
 
 
 # ------------------------- ATM ROI AUTO-DETECTION -----------------
 
 def auto_detect_atm_roi(frame) -> Tuple[float, float, float, float]:
     """
-    Heuristic ATM detector from a single frame using contours.
+    Heuristic ATM detector from a single frame (BGR or grey) using contours.
 
     Idea:
     - Find large-ish rectangular contour on the LEFT half of the frame
@@ -221,7 +478,7 @@ def auto_detect_atm_roi(frame) -> Tuple[float, float, float, float]:
     """
     h, w = frame.shape[:2]
 
-    gray = cv2.cvtColor(frame, cv2.COLOR_BGR2GRAY)
+    gray = frame if frame.ndim == 2 else cv2.cvtColor(frame, cv2.COLOR_BGR2GRAY)
     gray = cv2.GaussianBlur(gray, (5, 5), 0)
     edges = cv2.Canny(gray, 50, 150)
 
@@ -281,6 +538,164 @@ def auto_detect_atm_roi(frame) -> Tuple[float, float, float, float]:
     return (x1, y1, x2, y2)
 
 
+def _roi_iou(a, b) -> float:
+    return iou(a, b) if a is not None and b is not None else 0.0
+
+
+def roi_thumbnail(frame, width: int = 320) -> Tuple[np.ndarray, float]:
+    """Downscaled grey copy of a BGR frame and its scale factor back to full size."""
+    h, w = frame.shape[:2]
+    scale = w / float(min(width, w))
+    small = cv2.resize(frame, (int(round(w / scale)), int(round(h / scale))), interpolation=cv2.INTER_AREA)
+    return cv2.cvtColor(small, cv2.COLOR_BGR2GRAY), scale
+
+
+def background_atm_roi(thumbs: List[np.ndarray], scale: float):
+    """(ROI in full-size pixels, median background) from same-size thumbnails."""
+    background = np.median(np.stack(thumbs), axis=0).astype(np.uint8)
+    return tuple(v * scale for v in auto_detect_atm_roi(background)), background
+
+
+def atm_roi_from_file(cap, fps: float, seconds: float = 30.0, samples: int = 15):
+    """Offline: ROI from the background of the first `seconds` (reads forward, never seeks)."""
+    step = max(1, int(fps * seconds / samples))
+    thumbs, scale = [], 1.0
+    for i in range(step * samples):
+        if i % step:
+            if not cap.grab():
+                break
+            continue
+        ok, frame = cap.read()
+        if not ok:
+            break
+        thumb, scale = roi_thumbnail(frame)
+        thumbs.append(thumb)
+    if not thumbs:
+        return None
+    return tuple(int(round(v)) for v in background_atm_roi(thumbs, scale)[0])
+
+
+class AtmRoiEstimator:
+    """
+    ATM ROI re-detection off the frame loop. `offer` keeps a downscaled grey
+    thumbnail every `sample_sec` (the only per-frame cost is a timestamp
+    check); a background thread runs auto_detect_atm_roi on the temporal
+    median of the last `samples` thumbnails, so people passing through or
+    standing at the ATM drop out of the background. It re-estimates every
+    `interval` seconds, or as soon as the camera is signalled as moved,
+    either by `camera_moved()` or by most of the view changing for a few
+    samples in a row.
+
+    Small changes are smoothed. A jump to a different place is only taken
+    once two estimates in a row agree, unless the camera moved. The result
+    is published by replacing `roi`, so readers never see a half-updated
+    tuple. `roi` stays None until the first estimate, and startup doesn't
+    wait for it.
+    """
+
+    def __init__(self, interval: float = 300.0, sample_sec: float = 2.0, samples: int = 15,
+                 width: int = 320, alpha: float = 0.3, moved_diff: float = 40.0, moved_samples: int = 3):
+        self.interval = interval
+        self.sample_sec = sample_sec
+        self.width = width
+        self.alpha = alpha
+        self.moved_diff = moved_diff
+        self.moved_samples = moved_samples
+        self.roi: Optional[Tuple[int, int, int, int]] = None
+        self.version = 0
+        self.estimates = 0
+        self._ring: deque = deque(maxlen=max(1, samples))
+        self._scale = 1.0
+        self._last_offer = -1e18
+        self._queue: "queue.Queue[Optional[np.ndarray]]" = queue.Queue(maxsize=2)
+        self._moved = threading.Event()
+        self._candidate = None
+        self._changed_run = 0
+        self._thread = threading.Thread(target=self._run, name="atm-roi", daemon=True)
+        self._thread.start()
+
+    def offer(self, frame, ts: float):
+        if ts - self._last_offer < self.sample_sec:
+            return
+        self._last_offer = ts
+        thumb, self._scale = roi_thumbnail(frame, self.width)
+        try:
+            self._queue.put_nowait(thumb)
+        except queue.Full:
+            pass   # estimator busy; next sample in sample_sec
+
+    def camera_moved(self):
+        """External signal (PTZ preset change, operator): re-estimate from fresh samples."""
+        self._moved.set()
+
+    def close(self, timeout: float = 2.0):
+        self._queue.put(None)
+        self._thread.join(timeout)
+
+    def _check_moved(self, thumb: np.ndarray, background: Optional[np.ndarray]):
+        if background is None or background.shape != thumb.shape:
+            return
+        diff = float(np.mean(cv2.absdiff(thumb, background)))
+        self._changed_run = self._changed_run + 1 if diff > self.moved_diff else 0
+        if self._changed_run >= self.moved_samples:
+            self._changed_run = 0
+            print(f"[INFO] ATM camera view changed (mean diff {diff:.0f}); re-estimating ROI")
+            self._moved.set()
+
+    def _run(self):
+        background = None
+        warmup = (1, self._ring.maxlen)   # quick first guess, then once the median is full
+        next_run = float("inf")
+        moved = False
+        while True:
+            thumb = self._queue.get()
+            if thumb is None:
+                return
+            if self._ring and self._ring[-1].shape != thumb.shape:
+                self._ring.clear()   # source resolution changed
+            self._check_moved(thumb, background)
+            if self._moved.is_set():
+                self._moved.clear()
+                # the old view's samples would blend two scenes into the median
+                self._ring.clear()
+                warmup, moved = (1, self._ring.maxlen), True
+            self._ring.append(thumb)
+            now = time.monotonic()
+            if len(self._ring) not in warmup and now < next_run:
+                continue
+            if len(self._ring) == self._ring.maxlen:
+                warmup = ()
+            next_run = now + self.interval if self.interval > 0 else float("inf")
+            try:
+                t0 = time.perf_counter()
+                roi, background = background_atm_roi(list(self._ring), self._scale)
+                self._publish(roi, moved)
+                moved = False
+                print(f"[INFO] ATM ROI estimate {self.roi} from {len(self._ring)} sample(s) "
+                      f"({(time.perf_counter() - t0) * 1000:.0f} ms)")
+            except Exception as e:
+                print(f"[WARN] ATM ROI estimation failed: {e}")
+
+    def _publish(self, roi, moved: bool):
+        self.estimates += 1
+        cur = self.roi
+        if cur is None or moved:
+            new = roi
+        elif _roi_iou(cur, roi) >= 0.5:
+            # same ATM: ease towards the new estimate
+            new = tuple(c + self.alpha * (r - c) for c, r in zip(cur, roi))
+        elif _roi_iou(self._candidate, roi) >= 0.5:
+            new = roi   # confirmed by a second estimate
+        else:
+            self._candidate = roi
+            return
+        self._candidate = None
+        new = tuple(int(round(v)) for v in new)
+        if new != cur:
+            self.roi = new
+            self.version += 1
+
+
 # ------------------------- FEATURE / LOGIC ------------------------
 
 def is_after_hours(now: Optional[datetime] = None) -> bool:
@@ -298,37 +713,33 @@ def is_late_night(now: Optional[datetime] = None) -> bool:
     return (t >= dtime(23, 0, 0)) or (t <= dtime(4, 0, 0))
 
 
+PERSON_CLASSES = ("person",)
+VEHICLE_CLASSES = ("car", "truck", "bus", "motorbike")
+
+
 def extract_features(scene: SceneState):
     """
     Computes high-level features from scene + tracks for danger scoring.
+    Counts and dwell come from the tracker's ZoneEngine (kept up to date on
+    track events); scenes without one (offline stitching) get a fresh
+    engine filled with one O(1) zone lookup per track.
     """
     now_dt = datetime.fromtimestamp(scene.timestamp)
     after_hours = is_after_hours(now_dt)
     late_night = is_late_night(now_dt)
 
-    num_people = 0
-    num_cars = 0
-    num_people_near_atm = 0
-    num_cars_in_parking = 0
-    max_loiter_time_atm = 0.0
-    max_parked_time_after_hours = 0.0
-
-    for tr in scene.tracks:
-        cx, cy = bbox_center(tr.bbox)
-
-        if tr.class_name == "person":
-            num_people += 1
-            if point_in_rect(cx, cy, ATM_ROI):
-                num_people_near_atm += 1
-            if tr.time_in_atm_roi > max_loiter_time_atm:
-                max_loiter_time_atm = tr.time_in_atm_roi
-
-        if tr.class_name in ("car", "truck", "bus", "motorbike"):
-            num_cars += 1
-            if point_in_rect(cx, cy, PARKING_ROI):
-                num_cars_in_parking += 1
-            if after_hours and tr.time_in_parking_roi > max_parked_time_after_hours:
-                max_parked_time_after_hours = tr.time_in_parking_roi
+    zones = scene.zones
+    if zones is None:
+        zones = ZoneEngine(zone_map_for(scene.camera_type))
+        for tr in scene.tracks:
+            zones.place(tr, *bbox_center(tr.bbox))
+
+    num_people = zones.count(None, PERSON_CLASSES)
+    num_cars = zones.count(None, VEHICLE_CLASSES)
+    num_people_near_atm = zones.count("atm", PERSON_CLASSES)
+    num_cars_in_parking = zones.count("parking", VEHICLE_CLASSES)
+    max_loiter_time_atm = zones.max_dwell("atm", PERSON_CLASSES)
+    max_parked_time_after_hours = zones.max_dwell("parking", VEHICLE_CLASSES) if after_hours else 0.0
 
     feats = {
         "after_hours": after_hours,
@@ -342,6 +753,7 @@ def extract_features(scene: SceneState):
         "camera_type": scene.camera_type,
         "cam_is_atm": 1 if scene.camera_type == "ATM" else 0,
         "cam_is_parking": 1 if scene.camera_type == "PARKING" else 0,
+        "zones": zones.summary(),   # per-zone live counts; not a model input
     }
     return feats
 
@@ -356,112 +768,537 @@ def features_to_vector(features: dict) -> List[float]:
     return vec
 
 
-def compute_danger_score(features: dict):
-    """
-    Rule-based danger score 0–100, with reasons and flags.
-    Bank-specific ATM & parking behavior lives here.
-    """
-    score = 0
-    reasons = []
-
-    cam_type = features["camera_type"]
-    num_people = features["num_people"]
-    num_near_atm = features["num_people_near_atm"]
-    after_hours = features["after_hours"]
-    late_night = features["late_night"]
-
-    # ---------- ATM FRAUD-ISH LOGIC ----------
-    if cam_type == "ATM":
-        if num_people >= 2:
-            score += 25
-            reasons.append("Multiple people in ATM camera view")
+# Rules over FEATURE_KEYS columns: (points, reason, predicate on the (B, F) matrix).
+# Compiled once into array expressions; a batch of scenes is scored in one pass.
+_C = {k: i for i, k in enumerate(FEATURE_KEYS)}
 
-        if num_near_atm >= 1:
-            score += 20
-            reasons.append("Person in ATM interaction zone")
 
-        if num_near_atm >= 2:
-            score += 25
-            reasons.append("Multiple people in ATM interaction zone")
+def _col(X: np.ndarray, key: str) -> np.ndarray:
+    return X[:, _C[key]]
 
-        if features["max_loiter_time_atm"] > 5:
-            score += 20
-            reasons.append("Person loitering near ATM >5s")
-
-        if late_night or after_hours:
-            score += 10
-            reasons.append("ATM activity during late night / after hours")
 
+DANGER_RULES = [
+    # ---------- ATM FRAUD-ISH LOGIC ----------
+    (25, "Multiple people in ATM camera view",
+     lambda X: (_col(X, "cam_is_atm") > 0) & (_col(X, "num_people") >= 2)),
+    (20, "Person in ATM interaction zone",
+     lambda X: (_col(X, "cam_is_atm") > 0) & (_col(X, "num_people_near_atm") >= 1)),
+    (25, "Multiple people in ATM interaction zone",
+     lambda X: (_col(X, "cam_is_atm") > 0) & (_col(X, "num_people_near_atm") >= 2)),
+    (20, "Person loitering near ATM >5s",
+     lambda X: (_col(X, "cam_is_atm") > 0) & (_col(X, "max_loiter_time_atm") > 5)),
+    (10, "ATM activity during late night / after hours",
+     lambda X: (_col(X, "cam_is_atm") > 0) & ((_col(X, "late_night") > 0) | (_col(X, "after_hours") > 0))),
     # ---------- AFTER-HOURS PARKING LOGIC ----------
-    if cam_type == "PARKING":
-        if after_hours and features["num_cars_in_parking"] > 0:
-            score += 40
-            reasons.append("Vehicle present in parking lot after hours")
+    (40, "Vehicle present in parking lot after hours",
+     lambda X: (_col(X, "cam_is_parking") > 0) & (_col(X, "after_hours") > 0)
+     & (_col(X, "num_cars_in_parking") > 0)),
+    (25, "Vehicle parked >10 minutes after hours",
+     lambda X: (_col(X, "cam_is_parking") > 0) & (_col(X, "max_parked_time_after_hours") > 600)),
+    # ---------- GENERIC CROWDING / CONTEXT ----------
+    (10, "Crowd detected during late night",
+     lambda X: (_col(X, "num_people") >= 5) & (_col(X, "late_night") > 0)),
+]
+_RULE_POINTS = np.asarray([r[0] for r in DANGER_RULES], dtype=np.int32)
 
-        if features["max_parked_time_after_hours"] > 600:
-            score += 25
-            reasons.append("Vehicle parked >10 minutes after hours")
 
-    # ---------- GENERIC CROWDING / CONTEXT ----------
-    if num_people >= 5 and late_night:
-        score += 10
-        reasons.append("Crowd detected during late night")
+def fill_feature_row(row: np.ndarray, features: dict) -> np.ndarray:
+    """Write `features` into a float32 row in FEATURE_KEYS order (bools -> 0/1)."""
+    for i, key in enumerate(FEATURE_KEYS):
+        row[i] = features[key]
+    return row
+
 
-    score = max(0, min(score, 100))
+def score_rules(X: np.ndarray):
+    """(B, F) feature matrix -> (scores int32 (B,), rule hits bool (B, R))."""
+    hits = np.stack([rule(X) for _, _, rule in DANGER_RULES], axis=1)
+    scores = np.clip(hits.astype(np.int32) @ _RULE_POINTS, 0, 100)
+    return scores, hits
 
-    atm_flag = (cam_type == "ATM") and (score >= 60)
-    parking_flag = (cam_type == "PARKING") and (score >= 60)
 
+def _rule_labels(X: np.ndarray, scores: np.ndarray, i: int) -> List[str]:
     labels = []
-    if atm_flag:
+    if scores[i] >= 60 and X[i, _C["cam_is_atm"]] > 0:
         labels.append("ATM_FRAUD_SUSPECTED")
-    if parking_flag:
+    if scores[i] >= 60 and X[i, _C["cam_is_parking"]] > 0:
         labels.append("UNAUTHORIZED_PARKING_AFTER_HOURS")
+    return labels
 
+
+def compute_danger_score(features: dict):
+    """
+    Rule-based danger score 0–100, with reasons and flags.
+    Bank-specific ATM & parking behavior lives in DANGER_RULES.
+    """
+    X = np.zeros((1, len(FEATURE_KEYS)), dtype=np.float32)
+    fill_feature_row(X[0], features)
+    scores, hits = score_rules(X)
     return {
-        "danger_score": score,
-        "reasons": reasons,
-        "labels": labels,
+        "danger_score": int(scores[0]),
+        "reasons": [DANGER_RULES[j][1] for j in np.flatnonzero(hits[0])],
+        "labels": _rule_labels(X, scores, 0),
     }
 
 
+class OnnxProba:
+    """predict_proba() over an ONNX-exported classifier (e.g. skl2onnx) via onnxruntime."""
+
+    def __init__(self, path: str):
+        import onnxruntime as ort
+        self.session = ort.InferenceSession(path, providers=ort.get_available_providers())
+        self.input_name = self.session.get_inputs()[0].name
+        outputs = self.session.get_outputs()
+        names = [o.name for o in outputs]
+        # skl2onnx names it "probabilities" or "output_probability"; else take the last output
+        self.output_name = next((n for n in names if "prob" in n.lower()), names[-1])
+
+    def predict_proba(self, X) -> np.ndarray:
+        X = np.asarray(X, dtype=np.float32)
+        out = self.session.run([self.output_name], {self.input_name: X})[0]
+        if isinstance(out, list):   # ZipMap: one {class: prob} dict per row
+            return np.asarray([[d.get(0, 0.0), d.get(1, 0.0)] for d in out], dtype=np.float32)
+        return np.asarray(out, dtype=np.float32)
+
+
+def load_ml_model(path: str) -> Any:
+    """joblib-pickled sklearn model, or an .onnx export of it."""
+    if path.endswith(".onnx"):
+        return OnnxProba(path)
+    if joblib is None:
+        raise RuntimeError("joblib not installed")
+    return joblib.load(path)
+
+
+class BatchScorer:
+    """
+    Accumulates scenes' features into a preallocated float32 matrix and scores
+    them together: compiled rules as array expressions plus one predict_proba
+    call for the whole batch. Results match score_features() per scene.
+    """
+
+    def __init__(self, ml_model: Any = None, capacity: int = 256):
+        self.ml_model = ml_model
+        self.capacity = max(1, capacity)
+        self.X = np.zeros((self.capacity, len(FEATURE_KEYS)), dtype=np.float32)
+        self.n = 0
+
+    def add(self, features: dict) -> int:
+        """Adds one scene; returns its row. Call score() when full()."""
+        if self.n == self.capacity:
+            raise RuntimeError("BatchScorer full; call score() first")
+        fill_feature_row(self.X[self.n], features)
+        self.n += 1
+        return self.n - 1
+
+    def full(self) -> bool:
+        return self.n >= self.capacity
+
+    def score(self):
+        """-> [(danger_score, labels, reasons)] for the rows added since the last call."""
+        if self.n == 0:
+            return []
+        X = self.X[:self.n]
+        scores, hits = score_rules(X)
+        final = scores.copy()
+        prob = None
+        if self.ml_model is not None:
+            prob = np.asarray(self.ml_model.predict_proba(X))[:, 1]   # P(suspicious)
+            final = ((scores + (100 * prob).astype(np.int32)) / 2).astype(np.int32)
+        out = []
+        for i in range(self.n):
+            labels = _rule_labels(X, scores, i)
+            if prob is not None and prob[i] > 0.6:
+                labels.append("ML_SUSPICIOUS")
+            reasons = [DANGER_RULES[j][1] for j in np.flatnonzero(hits[i])]
+            out.append((int(final[i]), labels, reasons))
+        self.n = 0
+        return out
+
+
 # ------------------------- YOLO WRAPPER ---------------------------
 
 class Yolo10Detector:
-    def __init__(self, weights="yolov10s.pt", device="cuda"):
-        self.model = YOLO(weights)
+    def __init__(self, weights="yolov10s.pt", device="cuda", backend="torch", imgsz=640, batch=1,
+                 rules: Optional[dict] = None):
+        # backend: torch | onnx | tensorrt | tensorrt-int8 | openvino | auto,
+        # or an already loaded InferenceBackend (weights is then ignored)
+        if isinstance(backend, str):
+            backend = load_backend(weights, backend, imgsz=imgsz, device=device, batch=batch)
+        self.backend = backend
+        self.model = self.backend.model
         self.device = device
+        self.imgsz = imgsz
+        self.set_rules(rules)
+        print(f"[INFO] Inference backend: {self.backend.name} ({self.backend.artifact})")
+
+    def set_rules(self, rules: Optional[dict] = None):
+        """Swap the class filter (RuleSet config) between frames."""
+        self.table = RuleSet(rules if rules is not None else TRACK_RULES).compile(
+            getattr(self.model, "names", None) or {})
+
+    def _predict(self, images):
+        # only the kept classes go through NMS at all
+        return self.model.predict(images, device=self.device, imgsz=self.imgsz, verbose=False,
+                                  classes=self.table.class_ids)
 
     def detect(self, frame):
         """
         Returns list of {bbox, conf, class_name}
         """
-        results = self.model.predict(frame, device=self.device, verbose=False)[0]
+        return self._parse(self._predict(frame)[0])
+
+    def detect_batch(self, frames, max_batch: int = 16):
+        """
+        Runs several frames (e.g. one per camera) through a single predict call
+        per chunk of `max_batch`. Returns one detection list per input frame.
+        """
+        out = []
+        for i in range(0, len(frames), max(1, max_batch)):
+            chunk = list(frames[i:i + max_batch])
+            results = self._predict(chunk)
+            out.extend(self._parse(r) for r in results)
+        return out
+
+    def detect_regions(self, frame, windows, max_batch: int = 16, nms_iou: float = 0.5):
+        """
+        Detect inside crop `windows` (see roi_windows) in batched predict calls
+        and return merged detections in full-frame coordinates.
+        """
         detections = []
-        for box in results.boxes:
-            cls_id = int(box.cls)
-            conf = float(box.conf)
-            if cls_id not in COCO_CLASSES:
-                continue
-            class_name = COCO_CLASSES[cls_id]
-            if class_name not in ("person", "car", "truck", "bus", "motorbike"):
-                continue
+        for i in range(0, len(windows), max(1, max_batch)):
+            chunk = windows[i:i + max_batch]
+            crops = [frame[y1:y2, x1:x2] for (x1, y1, x2, y2) in chunk]
+            results = self._predict(crops)
+            for (x1, y1, _, _), r in zip(chunk, results):
+                detections.extend(self._parse(r, offset=(x1, y1)))
+        return merge_detections(detections, nms_iou)
+
+    def _parse(self, results, offset=(0, 0)):
+        boxes = results.boxes
+        if boxes is None or len(boxes) == 0:
+            return []
+        # one device->host copy per result: x1 y1 x2 y2 [id] conf cls
+        data = boxes.data
+        arr = data.cpu().numpy() if hasattr(data, "cpu") else np.asarray(data)
+        cls = arr[:, -1].astype(np.int64)
+        table = self.table
+        keep = (cls >= 0) & (cls < table.size)
+        keep[keep] = table.keep[cls[keep]]
+        if not keep.any():
+            return []
+        xyxy = arr[keep, :4].astype(np.float64)
+        xyxy[:, [0, 2]] += offset[0]
+        xyxy[:, [1, 3]] += offset[1]
+        return [
+            {"bbox": tuple(bb), "conf": cf, "class_name": table.keys[c]}
+            for bb, cf, c in zip(xyxy.tolist(), arr[keep, -2].tolist(), cls[keep].tolist())
+        ]
+
+
+# ------------------------- SCORING / ALERTS -----------------------
+
+def score_features(features: dict, ml_model: Any = None):
+    """Rule score, fused with the optional ML model -> (danger_score, labels, rule result)."""
+    result = compute_danger_score(features)
+    danger_score = result["danger_score"]
+    labels = result["labels"]
+
+    # Optional ML fusion
+    if ml_model is not None:
+        vec = fill_feature_row(np.empty(len(FEATURE_KEYS), dtype=np.float32), features)[None, :]
+        prob = float(ml_model.predict_proba(vec)[0][1])  # P(suspicious)
+        ml_score = int(100 * prob)
+        danger_score = int((danger_score + ml_score) / 2)
+        if prob > 0.6 and "ML_SUSPICIOUS" not in labels:
+            labels.append("ML_SUSPICIOUS")
+    return danger_score, labels, result
+
+
+# labels that save an evidence clip when --clips-dir is set
+CLIP_TRIGGER_LABELS = {"ATM_FRAUD_SUSPECTED"}
+
+
+def submit_alert(alert_sink: AlertSink, args, ts: float, danger_score, labels, reasons, tracks,
+                 recorder=None, media_time: bool = False):
+    record = {
+        "timestamp": datetime.fromtimestamp(ts).astimezone().isoformat(),
+        "camera": args.camera_type,
+        "source": args.source,
+        "danger_score": danger_score,
+        "labels": list(labels),
+        "reasons": reasons,
+        "track_ids": [tr.track_id for tr in tracks],
+    }
+    clip = None
+    if recorder is not None and CLIP_TRIGGER_LABELS.intersection(labels):
+        clip = record["clip"] = recorder.reserve(ts)
+    # one alert per camera + label set: track ids cover everyone in view and churn when a
+    # track is re-acquired, so they would split one event. Offline runs faster than real
+    # time, so coalesce on media time there
+    key = (args.camera_type, tuple(sorted(labels)))
+    if alert_sink.submit(record, key=key, now=ts if media_time else None):
+        print(
+            f"[ALERT] t={datetime.fromtimestamp(ts)} "
+            f"score={danger_score} labels={labels}"
+        )
+        if clip:
+            recorder.trigger(ts, clip, record)
+    elif clip:
+        recorder.extend(ts)
 
-            x1, y1, x2, y2 = box.xyxy[0].tolist()
-            detections.append(
-                {
-                    "bbox": (x1, y1, x2, y2),
-                    "conf": conf,
-                    "class_name": class_name,
-                }
-            )
-        return detections
+
+# ------------------------- OFFLINE (HEADLESS) MODE ----------------
+
+class PrefetchReader:
+    """
+    Decodes frames [start, end) on a background thread into a bounded queue.
+    Yields (frame_index, media_sec, frame); frames come from a fixed buffer
+    pool, so hand each one back with recycle() once it is no longer needed.
+    The pool covers a full `batch` held by the consumer plus the decoder's
+    next frame, so batch > depth cannot starve it.
+    """
+
+    def __init__(self, source: str, start: int = 0, end: Optional[int] = None, depth: int = 64,
+                 batch: int = 1):
+        self._cap = cv2.VideoCapture(source)
+        if not self._cap.isOpened():
+            raise RuntimeError(f"Failed to open source: {source}")
+        if start > 0:
+            self._cap.set(cv2.CAP_PROP_POS_FRAMES, start)
+        fps = self._cap.get(cv2.CAP_PROP_FPS)
+        self.fps = fps if fps > 0 else 30.0
+        self.start = start
+        self.end = end
+        self._queue = queue.Queue(maxsize=depth)
+        self._free = queue.Queue()
+        for _ in range(max(depth, batch) + 2):
+            self._free.put(None)   # sized by the first read into each slot
+        self._thread = threading.Thread(target=self._run, name="prefetch", daemon=True)
+        self._thread.start()
+
+    def _run(self):
+        idx = self.start
+        try:
+            while self.end is None or idx < self.end:
+                buf = self._free.get()
+                ok, frame = self._cap.read(buf) if buf is not None else self._cap.read()
+                if not ok:
+                    break
+                # media PTS of the frame just decoded; frame count / fps if the container has none
+                ms = self._cap.get(cv2.CAP_PROP_POS_MSEC)
+                sec = ms / 1000.0 if ms > 0 or idx == 0 else idx / self.fps
+                self._queue.put((idx, sec, frame))
+                idx += 1
+        finally:
+            self._cap.release()
+            self._queue.put(None)
+
+    def recycle(self, frame):
+        self._free.put(frame)
+
+    def __iter__(self):
+        while True:
+            item = self._queue.get()
+            if item is None:
+                return
+            yield item
+
+
+def track_chunk(job: dict) -> str:
+    """
+    Worker: detect + track frames [warm_start, end) of job["source"] in batches
+    and write one JSON line per frame (tracks with media-time ROI timings) to
+    job["out"]. Frames before job["start"] only warm the tracker up for stitching.
+    """
+    global ATM_ROI, ZONES
+    ATM_ROI = tuple(job["atm_roi"])
+    if job.get("zones") is not None:
+        ZONES = [Zone.from_dict(z) for z in job["zones"]]
+    detector = Yolo10Detector(weights=job["weights"], device=job["device"], backend=job["backend"],
+                              imgsz=job["imgsz"], batch=job["batch"], rules=job.get("rules"))
+    tracker = SimpleTracker()
+    reader = PrefetchReader(job["source"], job["warm_start"], job["end"], depth=job["prefetch"],
+                            batch=job["batch"])
+    windows = None
+    pending = []
+
+    def flush(out):
+        nonlocal windows
+        frames = [p[2] for p in pending]
+        if job["roi_infer"] == "off":
+            all_dets = detector.detect_batch(frames, max_batch=job["batch"])
+        else:
+            if windows is None:
+                roi = inference_roi(job["camera_type"])
+                tile = job["tile_size"] if job["roi_infer"] == "tile" else 0
+                windows = roi_windows(roi, frames[0].shape, tile, job["tile_overlap"])
+            all_dets = [detector.detect_regions(f, windows, max_batch=job["batch"]) for f in frames]
+        for (idx, sec, frame), dets in zip(pending, all_dets):
+            ts = job["t0"] + sec
+            tracks = tracker.update(dets, ts, job["camera_type"])
+            out.write(json.dumps({"i": idx, "ts": ts, "tracks": [
+                [tr.track_id, tr.class_name, list(tr.bbox), tr.conf, tr.first_seen, tr.last_seen,
+                 tr.time_in_atm_roi, tr.time_in_parking_roi] for tr in tracks]}) + "\n")
+            reader.recycle(frame)
+        pending.clear()
+
+    with open(job["out"], "w") as out:
+        for item in reader:
+            pending.append(item)
+            if len(pending) >= job["batch"]:
+                flush(out)
+        if pending:
+            flush(out)
+    return job["out"]
+
+
+class ChunkStitcher:
+    """
+    Turns per-chunk track rows into TrackStates with global ids. On the last
+    frame of the previous chunk (which the next chunk re-processed as warm-up)
+    tracks are matched by class + IoU; matched tracks keep their global id,
+    first_seen and accumulated ROI time across the boundary.
+    """
+
+    def __init__(self, iou_thresh: float = 0.3):
+        self.iou_thresh = iou_thresh
+        self.next_id = 1
+        self._map: Dict[int, Tuple[int, float, float, float]] = {}  # local -> (gid, first_seen, d_atm, d_park)
+        self._last_rows: list = []        # previous chunk's last emitted frame, already global
+
+    def begin_chunk(self, boundary_rows):
+        """boundary_rows: the new chunk's rows on the previous chunk's last frame (or None)."""
+        self._map = {}
+        prev = self._last_rows
+        if not boundary_rows or not prev:
+            return
+        a = np.asarray([r[2] for r in boundary_rows], dtype=np.float32).reshape(-1, 4)
+        b = np.asarray([r[2] for r in prev], dtype=np.float32).reshape(-1, 4)
+        ious = iou_matrix(a, b)
+        same = np.asarray([r[1] for r in boundary_rows])[:, None] == np.asarray([r[1] for r in prev])[None, :]
+        ious[~same] = 0.0
+        for i, j in assign_max_iou(ious, self.iou_thresh):
+            new, old = boundary_rows[i], prev[j]
+            self._map[new[0]] = (old[0], old[4], old[6] - new[6], old[7] - new[7])
+
+    def tracks(self, rows) -> List[TrackState]:
+        out, emitted = [], []
+        for tid, cls, bbox, conf, first_seen, last_seen, t_atm, t_park in rows:
+            m = self._map.get(tid)
+            if m is None:
+                m = self._map[tid] = (self.next_id, first_seen, 0.0, 0.0)
+                self.next_id += 1
+            gid, first, d_atm, d_park = m
+            tr = TrackState(track_id=gid, class_name=cls, bbox=tuple(bbox), conf=conf,
+                            first_seen=first, last_seen=last_seen,
+                            time_in_atm_roi=t_atm + d_atm, time_in_parking_roi=t_park + d_park)
+            out.append(tr)
+            emitted.append([gid, cls, bbox, conf, first, last_seen, tr.time_in_atm_roi, tr.time_in_parking_roi])
+        self._last_rows = emitted
+        return out
+
+
+def plan_chunks(total_frames: int, workers: int, overlap: int, min_chunk: int = 300):
+    """[(warm_start, start, end)] covering [0, total) with `overlap` warm-up frames before each chunk."""
+    n = max(1, min(workers, total_frames // max(1, min_chunk)))
+    bounds = np.linspace(0, total_frames, n + 1).round().astype(int).tolist()
+    return [(max(0, a - overlap) if a > 0 else 0, a, b) for a, b in zip(bounds[:-1], bounds[1:])]
+
+
+def run_offline(args, fps: float, ml_model: Any, csv_writer, alert_sink: AlertSink):
+    """
+    Headless max-throughput pass over a video file: prefetching decode, batched
+    detection, media-time tracking, optional multi-process chunks, no display.
+    """
+    import tempfile
+    from multiprocessing import get_context
+    global ATM_ROI
+
+    cap = cv2.VideoCapture(args.source)
+    total = int(cap.get(cv2.CAP_PROP_FRAME_COUNT))
+    if args.camera_type == "ATM" and ZONES is None:
+        ATM_ROI = atm_roi_from_file(cap, fps) or ATM_ROI
+        print("[INFO] Estimated ATM_ROI:", ATM_ROI)
+    cap.release()
+    if total <= 0:
+        total = None    # unknown length: one chunk to EOF
+    t0 = datetime.fromisoformat(args.start_time).timestamp() if args.start_time else time.time()
+    overlap = int(round(args.chunk_overlap * fps))
+    chunks = plan_chunks(total, args.workers, overlap) if total else [(0, 0, None)]
+
+    tmpdir = tempfile.mkdtemp(prefix="bankcv-offline-")
+    jobs = [{
+        "source": args.source, "warm_start": w, "start": a, "end": b,
+        "out": os.path.join(tmpdir, f"chunk-{k:04d}.jsonl"),
+        "weights": args.weights, "device": args.device, "backend": args.backend,
+        "imgsz": args.img_size, "batch": args.batch, "prefetch": args.prefetch,
+        "camera_type": args.camera_type, "atm_roi": list(ATM_ROI), "t0": t0,
+        "roi_infer": args.roi_infer, "tile_size": args.tile_size, "tile_overlap": args.tile_overlap,
+        "rules": args.rules_data,
+        "zones": [z.to_dict() for z in ZONES] if ZONES is not None else None,
+    } for k, (w, a, b) in enumerate(chunks)]
+    print(f"[INFO] Offline: {total or '?'} frames in {len(jobs)} chunk(s), "
+          f"batch={args.batch}, overlap={overlap} frames")
+
+    started = time.time()
+    frames_done = 0
+    stitcher = ChunkStitcher()
+    scorer = BatchScorer(ml_model, capacity=args.score_batch)
+    scored: list = []   # (ts, tracks) per row in `scorer`
+
+    def flush_scores():
+        for (ts, tracks), (danger_score, labels, reasons) in zip(scored, scorer.score()):
+            if labels:
+                submit_alert(alert_sink, args, ts, danger_score, labels, reasons, tracks,
+                             media_time=True)
+        scored.clear()
+
+    pool = get_context("spawn").Pool(len(jobs)) if len(jobs) > 1 else None
+    try:
+        results = pool.imap(track_chunk, jobs) if pool else map(track_chunk, jobs)
+        for job, path in zip(jobs, results):
+            with open(path) as f:
+                first = True
+                for line in f:
+                    rec = json.loads(line)
+                    if rec["i"] < job["start"]:
+                        if rec["i"] == job["start"] - 1:
+                            stitcher.begin_chunk(rec["tracks"])
+                            first = False
+                        continue
+                    if first:
+                        stitcher.begin_chunk(None)
+                        first = False
+                    ts = rec["ts"]
+                    tracks = stitcher.tracks(rec["tracks"])
+                    features = extract_features(SceneState(timestamp=ts, camera_type=args.camera_type,
+                                                           tracks=tracks))
+                    if args.mode == "collect":
+                        csv_writer.writerow([args.label] + features_to_vector(features))
+                    else:
+                        scorer.add(features)
+                        scored.append((ts, tracks))
+                        if scorer.full():
+                            flush_scores()
+                    frames_done += 1
+            os.remove(path)
+        flush_scores()
+    finally:
+        if pool is not None:
+            pool.close()
+            pool.join()
+        try: os.rmdir(tmpdir)
+        except OSError: pass
+    elapsed = time.time() - started
+    media = frames_done / fps
+    print(f"[INFO] Offline done: {frames_done} frames in {elapsed:.1f}s "
+          f"({frames_done / max(elapsed, 1e-9):.1f} fps, {media / max(elapsed, 1e-9):.1f}x real time)")
 
 
 # ------------------------- MAIN LOOP ------------------------------
 
 def main():
-    global ATM_ROI
+    global ATM_ROI, ZONES
 
     parser = argparse.ArgumentParser()
     parser.add_argument(
@@ -481,6 +1318,62 @@ def main():
     parser.add_argument(
         "--device", default="cpu", help="cuda or cpu"
     )
+    parser.add_argument(
+        "--backend",
+        choices=["torch", "onnx", "tensorrt", "tensorrt-int8", "openvino", "auto"],
+        default="torch",
+        help="Inference runtime; exports are cached next to the weights",
+    )
+    parser.add_argument(
+        "--img-size", type=int, default=640, help="Inference image size"
+    )
+    parser.add_argument(
+        "--roi-infer",
+        choices=["off", "crop", "tile"],
+        default="off",
+        help="Detect only inside the camera's ROI (crop), or in overlapping tiles over it (tile)",
+    )
+    parser.add_argument(
+        "--tile-size", type=int, default=640, help="Tile edge in source pixels for --roi-infer tile"
+    )
+    parser.add_argument(
+        "--tile-overlap", type=float, default=0.2, help="Fractional overlap between tiles"
+    )
+    parser.add_argument(
+        "--offline",
+        type=int,
+        default=0,
+        help="If 1 (video files), headless max-throughput pass: prefetch, batching, media time, no display",
+    )
+    parser.add_argument(
+        "--batch", type=int, default=8, help="Frames per detector call in --offline mode"
+    )
+    parser.add_argument(
+        "--workers", type=int, default=1, help="Processes splitting the file into chunks in --offline mode"
+    )
+    parser.add_argument(
+        "--chunk-overlap",
+        type=float,
+        default=5.0,
+        help="Seconds each chunk re-processes before its start so tracks can be stitched",
+    )
+    parser.add_argument(
+        "--score-batch", type=int, default=256, help="Scenes scored per rules/ML call in --offline mode"
+    )
+    parser.add_argument(
+        "--prefetch", type=int, default=64, help="Decoded frames buffered ahead in --offline mode"
+    )
+    parser.add_argument(
+        "--start-time",
+        default=None,
+        help="Wall-clock time of the file's first frame (ISO 8601) for --offline; default now",
+    )
+    parser.add_argument(
+        "--metrics-port",
+        type=int,
+        default=0,
+        help="If set, serve Prometheus stage timings on http://0.0.0.0:PORT/metrics",
+    )
     parser.add_argument(
         "--realtime",
         type=int,
@@ -509,10 +1402,62 @@ def main():
     parser.add_argument(
         "--ml-model",
         default=None,
-        help="Path to trained ML model (joblib) for learned danger score",
+        help="Path to trained ML model (joblib, or an .onnx export) for learned danger score",
+    )
+    parser.add_argument(
+        "--alerts-dir",
+        default=None,
+        help="Store alerts as JSONL segments here (same layout as server.py)",
+    )
+    parser.add_argument(
+        "--alert-coalesce",
+        type=float,
+        default=10.0,
+        help="Seconds during which repeats of the same alert labels are folded into one",
+    )
+    parser.add_argument(
+        "--clips-dir",
+        default=None,
+        help="Keep a pre-roll of encoded frames and save an MP4 clip here on ATM_FRAUD_SUSPECTED",
+    )
+    parser.add_argument(
+        "--preroll", type=float, default=10.0, help="Seconds before the alert kept in a clip"
+    )
+    parser.add_argument(
+        "--postroll", type=float, default=5.0, help="Seconds recorded after the last alert of a clip"
+    )
+    parser.add_argument(
+        "--roi-interval",
+        type=float,
+        default=300.0,
+        help="Seconds between background ATM ROI re-estimates (0: only at startup / when the camera moves)",
+    )
+    parser.add_argument(
+        "--zones",
+        type=str,
+        default=None,
+        help="Zones JSON ([{name, kind: atm|parking|..., polygon: [[x, y], ...]}]) replacing the ATM/parking ROIs",
+    )
+    parser.add_argument(
+        "--rules",
+        type=str,
+        default=None,
+        help="Rules JSON ({levels, colors, track}) selecting which classes are kept; re-read when it changes",
+    )
+    parser.add_argument(
+        "--adaptive",
+        type=int,
+        default=0,
+        help="If 1, run detection every frame only on motion/threats; tracker predicts in between",
     )
 
     args = parser.parse_args()
+    rules_file = RulesFile(args.rules) if args.rules else None
+    rules = rules_file.poll(time.monotonic()) if rules_file else None
+    args.rules_data = rules
+    if args.zones:
+        ZONES = load_zones(args.zones)
+        print(f"[INFO] Loaded {len(ZONES)} zone(s) from {args.zones}")
 
     # Open video source
     if args.source == "0":
@@ -524,18 +1469,12 @@ def main():
         print("Failed to open source:", args.source)
         return
 
-    # ATM ROI auto-detection from the first frame
-    if args.camera_type == "ATM":
-        ret0, frame0 = cap.read()
-        if not ret0:
-            print("Failed to read first frame for ATM ROI detection.")
-            return
-        ATM_ROI = auto_detect_atm_roi(frame0)
-        print("[INFO] Auto-detected ATM_ROI:", ATM_ROI)
-
-        # For file sources, rewind to start so we don't skip frames
-        if args.source != "0":
-            cap.set(cv2.CAP_PROP_POS_FRAMES, 0)
+    # ATM ROI: estimated in the background from the frames the loop reads anyway
+    # (the default stands until the first estimate; no rewinding the source)
+    roi_estimator = None
+    if args.camera_type == "ATM" and ZONES is None and not args.offline:
+        roi_estimator = AtmRoiEstimator(interval=args.roi_interval)
+    roi_version = 0
 
     # FPS for fake-live playback
     fps = cap.get(cv2.CAP_PROP_FPS)
@@ -543,16 +1482,24 @@ def main():
         fps = 30.0
     frame_delay = 1.0 / fps
 
-    detector = Yolo10Detector(weights=args.weights, device=args.device)
+    if args.offline and args.source == "0":
+        raise SystemExit("--offline needs a video file source")
+    # offline workers load their own detector
+    detector = None if args.offline else Yolo10Detector(
+        weights=args.weights, device=args.device, backend=args.backend, imgsz=args.img_size,
+        rules=rules,
+    )
     tracker = SimpleTracker()
+    windows = None   # ROI crop windows, built once the frame size is known
+    scheduler = AdaptiveScheduler() if args.adaptive else None
 
     # Load ML danger model if provided
     ml_model: Any = None
     if args.ml_model is not None:
-        if joblib is None:
+        if joblib is None and not args.ml_model.endswith(".onnx"):
             print("[WARN] joblib not installed; cannot load ML model.")
         elif os.path.exists(args.ml_model):
-            ml_model = joblib.load(args.ml_model)
+            ml_model = load_ml_model(args.ml_model)
             print(f"[INFO] Loaded ML danger model from {args.ml_model}")
         else:
             print(f"[WARN] ML model path {args.ml_model} not found; running without ML.")
@@ -569,33 +1516,107 @@ def main():
         if not file_exists:
             csv_writer.writerow(["label"] + FEATURE_KEYS)
 
+    # Alerts go through a background sink: the frame loop never blocks on disk,
+    # and the same labels only alert once per coalesce window.
+    alert_sink = AlertSink(
+        AlertStore(args.alerts_dir) if args.alerts_dir else None,
+        coalesce_sec=args.alert_coalesce,
+    )
+    if args.alerts_dir:
+        alert_sink.start()
+
+    recorder = None
+    if args.clips_dir and not args.offline:
+        from clips import ClipRecorder, report_to_sink
+        recorder = ClipRecorder(args.camera_type, args.clips_dir, preroll=args.preroll,
+                                postroll=args.postroll,
+                                on_done=report_to_sink(lambda: alert_sink))
+
+    if args.offline:
+        cap.release()
+        run_offline(args, fps, ml_model, csv_writer, alert_sink)
+        if csv_file is not None:
+            csv_file.close()
+        alert_sink.close()
+        return
+
     print(
         f"[INFO] Starting loop, mode={args.mode}, "
         f"camera_type={args.camera_type}, after_hours={is_after_hours()}"
     )
 
+    # per-stage timings; exported only with --metrics-port
+    registry = Registry()
+    stage_seconds = registry.histogram("surveilens_stage_seconds", "Per-frame time spent in each stage")
+    frame_rate = RateMeter()
+    cam = args.camera_type
+    registry.collector(lambda: [
+        ("surveilens_configured_fps", "gauge", "Source FPS", [({"camera": cam}, fps)]),
+        ("surveilens_achieved_fps", "gauge", "Measured loop frames per second", [({"camera": cam}, frame_rate.rate())]),
+        ("surveilens_frames_total", "counter", "Frames processed", [({"camera": cam}, frame_rate.count)]),
+    ])
+    if args.metrics_port:
+        serve_metrics(registry, args.metrics_port)
+        print(f"[INFO] Metrics on http://0.0.0.0:{args.metrics_port}/metrics")
+
+    frame = None
     while True:
-        ret, frame = cap.read()
+        # decode into the previous frame's buffer (no per-frame allocation)
+        t0 = time.perf_counter()
+        ret, frame = cap.read(frame)
         if not ret:
             break
+        t1 = time.perf_counter()
+        stage_seconds.observe(t1 - t0, stage="decode", camera=cam)
+        frame_rate.tick()
 
         ts = time.time()
-
-        # Detection
-        detections = detector.detect(frame)
-
-        # Tracking
-        tracks = tracker.update(detections, ts, args.camera_type)
+        if roi_estimator is not None:
+            roi_estimator.offer(frame, t0)
+            if roi_estimator.version != roi_version:
+                roi_version = roi_estimator.version
+                ATM_ROI = roi_estimator.roi   # zones / tracker pick it up on the next update
+                windows = None
+        if rules_file is not None:
+            changed = rules_file.poll(t0)
+            if changed is not None:
+                detector.set_rules(changed)
+                print(f"[INFO] Reloaded rules from {args.rules}")
+
+        # Detection + tracking (or just tracker prediction on a quiet frame)
+        inferred = scheduler is None or scheduler.should_infer(frame)
+        if inferred:
+            if args.roi_infer == "off":
+                detections = detector.detect(frame)
+            else:
+                if windows is None:
+                    roi = inference_roi(args.camera_type)
+                    tile = args.tile_size if args.roi_infer == "tile" else 0
+                    windows = roi_windows(roi, frame.shape, tile, args.tile_overlap)
+                    print(f"[INFO] ROI inference over {len(windows)} window(s): {windows}")
+                detections = detector.detect_regions(frame, windows)
+            t2 = time.perf_counter()
+            stage_seconds.observe(t2 - t1, stage="inference", camera=cam)
+            tracks = tracker.update(detections, ts, args.camera_type)
+        else:
+            t2 = time.perf_counter()
+            tracks = tracker.predict(ts, args.camera_type)
+        t3 = time.perf_counter()
+        stage_seconds.observe(t3 - t2, stage="tracker", camera=cam)
+        threat = False
 
         # Build scene state
         scene = SceneState(
             timestamp=ts,
             camera_type=args.camera_type,
             tracks=tracks,
+            zones=tracker.zones,
         )
 
         # Features
         features = extract_features(scene)
+        t4 = time.perf_counter()
+        stage_seconds.observe(t4 - t3, stage="features", camera=cam)
 
         if args.mode == "collect":
             vec = features_to_vector(features)
@@ -613,18 +1634,10 @@ def main():
             )
 
         else:
-            result = compute_danger_score(features)
-            danger_score = result["danger_score"]
-            labels = result["labels"]
-
-            # Optional ML fusion
-            if ml_model is not None:
-                vec = [features_to_vector(features)]
-                prob = float(ml_model.predict_proba(vec)[0][1])  # P(suspicious)
-                ml_score = int(100 * prob)
-                danger_score = int((danger_score + ml_score) / 2)
-                if prob > 0.6 and "ML_SUSPICIOUS" not in labels:
-                    labels.append("ML_SUSPICIOUS")
+            danger_score, labels, result = score_features(features, ml_model)
+            threat = bool(labels)
+            t5 = time.perf_counter()
+            stage_seconds.observe(t5 - t4, stage="scoring", camera=cam)
 
             # --- Visualization / logging ---
             for tr in tracks:
@@ -666,11 +1679,17 @@ def main():
                 2,
             )
 
+            if recorder is not None:
+                recorder.push(frame, ts)
             if labels:
-                print(
-                    f"[ALERT] t={datetime.fromtimestamp(ts)} "
-                    f"score={danger_score} labels={labels}"
-                )
+                submit_alert(alert_sink, args, ts, danger_score, labels, result["reasons"], tracks,
+                             recorder)
+
+        if args.mode != "collect":
+            stage_seconds.observe(time.perf_counter() - t5, stage="draw", camera=cam)
+
+        if inferred and scheduler is not None:
+            scheduler.observe(len(detections), threat)
 
         cv2.imshow("Bank CV Monitor", frame)
 
@@ -686,6 +1705,12 @@ def main():
     if csv_file is not None:
         csv_file.close()
 
+    if recorder is not None:
+        recorder.close()
+    if roi_estimator is not None:
+        roi_estimator.close()
+    alert_sink.close()
+
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,217 @@
+# gpu_pipeline.py — on-device letterbox, inference, overlay drawing and I420 conversion (GPU_PIPELINE=1)
+import threading
+from collections import OrderedDict
+from typing import Dict, List, Optional, Sequence, Tuple
+
+import cv2
+import numpy as np
+
+try:
+    import torch
+    import torch.nn.functional as F
+except Exception as e:   # torch ships with ultralytics; absent means CPU-only install
+    torch = None
+    F = None
+    print("[WARN] torch not available; GPU pipeline disabled.", e)
+
+PAD_VALUE = 114   # ultralytics LetterBox fill
+
+# BT.601 limited range, same as cv2.COLOR_BGR2YUV_I420
+_Y = (0.098, 0.504, 0.257)       # B, G, R
+_U = (0.439, -0.291, -0.148)
+_V = (-0.071, -0.368, 0.439)
+
+
+def available(device=None) -> bool:
+    if torch is None or not torch.cuda.is_available():
+        return False
+    return device in (None, "") or str(device).startswith("cuda") or str(device).isdigit()
+
+
+class _Sprites:
+    """Caption / banner text rendered once with cv2 and kept on the device as (pixels, mask)."""
+
+    def __init__(self, device, capacity: int = 512):
+        self.device = device
+        self.capacity = capacity
+        self._cache: "OrderedDict[tuple, tuple]" = OrderedDict()
+
+    def get(self, text: str, color, scale: float, thickness: int):
+        key = (text, tuple(color), scale, thickness)
+        hit = self._cache.get(key)
+        if hit is not None:
+            self._cache.move_to_end(key)
+            return hit
+        (tw, th), base = cv2.getTextSize(text, cv2.FONT_HERSHEY_SIMPLEX, scale, thickness)
+        canvas = np.zeros((th + base + thickness, tw + thickness, 3), dtype=np.uint8)
+        cv2.putText(canvas, text, (0, th), cv2.FONT_HERSHEY_SIMPLEX, scale, color, thickness, cv2.LINE_AA)
+        mask = canvas.any(axis=2)
+        hit = (torch.from_numpy(canvas).to(self.device), torch.from_numpy(mask).to(self.device), th)
+        self._cache[key] = hit
+        if len(self._cache) > self.capacity:
+            self._cache.popitem(last=False)
+        return hit
+
+
+class GpuPipeline:
+    """
+    Keeps each decoded frame on the GPU from one upload to the finished
+    I420 picture. Letterboxing to `imgsz` (BGR->RGB, /255) is done with
+    tensor ops in place of ultralytics' CPU preprocessing. The batch goes
+    through the model's own predictor (inference + NMS + box scaling).
+    Boxes, captions and the HIGH tint are drawn on the device frame, which
+    is then converted to I420 there. Only the box tensor and the
+    1.5-byte-per-pixel I420 picture ever come back to the host. The
+    encoders (aiortc / PyAV) take host frames, so that last copy stays.
+    """
+
+    def __init__(self, device=None, imgsz: int = 640):
+        self.device = torch.device(device if device not in (None, "") else "cuda")
+        if self.device.type == "cuda" and self.device.index is None:
+            self.device = torch.device("cuda", torch.cuda.current_device())
+        self.imgsz = imgsz
+        self.sprites = _Sprites(self.device)
+        self._stage: Dict[tuple, "torch.Tensor"] = {}   # pinned upload / download buffers by shape
+        self._colors: Dict[tuple, "torch.Tensor"] = {}
+        self._lock = threading.Lock()
+        self._y = torch.tensor(_Y, device=self.device)
+        self._u = torch.tensor(_U, device=self.device)
+        self._v = torch.tensor(_V, device=self.device)
+        self.stream = torch.cuda.Stream(self.device)
+        print(f"[INFO] GPU pipeline on {self.device}")
+
+    # ----- host <-> device -----
+    def _pinned(self, key, shape) -> "torch.Tensor":
+        buf = self._stage.get(key)
+        if buf is None or tuple(buf.shape) != tuple(shape):
+            buf = self._stage[key] = torch.empty(shape, dtype=torch.uint8, pin_memory=True)
+        return buf
+
+    def upload(self, img: np.ndarray, key=None) -> "torch.Tensor":
+        """HxWx3 uint8 BGR onto the device (through a pinned buffer per `key`)."""
+        stage = self._pinned(("up", key), img.shape)
+        stage.numpy()[...] = img
+        return stage.to(self.device, non_blocking=True)
+
+    def _color(self, bgr) -> "torch.Tensor":
+        key = tuple(int(c) for c in bgr)
+        t = self._colors.get(key)
+        if t is None:
+            t = self._colors[key] = torch.tensor(key, dtype=torch.uint8, device=self.device)
+        return t
+
+    # ----- preprocessing -----
+    def _letterbox(self, frame: "torch.Tensor", out: "torch.Tensor"):
+        """Resize + centre-pad one HWC BGR frame into out (3, S, S) RGB float in [0, 1]."""
+        h, w = frame.shape[:2]
+        s = self.imgsz
+        r = min(s / h, s / w)
+        nw, nh = int(round(w * r)), int(round(h * r))
+        # same rounding as ultralytics LetterBox, so its scale_boxes() maps boxes back exactly
+        top, left = int(round((s - nh) / 2 - 0.1)), int(round((s - nw) / 2 - 0.1))
+        x = frame.permute(2, 0, 1).flip(0).unsqueeze(0).float()   # 1, 3(RGB), H, W
+        if (nh, nw) != (h, w):
+            x = F.interpolate(x, size=(nh, nw), mode="bilinear", align_corners=False)
+        out.fill_(PAD_VALUE / 255.0)
+        out[:, top:top + nh, left:left + nw] = x[0].div_(255.0)
+
+    def infer(self, model, images: Sequence[np.ndarray], conf: float, classes=None, keys=None):
+        """
+        One batch through `model` (InferenceBackend) with frames kept on the GPU.
+        Returns ultralytics Results (boxes in original-frame pixels), each carrying
+        its device frame as `gpu_frame` for draw() / to_i420().
+        """
+        yolo = model.model
+        predictor = getattr(yolo, "predictor", None)
+        if predictor is None:   # created by the first predict() (normally the warm-up)
+            model.predict([np.zeros((64, 64, 3), dtype=np.uint8)], imgsz=self.imgsz, conf=conf)
+            predictor = yolo.predictor
+        keys = keys or list(range(len(images)))
+        with self._lock, torch.cuda.stream(self.stream), torch.inference_mode():
+            frames = [self.upload(img, key) for img, key in zip(images, keys)]
+            batch = torch.empty((len(frames), 3, self.imgsz, self.imgsz), device=self.device)
+            for i, fr in enumerate(frames):
+                self._letterbox(fr, batch[i])
+            if getattr(predictor.model, "fp16", False):
+                batch = batch.half()
+            predictor.args.conf = conf
+            predictor.args.classes = classes
+            # shape-only stand-ins for the original images: scale_boxes / Results only read .shape
+            shells = [np.broadcast_to(np.zeros((1, 1, 3), dtype=np.uint8), img.shape) for img in images]
+            predictor.batch = ([str(k) for k in keys],)
+            preds = predictor.inference(batch)
+            results = predictor.postprocess(preds, batch, shells)
+        self.stream.synchronize()
+        for res, fr in zip(results, frames):
+            res.gpu_frame = fr
+        return results
+
+    # ----- drawing -----
+    def _box(self, frame, x1: int, y1: int, x2: int, y2: int, color, t: int = 2):
+        h, w = frame.shape[:2]
+        x1, x2 = max(0, min(w, x1)), max(0, min(w, x2))
+        y1, y2 = max(0, min(h, y1)), max(0, min(h, y2))
+        if x2 <= x1 or y2 <= y1:
+            return
+        c = self._color(color)
+        frame[y1:min(y2, y1 + t), x1:x2] = c
+        frame[max(y1, y2 - t):y2, x1:x2] = c
+        frame[y1:y2, x1:min(x2, x1 + t)] = c
+        frame[y1:y2, max(x1, x2 - t):x2] = c
+
+    def _text(self, frame, text: str, x: int, y: int, color, scale: float, thickness: int):
+        """Blit a cached sprite with its baseline at y (like cv2.putText's origin)."""
+        pix, mask, th = self.sprites.get(text, color, scale, thickness)
+        h, w = frame.shape[:2]
+        y0 = y - th
+        sy, sx = max(0, -y0), max(0, -x)
+        y0, x0 = max(0, y0), max(0, x)
+        ph, pw = min(pix.shape[0] - sy, h - y0), min(pix.shape[1] - sx, w - x0)
+        if ph <= 0 or pw <= 0:
+            return
+        region = frame[y0:y0 + ph, x0:x0 + pw]
+        m = mask[sy:sy + ph, sx:sx + pw, None]
+        region.copy_(torch.where(m, pix[sy:sy + ph, sx:sx + pw], region))
+
+    def draw(self, frame, boxes: List[Tuple[tuple, str, tuple]], error: Optional[str] = None,
+             banner: Optional[Tuple[str, tuple, float]] = None):
+        """
+        In place on the device frame. boxes: [(x1, y1, x2, y2), caption, BGR];
+        banner: (text, tint BGR, alpha) for the HIGH overlay.
+        """
+        with self._lock, torch.cuda.stream(self.stream):
+            if error:
+                self._text(frame, f"YOLO error: {error}", 10, 24, (0, 0, 255), 0.6, 2)
+            for (x1, y1, x2, y2), caption, color in boxes:
+                self._box(frame, int(x1), int(y1), int(x2), int(y2), color)
+                self._text(frame, caption, int(x1), max(0, int(y1) - 8), color, 0.6, 2)
+            if banner is not None:
+                text, tint, alpha = banner
+                blended = frame.float().mul_(1 - alpha).add_(self._color(tint).float() * alpha)
+                frame.copy_(blended.round_())
+                self._text(frame, text, 30, int(0.12 * frame.shape[0]), (255, 255, 255), 1.5, 4)
+
+    # ----- output -----
+    def resize(self, frame, height: int, width: int):
+        x = frame.permute(2, 0, 1).unsqueeze(0).float()
+        x = F.interpolate(x, size=(height, width), mode="area")
+        return x[0].permute(1, 2, 0).round_().to(torch.uint8).contiguous()
+
+    def to_i420(self, frame, key=None, out: Optional[np.ndarray] = None) -> np.ndarray:
+        """Device BGR frame -> host (h*3/2, w) I420 (into `out` when given, e.g. a shm slot)."""
+        with self._lock, torch.cuda.stream(self.stream):
+            h, w = frame.shape[0] & ~1, frame.shape[1] & ~1
+            f = frame[:h, :w].float()
+            y = (f @ self._y).add_(16.0)
+            sub = f.view(h // 2, 2, w // 2, 2, 3).mean(dim=(1, 3))   # 2x2 chroma average
+            u = (sub @ self._u).add_(128.0)
+            v = (sub @ self._v).add_(128.0)
+            yuv = torch.cat((y.reshape(-1), u.reshape(-1), v.reshape(-1))).round_().clamp_(0, 255)
+            stage = self._pinned(("down", key), (h * 3 // 2, w))
+            stage.view(-1).copy_(yuv.to(torch.uint8), non_blocking=True)
+        self.stream.synchronize()
+        host = stage.numpy()
+        if out is not None:
+            out[...] = host
+            return out
+        return host
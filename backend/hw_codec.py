@@ -0,0 +1,319 @@
+# hw_codec.py — optional hardware decode (PyAV hwaccel) and H.264 encode (NVENC/QSV/V4L2 M2M) for aiortc
+import time
+from collections import deque
+from fractions import Fraction
+from typing import Callable, Optional, Tuple
+
+import cv2
+import numpy as np
+
+try:
+    import av
+except Exception:  # pragma: no cover - av ships with aiortc
+    av = None
+
+try:
+    from av.codec.hwaccel import HWAccel, hwdevices_available
+except Exception:
+    HWAccel = None
+    hwdevices_available = None
+
+DECODE_DEVICES = ["cuda", "vaapi", "qsv", "videotoolbox"]                      # "auto" order
+ENCODERS = ["h264_nvenc", "h264_qsv", "h264_v4l2m2m", "h264_videotoolbox"]     # "auto" order
+
+# what aiortc asks of libx264 (profile baseline, tune zerolatency), per hw encoder: constrained
+# baseline to match the 42e01f the SDP offers, no B-frames / lookahead, and an IDR (not just an
+# I-frame) when a PLI makes aiortc send pict_type=I, so a viewer can start decoding from it
+HW_ENCODER_OPTIONS = {
+    "h264_nvenc": {"profile": "baseline", "tune": "ull", "zerolatency": "1", "delay": "0",
+                   "rc-lookahead": "0", "bf": "0", "forced-idr": "1"},
+    "h264_qsv": {"profile": "baseline", "look_ahead": "0", "async_depth": "1", "bf": "0",
+                 "forced_idr": "1"},
+    "h264_v4l2m2m": {"bf": "0"},   # profile / IDR handling are the driver's
+    "h264_videotoolbox": {"profile": "baseline", "realtime": "1", "bf": "0"},
+}
+
+
+# ---------- decode ----------
+class PyAVCapture:
+    """
+    Just enough of cv2.VideoCapture (read/get/set/isOpened/release) over PyAV so
+    CaptureThread can decode RTSP/file sources on a hardware decoder. Frames are
+    downloaded to host memory as BGR for the rest of the pipeline. Packets are
+    demuxed here, so `packet_sink(data, pts_ms, dts_ms, keyframe, ts)` (e.g.
+    ClipRecorder.push_packet) can keep the camera's own bitstream.
+    """
+
+    def __init__(self, source: str, device_type: Optional[str] = None):
+        kwargs = {}
+        if device_type and HWAccel is not None:
+            kwargs["hwaccel"] = HWAccel(device_type=device_type, allow_software_fallback=True)
+        options = {"rtsp_transport": "tcp", "fflags": "nobuffer"} if str(source).startswith("rtsp") else {}
+        self._container = av.open(str(source), options=options, **kwargs)
+        self._stream = self._container.streams.video[0]
+        self._stream.thread_type = "AUTO"
+        self._packets = self._container.demux(self._stream)
+        self._decoded: deque = deque()
+        self.packet_sink: Optional[Callable[[bytes, Optional[int], Optional[int], bool, float], None]] = None
+        is_hw = getattr(self._stream.codec_context, "is_hwaccel", None)
+        if not device_type or is_hw is False:
+            self.decode_path = "software"
+        else:
+            self.decode_path = device_type if is_hw else f"{device_type} (unconfirmed)"
+        self.fps = float(self._stream.average_rate or 0)
+        self.last_pts_sec: Optional[float] = None   # media time of the last frame read
+        self.eof = False                             # demuxer exhausted (file end / stream closed)
+
+    def isOpened(self):
+        return self._container is not None
+
+    def read(self, image=None):
+        if self._container is None:
+            return False, None
+        try:
+            frame = self._next_frame()
+        except StopIteration:
+            self.eof = True
+            return False, None
+        except Exception:
+            return False, None
+        if frame.pts is not None and frame.time_base is not None:
+            self.last_pts_sec = float(frame.pts * frame.time_base)
+        return True, frame.to_ndarray(format="bgr24")
+
+    def _next_frame(self):
+        while not self._decoded:
+            packet = next(self._packets)   # StopIteration at EOF
+            if packet.size and self.packet_sink is not None:
+                self._tap(packet)
+            self._decoded.extend(packet.decode())
+        return self._decoded.popleft()
+
+    def _tap(self, packet):
+        tb = packet.time_base
+        ms = lambda t: int(t * tb * 1000) if t is not None and tb is not None else None
+        try:
+            self.packet_sink(bytes(packet), ms(packet.pts), ms(packet.dts), packet.is_keyframe, time.time())
+        except Exception as e:
+            print(f"[WARN] packet tap failed: {e}")
+            self.packet_sink = None
+
+    def stream_info(self) -> dict:
+        """Codec parameters a muxer needs to write these packets unchanged."""
+        ctx = self._stream.codec_context
+        return {"codec": ctx.name, "width": ctx.width, "height": ctx.height,
+                "extradata": bytes(ctx.extradata) if ctx.extradata else None,
+                "rate": self._stream.average_rate}
+
+    def get(self, prop):
+        if prop == cv2.CAP_PROP_FPS:
+            return self.fps
+        return 0.0
+
+    def set(self, prop, value):
+        return False
+
+    def release(self):
+        if self._container is not None:
+            try: self._container.close()
+            except Exception: pass
+            self._container = None
+
+
+def _pick_decode_device(mode: str) -> Optional[str]:
+    if mode in ("", "none", "software") or HWAccel is None:
+        return None
+    available = set(hwdevices_available()) if hwdevices_available else set()
+    if mode == "auto":
+        return next((d for d in DECODE_DEVICES if d in available), None)
+    return mode if mode in available else None
+
+
+def open_capture(source, mode: str = "none") -> Tuple[object, str]:
+    """
+    Returns (capture, decode_path). Camera indices and mode "none" use OpenCV;
+    otherwise PyAV with the requested (or first available) hw decoder, falling
+    back to OpenCV software decode if PyAV cannot open the source.
+    """
+    mode = (mode or "none").lower()
+    device = None if isinstance(source, int) else _pick_decode_device(mode)
+    if device is not None and av is not None:
+        try:
+            cap = PyAVCapture(source, device)
+            return cap, cap.decode_path
+        except Exception as e:
+            print(f"[WARN] hardware decode ({device}) failed for {source}: {e}; using software")
+    return cv2.VideoCapture(source), "software"
+
+
+# ---------- encode ----------
+_encoder_state = {"requested": "none", "codec": None, "hw_contexts": 0, "sw_fallbacks": 0}
+
+
+def _probe_encoder(name: str) -> bool:
+    """Open the encoder and push one small frame; only then trust it."""
+    try:
+        ctx = av.CodecContext.create(name, "w")
+        ctx.width, ctx.height = 256, 256
+        ctx.pix_fmt = "yuv420p"
+        ctx.time_base = Fraction(1, 30)
+        ctx.framerate = Fraction(30, 1)
+        ctx.options = dict(HW_ENCODER_OPTIONS.get(name, {}))
+        frame = av.VideoFrame.from_ndarray(np.zeros((384, 256), dtype=np.uint8), format="yuv420p")
+        frame.pts = 0
+        list(ctx.encode(frame))
+        list(ctx.encode(None))
+        return True
+    except Exception:
+        return False
+
+
+# aiortc versions whose H264Encoder / Vp8Encoder internals the subclasses below are written against
+AIORTC_TESTED = ((1, 5), (2, 0))   # [min, max)
+_encode_observer: Optional[Callable[[str, float], None]] = None   # set by install_encode_timer
+_registered = {"done": False, "ok": False}
+
+
+def _aiortc_version() -> Tuple[int, ...]:
+    from importlib.metadata import version
+    return tuple(int(p) for p in version("aiortc").split(".")[:2] if p.isdigit())
+
+
+def _open_hw_context(codec: str, frame, bitrate: int, rate: int):
+    """
+    The context aiortc would create for libx264, on `codec`, with that encoder's
+    spelling of the same low-latency options. Opened here, so an option the
+    encoder rejects raises now and the caller can fall back to libx264.
+    """
+    ctx = av.CodecContext.create(codec, "w")
+    ctx.width, ctx.height = frame.width, frame.height
+    ctx.bit_rate = bitrate
+    ctx.pix_fmt = "yuv420p"
+    ctx.framerate = Fraction(rate, 1)
+    ctx.time_base = Fraction(1, rate)
+    ctx.options = dict(HW_ENCODER_OPTIONS.get(codec, {}))
+    ctx.open()
+    return ctx
+
+
+def _encoder_classes():
+    """Subclasses of aiortc's encoders: hw H.264 context (when installed) and per-call timing."""
+    import aiortc.codecs.h264 as h264
+    from aiortc.codecs.vpx import Vp8Encoder
+
+    def timed(codec, call, *args, **kwargs):
+        t0 = time.perf_counter()
+        try:
+            return call(*args, **kwargs)
+        finally:
+            if _encode_observer is not None:
+                _encode_observer(codec, time.perf_counter() - t0)
+
+    class SurveiLensH264Encoder(h264.H264Encoder):
+        def _encode_frame(self, frame, force_keyframe):
+            hw = _encoder_state["codec"]
+            c = self.codec
+            # same reset rule as the parent, so its own check then finds a matching context
+            if c is not None and (frame.width != c.width or frame.height != c.height
+                                  or abs(self.target_bitrate - c.bit_rate) / c.bit_rate > 0.1):
+                self.buffer_data = b""
+                self.buffer_pts = None
+                self.codec = None
+            if self.codec is None and hw:
+                try:
+                    self.codec = _open_hw_context(hw, frame, self.target_bitrate, h264.MAX_FRAME_RATE)
+                    _encoder_state["hw_contexts"] += 1
+                except Exception as e:
+                    print(f"[WARN] {hw} unavailable for this stream: {e}; using libx264")
+                    _encoder_state["sw_fallbacks"] += 1
+            return super()._encode_frame(frame, force_keyframe)
+
+        def encode(self, *args, **kwargs):
+            return timed("h264", super().encode, *args, **kwargs)
+
+    class SurveiLensVp8Encoder(Vp8Encoder):
+        def encode(self, *args, **kwargs):
+            return timed("vp8", super().encode, *args, **kwargs)
+
+    return {"video/h264": SurveiLensH264Encoder, "video/vp8": SurveiLensVp8Encoder}
+
+
+def _register_encoders() -> bool:
+    """
+    Route aiortc's encoder lookup (rtcrtpsender.get_encoder) to the subclasses
+    above, once. Outside AIORTC_TESTED, or if the lookup is not where it is
+    expected, nothing is touched: stock libx264 / VP8, no encode timing.
+    """
+    if _registered["done"]:
+        return _registered["ok"]
+    _registered["done"] = True
+    try:
+        version = _aiortc_version()
+        lo, hi = AIORTC_TESTED
+        if not lo <= version < hi:
+            raise RuntimeError(f"aiortc {'.'.join(map(str, version))} outside tested "
+                               f"{'.'.join(map(str, lo))}-{'.'.join(map(str, hi))}")
+        import aiortc.rtcrtpsender as rtcrtpsender
+        classes = _encoder_classes()
+        stock = rtcrtpsender.get_encoder
+        if not hasattr(classes["video/h264"], "_encode_frame"):
+            raise RuntimeError("H264Encoder has no _encode_frame")
+
+        def get_encoder(codec):
+            cls = classes.get(codec.mimeType.lower())
+            return cls() if cls is not None else stock(codec)
+
+        rtcrtpsender.get_encoder = get_encoder
+        _registered["ok"] = True
+    except Exception as e:
+        print(f"[WARN] custom aiortc encoders not installed ({e}); stock encoders, no hw encode / encode timing")
+    return _registered["ok"]
+
+
+def install_hw_encoder(mode: str = "none") -> Optional[str]:
+    """
+    Make aiortc's H.264 encoder open `mode` (or the first working hw encoder
+    for "auto") instead of libx264. Falls back to libx264 per stream if the hw
+    encoder cannot be created. Returns the active hw codec name or None.
+    """
+    mode = (mode or "none").lower()
+    _encoder_state["requested"] = mode
+    if mode in ("", "none", "software") or av is None:
+        return None
+    candidates = ENCODERS if mode == "auto" else [mode]
+    codec = next((c for c in candidates if _probe_encoder(c)), None)
+    if codec is None:
+        print(f"[WARN] no hardware H.264 encoder available for {mode!r}; using libx264")
+        return None
+    if not _register_encoders():
+        return None
+    _encoder_state["codec"] = codec
+    print(f"[INFO] hardware H.264 encode: {codec}")
+    return codec
+
+
+def prefer_h264(pc, sender):
+    """Put H.264 first in the offer for `sender` so viewers actually use the hw encoder."""
+    from aiortc.rtcrtpsender import RTCRtpSender
+    caps = RTCRtpSender.getCapabilities("video")
+    prefs = [c for c in caps.codecs if c.mimeType == "video/H264"] + \
+            [c for c in caps.codecs if c.mimeType != "video/H264"]
+    for t in pc.getTransceivers():
+        if t.sender is sender:
+            t.setCodecPreferences(prefs)
+
+
+def encoder_status():
+    return {
+        "requested": _encoder_state["requested"],
+        "active": _encoder_state["codec"] or "software",
+        "hw_contexts": _encoder_state["hw_contexts"],
+        "sw_fallbacks": _encoder_state["sw_fallbacks"],
+    }
+
+
+def install_encode_timer(observe):
+    """Time every aiortc encoder call: observe(codec, seconds) (runs on aiortc's executor)."""
+    global _encode_observer
+    if _register_encoders():
+        _encode_observer = observe
@@ -0,0 +1,211 @@
+# inference_backends.py — selectable YOLO runtimes behind one predict() interface
+import hashlib
+import importlib.util
+import json
+import shutil
+import threading
+import time
+from pathlib import Path
+from typing import Optional
+
+# ultralytics (and torch behind it) is imported on the first load, not at import
+# time, so the server answers /ready while the model thread pays for it
+_YOLO = None
+_import_lock = threading.Lock()
+IMPORT_SEC: Optional[float] = None
+
+
+def ultralytics_available() -> bool:
+    """Cheap check (no import) that ultralytics is installed."""
+    return _YOLO is not None or importlib.util.find_spec("ultralytics") is not None
+
+
+def _yolo():
+    global _YOLO, IMPORT_SEC
+    with _import_lock:
+        if _YOLO is None:
+            t0 = time.time()
+            from ultralytics import YOLO
+            _YOLO, IMPORT_SEC = YOLO, time.time() - t0
+    return _YOLO
+
+# name -> ultralytics export arguments; "torch" runs the .pt weights eagerly
+BACKENDS = {
+    "torch": None,
+    "onnx": {"format": "onnx", "suffix": ".onnx", "dynamic": True},
+    "tensorrt": {"format": "engine", "suffix": ".engine", "half": True, "dynamic": True},
+    "tensorrt-int8": {"format": "engine", "suffix": ".engine", "int8": True, "dynamic": True},
+    "openvino": {"format": "openvino", "suffix": "_openvino_model", "dynamic": True},
+}
+# tried in order for "auto"; the first one that exports and loads wins
+AUTO_ORDER = {"cuda": ["tensorrt", "onnx", "torch"], "cpu": ["openvino", "onnx", "torch"]}
+
+
+def weights_hash(path: str, n: int = 12) -> str:
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1 << 20), b""):
+            h.update(chunk)
+    return h.hexdigest()[:n]
+
+
+def _device_key(device) -> str:
+    if device is None or device == "":
+        return "default"
+    return str(device).replace(":", "").replace(",", "-")
+
+
+def export_cache_path(weights: str, backend: str, imgsz: int, device, batch: int,
+                      digest: Optional[str] = None) -> Path:
+    """Exports live next to the weights, keyed by weights hash + imgsz + device (+ backend/batch)."""
+    w = Path(weights).resolve()
+    spec = BACKENDS[backend]
+    name = f"{w.stem}-{digest or weights_hash(str(w))}-{backend}-{imgsz}-{_device_key(device)}-b{batch}"
+    return w.parent / f"{name}{spec['suffix']}"
+
+
+class InferenceBackend:
+    """A loaded model plus where it came from; `predict` mirrors YOLO.predict."""
+
+    def __init__(self, name: str, model, weights: str, artifact: str, device,
+                 requested: str, load_sec: float, exported: bool):
+        self.name = name
+        self.model = model
+        self.weights = weights
+        self.artifact = artifact
+        self.device = device
+        self.requested = requested
+        self.load_sec = load_sec
+        self.exported = exported   # False when the artifact came from the cache
+        self.warmup_sec: Optional[float] = None
+
+    @property
+    def names(self):
+        return getattr(self.model, "names", {}) or {}
+
+    def predict(self, images, imgsz: int, conf: float, **kwargs):
+        if self.device and self.name != "torch":
+            kwargs.setdefault("device", self.device)
+        return self.model.predict(images, imgsz=imgsz, conf=conf, verbose=False, **kwargs)
+
+    def info(self):
+        return {
+            "backend": self.name,
+            "requested": self.requested,
+            "artifact": self.artifact,
+            "device": self.device,
+            "load_sec": round(self.load_sec, 3),
+            "exported_now": self.exported,
+            "warmup_sec": round(self.warmup_sec, 3) if self.warmup_sec is not None else None,
+        }
+
+
+def _export(weights: str, backend: str, imgsz: int, device, batch: int, int8_data: Optional[str],
+            digest: Optional[str] = None) -> Path:
+    spec = dict(BACKENDS[backend])
+    suffix = spec.pop("suffix")
+    target = export_cache_path(weights, backend, imgsz, device, batch, digest)
+    if target.exists():
+        return target
+    print(f"[INFO] Exporting {weights} -> {backend} (imgsz={imgsz}, device={device}); cached at {target}")
+    kwargs = dict(spec, imgsz=imgsz, batch=batch)
+    if device:
+        kwargs["device"] = device
+    if spec.get("int8") and int8_data:
+        kwargs["data"] = int8_data
+    produced = Path(_yolo()(weights).export(**kwargs))
+    # ultralytics writes next to the weights under the plain stem; move into the keyed name
+    if produced.resolve() != target.resolve():
+        if target.exists():
+            shutil.rmtree(target) if target.is_dir() else target.unlink()
+        shutil.move(str(produced), str(target))
+    if suffix == "_openvino_model" and not target.is_dir():
+        raise RuntimeError(f"OpenVINO export did not produce a model directory: {target}")
+    return target
+
+
+def _auto_choice_path(weights: str, imgsz: int, device, batch: int, digest: Optional[str] = None) -> Path:
+    w = Path(weights).resolve()
+    return w.parent / f"{w.stem}-{digest or weights_hash(str(w))}-auto-{imgsz}-{_device_key(device)}-b{batch}.json"
+
+
+def _cuda_available() -> bool:
+    try:
+        import torch   # already loaded by ultralytics at this point
+        return torch.cuda.is_available()
+    except Exception:
+        return False
+
+
+def _remember_auto(path: Path, name: str):
+    try:
+        tmp = path.with_suffix(".tmp")
+        tmp.write_text(json.dumps({"backend": name}))
+        tmp.replace(path)
+    except OSError as e:
+        print(f"[WARN] Could not record auto backend choice: {e}")
+
+
+def load_backend(weights: str, backend: str = "torch", imgsz: int = 640, device=None,
+                 batch: int = 1, int8_data: Optional[str] = None) -> InferenceBackend:
+    """
+    Loads `weights` on the requested backend, exporting once and reusing the
+    cached artifact afterwards. "auto" picks the fastest backend that works on
+    `device`; any export/load failure falls back to plain PyTorch. The auto
+    winner is recorded next to the weights, so a restart goes straight to it
+    instead of retrying the backends that failed last time.
+    """
+    if not ultralytics_available():
+        raise RuntimeError("ultralytics not installed")
+    YOLO = _yolo()
+    requested = (backend or "torch").lower()
+    choice = None
+    digest = None   # weights hash, read once per load (exports and the auto record are keyed on it)
+    if requested != "torch":
+        try:
+            digest = weights_hash(str(Path(weights).resolve()))
+        except OSError:
+            pass   # e.g. a hub name ultralytics downloads itself; the export paths hash later
+    if requested == "auto":
+        if device is None and _cuda_available():
+            device = "cuda"
+        is_cuda = device is not None and str(device) not in ("cpu", "mps")
+        order = AUTO_ORDER["cuda" if is_cuda else "cpu"]
+        try:
+            choice = _auto_choice_path(weights, imgsz, device, batch, digest)
+            remembered = json.loads(choice.read_text()).get("backend")
+            if remembered in order:
+                order = [remembered] + [n for n in order if n != remembered]
+        except (OSError, ValueError):
+            pass
+    elif requested in BACKENDS:
+        order = [requested] if requested == "torch" else [requested, "torch"]
+    else:
+        raise ValueError(f"Unknown inference backend: {backend!r} (choose from {sorted(BACKENDS)} or auto)")
+
+    last_err = None
+    for name in order:
+        t0 = time.time()
+        try:
+            if name == "torch":
+                model = YOLO(weights)
+                if device:
+                    try:
+                        model.to(device)
+                    except Exception as e:
+                        print(f"[WARN] Could not move model to {device}: {e}")
+                loaded = InferenceBackend(name, model, weights, str(weights), device,
+                                          requested, time.time() - t0, exported=False)
+            else:
+                cached = export_cache_path(weights, name, imgsz, device, batch, digest).exists()
+                artifact = _export(weights, name, imgsz, device, batch, int8_data, digest)
+                model = YOLO(str(artifact), task="detect")
+                loaded = InferenceBackend(name, model, weights, str(artifact), device,
+                                          requested, time.time() - t0, exported=not cached)
+            if choice is not None and (name != order[0] or not choice.exists()):
+                _remember_auto(choice, name)
+            return loaded
+        except Exception as e:
+            last_err = e
+            print(f"[WARN] Inference backend {name} unavailable: {e}")
+    raise RuntimeError(f"No inference backend could be loaded: {last_err}")
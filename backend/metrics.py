@@ -0,0 +1,169 @@
+# metrics.py — minimal Prometheus text-format metrics (histograms, counters, gauges, rate meters)
+import bisect
+import threading
+import time
+from typing import Callable, Dict, Iterable, List, Optional, Tuple
+
+# seconds; covers sub-ms draw/convert up to multi-second stalls
+STAGE_BUCKETS = (0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5)
+
+LabelKey = Tuple[Tuple[str, str], ...]
+
+
+def _key(labels: Dict[str, object]) -> LabelKey:
+    return tuple(sorted((k, str(v)) for k, v in labels.items()))
+
+
+def _fmt_labels(key: LabelKey, extra: Optional[Tuple[str, str]] = None) -> str:
+    items = list(key) + ([extra] if extra else [])
+    if not items:
+        return ""
+    esc = lambda v: v.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n")
+    return "{" + ",".join(f'{k}="{esc(v)}"' for k, v in items) + "}"
+
+
+def _fmt_value(v: float) -> str:
+    if v == float("inf"):
+        return "+Inf"
+    return repr(float(v)) if isinstance(v, float) else str(v)
+
+
+class Histogram:
+    def __init__(self, name: str, help: str, buckets=STAGE_BUCKETS):
+        self.name = name
+        self.help = help
+        self.buckets = tuple(buckets)
+        self._series: Dict[LabelKey, list] = {}   # key -> [bucket counts..., sum, count]
+        self._lock = threading.Lock()
+
+    def observe(self, value: float, **labels):
+        key = _key(labels)
+        i = bisect.bisect_left(self.buckets, value)
+        with self._lock:
+            s = self._series.get(key)
+            if s is None:
+                s = self._series[key] = [0] * len(self.buckets) + [0.0, 0]
+            if i < len(self.buckets):
+                s[i] += 1
+            s[-2] += value
+            s[-1] += 1
+
+    def render(self) -> List[str]:
+        out = [f"# HELP {self.name} {self.help}", f"# TYPE {self.name} histogram"]
+        with self._lock:
+            series = [(k, list(v)) for k, v in self._series.items()]
+        for key, s in series:
+            cum = 0
+            for bound, n in zip(self.buckets, s):
+                cum += n
+                out.append(f"{self.name}_bucket{_fmt_labels(key, ('le', _fmt_value(bound)))} {cum}")
+            out.append(f"{self.name}_bucket{_fmt_labels(key, ('le', '+Inf'))} {s[-1]}")
+            out.append(f"{self.name}_sum{_fmt_labels(key)} {s[-2]!r}")
+            out.append(f"{self.name}_count{_fmt_labels(key)} {s[-1]}")
+        return out
+
+
+class RateMeter:
+    """Events per second over an exponentially weighted inter-event interval."""
+
+    def __init__(self, alpha: float = 0.1):
+        self.alpha = alpha
+        self._last: Optional[float] = None
+        self._interval: Optional[float] = None
+        self.count = 0
+
+    def tick(self, now: Optional[float] = None):
+        now = time.monotonic() if now is None else now
+        if self._last is not None:
+            dt = now - self._last
+            self._interval = dt if self._interval is None else \
+                (1 - self.alpha) * self._interval + self.alpha * dt
+        self._last = now
+        self.count += 1
+
+    def rate(self, stale_after: float = 2.0) -> float:
+        if self._interval is None or self._interval <= 0:
+            return 0.0
+        if time.monotonic() - self._last > max(stale_after, 2 * self._interval):
+            return 0.0   # stream stalled
+        return 1.0 / self._interval
+
+
+# collectors return [(name, type, help, [(labels dict, value), ...]), ...] at scrape time
+Collector = Callable[[], Iterable[Tuple[str, str, str, List[Tuple[Dict[str, object], float]]]]]
+
+
+class Registry:
+    def __init__(self):
+        self._histograms: List[Histogram] = []
+        self._collectors: List[Collector] = []
+
+    def histogram(self, name: str, help: str, buckets=STAGE_BUCKETS) -> Histogram:
+        h = Histogram(name, help, buckets)
+        self._histograms.append(h)
+        return h
+
+    def collector(self, fn: Collector) -> Collector:
+        self._collectors.append(fn)
+        return fn
+
+    def render(self) -> str:
+        lines: List[str] = []
+        for h in self._histograms:
+            lines.extend(h.render())
+        for fn in self._collectors:
+            try:
+                families = list(fn())
+            except Exception as e:
+                lines.append(f"# collector failed: {type(e).__name__}: {e}")
+                continue
+            for name, kind, help, samples in families:
+                lines.append(f"# HELP {name} {help}")
+                lines.append(f"# TYPE {name} {kind}")
+                for labels, value in samples:
+                    lines.append(f"{name}{_fmt_labels(_key(labels))} {_fmt_value(value)}")
+        return "\n".join(lines) + "\n"
+
+
+def gpu_memory_samples():
+    """(labels, bytes) per CUDA device, only if torch is already loaded (never imports it)."""
+    import sys
+    torch = sys.modules.get("torch")
+    if torch is None:
+        return [], []
+    try:
+        if not torch.cuda.is_available():
+            return [], []
+        n = torch.cuda.device_count()
+        allocated = [({"device": str(i)}, torch.cuda.memory_allocated(i)) for i in range(n)]
+        reserved = [({"device": str(i)}, torch.cuda.memory_reserved(i)) for i in range(n)]
+        return allocated, reserved
+    except Exception:
+        return [], []
+
+
+CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8"
+
+
+def serve(registry: Registry, port: int, host: str = "0.0.0.0"):
+    """Expose `registry` on http://host:port/metrics from a daemon thread (for CLI tools)."""
+    from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+    class Handler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path.split("?")[0] != "/metrics":
+                self.send_error(404)
+                return
+            body = registry.render().encode("utf-8")
+            self.send_response(200)
+            self.send_header("Content-Type", CONTENT_TYPE)
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, *args):
+            pass
+
+    httpd = ThreadingHTTPServer((host, port), Handler)
+    threading.Thread(target=httpd.serve_forever, name="metrics-http", daemon=True).start()
+    return httpd
@@ -0,0 +1,111 @@
+# model_manager.py — background model load + warm-up, swapped in between batches
+import threading
+import time
+from typing import Callable, Optional, Tuple
+
+import numpy as np
+
+
+class ModelManager:
+    """
+    Holds the serving model (`current`, an InferenceBackend) and loads new
+    weights on a background thread: load, run dummy inferences at `imgsz` so
+    CUDA context / cuDNN autotune / lazy init happen there, then replace
+    `current` in one assignment. Callers read `current` once per batch, so a
+    batch never mixes models and the old one keeps serving until the new one
+    is warm. Requests made during a load queue up; only the newest one wins.
+    """
+
+    def __init__(self, load: Callable[[str, str], object], imgsz: int = 640,
+                 warmup_batch: int = 1, warmup_runs: int = 2, conf: float = 0.25):
+        self._load = load            # (weights, backend) -> InferenceBackend
+        self.imgsz = imgsz
+        self.warmup_batch = max(1, warmup_batch)
+        self.warmup_runs = max(1, warmup_runs)
+        self.conf = conf
+        self.current = None
+        self._lock = threading.Lock()
+        self._wanted: Optional[Tuple[str, str]] = None
+        self._thread: Optional[threading.Thread] = None
+        self._swapped = threading.Event()
+        self.loading: Optional[dict] = None
+        self.last_error: Optional[str] = None
+        self.swaps = 0
+
+    @staticmethod
+    def _key(model) -> Optional[Tuple[str, str]]:
+        return (model.weights, model.requested) if model is not None else None
+
+    def request(self, weights: str, backend: str) -> bool:
+        """Ask for (weights, backend); returns False when that is already serving."""
+        key = (weights, backend)
+        with self._lock:
+            self._wanted = key
+            if self._key(self.current) == key:
+                return False
+            if self._thread is None:
+                self._swapped.clear()
+                self._thread = threading.Thread(target=self._run, name="model-load", daemon=True)
+                self._thread.start()
+        return True
+
+    def wait(self, timeout: Optional[float] = None) -> bool:
+        """Block until the pending load swaps in (or nothing is pending)."""
+        with self._lock:
+            if self._thread is None:
+                return self.current is not None
+        return self._swapped.wait(timeout)
+
+    def _warm(self, model):
+        dummy = np.zeros((self.imgsz, self.imgsz, 3), dtype=np.uint8)
+        t0 = time.time()
+        # single frame plus a full batch so dynamic-shape engines build both profiles
+        batches = [[dummy]] + ([[dummy] * self.warmup_batch] if self.warmup_batch > 1 else [])
+        for _ in range(self.warmup_runs):
+            for images in batches:
+                model.predict(images, imgsz=self.imgsz, conf=self.conf)
+        return time.time() - t0
+
+    def _run(self):
+        while True:
+            with self._lock:
+                key = self._wanted
+                if key is None or self._key(self.current) == key:
+                    self.loading = None
+                    self._thread = None
+                    self._swapped.set()
+                    return
+                self.loading = {"weights": key[0], "backend": key[1], "since": time.time()}
+            print(f"[INFO] Loading YOLO weights in background: {key[0]} (backend={key[1]})")
+            try:
+                model = self._load(*key)
+                model.warmup_sec = self._warm(model)
+            except Exception as e:
+                print(f"[WARN] Model load failed for {key[0]} ({key[1]}): {e}; keeping current model")
+                with self._lock:
+                    self.last_error = f"{type(e).__name__}: {e}"
+                    if self._wanted == key:
+                        self.loading = None
+                        self._thread = None
+                        self._swapped.set()
+                        return
+                continue
+            with self._lock:
+                if self._wanted == key:
+                    self.current = model
+                    self.swaps += 1
+                    self.last_error = None
+            print(f"[INFO] Inference backend ready: {model.name} ({model.artifact}), "
+                  f"load {model.load_sec:.2f}s, warm-up {model.warmup_sec:.2f}s")
+
+    def status(self):
+        with self._lock:   # the loader resets `loading` to None under this lock
+            cur, loading = self.current, self.loading
+            swaps, last_error = self.swaps, self.last_error
+        return {
+            "current": cur.info() if cur is not None else None,
+            "loading": dict(loading, elapsed_sec=round(time.time() - loading["since"], 3))
+                       if loading else None,
+            "swaps": swaps,
+            "last_error": last_error,
+        }
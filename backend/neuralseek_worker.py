@@ -0,0 +1,247 @@
+# neuralseek_worker.py — non-blocking NeuralSeek escalation (summarize -> govern) off the frame loop
+import asyncio
+import time
+from typing import Any, Dict, Hashable, List, Optional
+
+import httpx
+
+from ns_test import (NeuralSeekClient, extract_summary, governor_vars,
+                     normalize_governor_result)
+
+
+class CircuitOpen(RuntimeError):
+    pass
+
+
+class AsyncNeuralSeekClient(NeuralSeekClient):
+    """Same configuration as NeuralSeekClient, but one pooled keep-alive httpx client."""
+
+    def __init__(self, max_connections: int = 4, **kwargs):
+        super().__init__(**kwargs)
+        self._http: Optional[httpx.AsyncClient] = None
+        self._max_connections = max_connections
+
+    def _client(self) -> httpx.AsyncClient:
+        if self._http is None:
+            limits = httpx.Limits(max_connections=self._max_connections,
+                                  max_keepalive_connections=self._max_connections)
+            self._http = httpx.AsyncClient(timeout=self.timeout, limits=limits)
+        return self._http
+
+    async def acall_agent(self, agent: str, vars_dict: Optional[Dict[str, Any]] = None,
+                          input_text: Optional[str] = None) -> Dict[str, Any]:
+        if not self.enabled:
+            raise RuntimeError("NeuralSeek not configured (missing endpoint/instance or api key).")
+        payload = {"agent": agent}
+        if vars_dict is not None:
+            payload["vars"] = vars_dict
+        if input_text:
+            payload["input"] = input_text
+        resp = await self._client().post(self._url(), headers=self._headers(), json=payload)
+        resp.raise_for_status()
+        try:
+            return resp.json()
+        except Exception:
+            return {"raw": resp.text}
+
+    async def aclose(self):
+        if self._http is not None:
+            await self._http.aclose()
+            self._http = None
+
+
+class _Endpoint:
+    """Token-bucket rate limit + consecutive-failure circuit breaker for one agent."""
+
+    def __init__(self, rate_per_sec: float, burst: int, failures: int, reset_sec: float):
+        self.rate = rate_per_sec
+        self.burst = max(1, burst)
+        self.tokens = float(self.burst)
+        self.updated = time.monotonic()
+        self.max_failures = failures
+        self.reset_sec = reset_sec
+        self.failures = 0
+        self.opened_at: Optional[float] = None
+        self.probe_at: Optional[float] = None   # half-open: start of the one trial call
+
+    async def acquire(self):
+        if self.opened_at is not None:
+            now = time.monotonic()
+            if now - self.opened_at < self.reset_sec:
+                raise CircuitOpen("circuit open")
+            # half-open: admit a single probe; a probe that never reported is replaced after reset_sec
+            if self.probe_at is not None and now - self.probe_at < self.reset_sec:
+                raise CircuitOpen("circuit half-open, probe in flight")
+            self.probe_at = now
+        while True:
+            now = time.monotonic()
+            self.tokens = min(self.burst, self.tokens + (now - self.updated) * self.rate)
+            self.updated = now
+            if self.tokens >= 1.0:
+                self.tokens -= 1.0
+                return
+            await asyncio.sleep((1.0 - self.tokens) / self.rate)
+
+    def record(self, ok: bool):
+        if ok:
+            self.failures = 0
+            self.opened_at = self.probe_at = None
+            return
+        self.failures += 1
+        if self.probe_at is not None or self.failures >= self.max_failures:
+            self.opened_at = time.monotonic()   # a failed probe re-opens at once
+            self.probe_at = None
+
+    def state(self):
+        circuit = "closed" if self.opened_at is None else "half-open" if self.probe_at is not None else "open"
+        return {"circuit": circuit,
+                "failures": self.failures, "tokens": round(self.tokens, 2)}
+
+
+class EscalationPool:
+    """
+    Bounded asyncio worker pool running Incident_Summarizer -> Governor per
+    incident. Alerts for the same key (camera + labels) arriving while a call
+    is queued or in flight, or within `debounce_sec` after it finished, join
+    that incident instead of starting a new one. The result lands on every
+    joined alert as `neuralseek_async` via store.annotate(); alerts debounced
+    after it finished get the same cached result.
+    """
+
+    def __init__(self, client: AsyncNeuralSeekClient, store, incident_agent: str,
+                 governor_agent: str, policy: dict, workers: int = 4, max_pending: int = 256,
+                 debounce_sec: float = 30.0, rate_per_sec: float = 2.0, burst: int = 4,
+                 breaker_failures: int = 5, breaker_reset_sec: float = 30.0):
+        self.client = client
+        self.store = store
+        self.incident_agent = incident_agent
+        self.governor_agent = governor_agent
+        self.policy = policy
+        self.workers = max(1, workers)
+        self.debounce_sec = debounce_sec
+        self._queue: Optional[asyncio.Queue] = None
+        self._max_pending = max_pending
+        self._open: Dict[Hashable, dict] = {}      # key -> incident (queued or in flight)
+        self._done_at: Dict[Hashable, float] = {}  # key -> monotonic finish time
+        self._results: Dict[Hashable, dict] = {}   # key -> last finished result
+        self._endpoints = {
+            name: _Endpoint(rate_per_sec, burst, breaker_failures, breaker_reset_sec)
+            for name in (incident_agent, governor_agent)
+        }
+        self._loop = None
+        self._tasks: List[asyncio.Task] = []
+        self.stats_counters = {"incidents": 0, "debounced": 0, "dropped": 0,
+                               "succeeded": 0, "failed": 0, "short_circuited": 0}
+
+    # ----- lifecycle (call on the event loop) -----
+    def start(self):
+        self._loop = asyncio.get_running_loop()
+        self._queue = asyncio.Queue(maxsize=self._max_pending)
+        self._tasks = [asyncio.create_task(self._worker()) for _ in range(self.workers)]
+        self.store.listeners.append(self.on_alerts)
+        return self
+
+    async def stop(self):
+        if self.on_alerts in self.store.listeners:
+            self.store.listeners.remove(self.on_alerts)
+        for t in self._tasks:
+            t.cancel()
+        self._tasks = []
+        await self.client.aclose()
+
+    # ----- intake -----
+    def on_alerts(self, records: List[dict]):
+        """AlertStore listener (any thread): escalate committed HIGH alerts."""
+        if self._loop is None:
+            return
+        for rec in records:
+            if str(rec.get("frame_level") or rec.get("severity") or "").upper() == "HIGH":
+                self._loop.call_soon_threadsafe(self._submit, rec)
+
+    def _submit(self, rec: dict):
+        key = (rec.get("camera"), tuple(rec.get("labels") or ()))
+        incident = self._open.get(key)
+        if incident is not None:
+            incident["alert_ids"].append(rec["id"])
+            self.stats_counters["debounced"] += 1
+            return
+        done = self._done_at.get(key)
+        if done is not None and time.monotonic() - done < self.debounce_sec:
+            self.stats_counters["debounced"] += 1
+            asyncio.create_task(self._annotate([rec["id"]], self._results[key]))
+            return
+        incident = {"key": key, "alert_ids": [rec["id"]], "payload": event_payload_for(rec)}
+        try:
+            self._queue.put_nowait(incident)
+        except asyncio.QueueFull:
+            self.stats_counters["dropped"] += 1
+            return
+        self._open[key] = incident
+        self.stats_counters["incidents"] += 1
+
+    # ----- workers -----
+    async def _call(self, agent: str, vars_dict: dict):
+        ep = self._endpoints[agent]
+        await ep.acquire()
+        try:
+            out = await self.client.acall_agent(agent=agent, vars_dict=vars_dict)
+        except Exception:
+            ep.record(False)
+            raise
+        ep.record(True)
+        return out
+
+    async def _escalate(self, payload: dict) -> Dict[str, Any]:
+        summarizer_raw = await self._call(self.incident_agent, payload)
+        summary_text = extract_summary(summarizer_raw)
+        governor_raw = await self._call(self.governor_agent,
+                                        governor_vars(payload, summary_text, self.policy))
+        return normalize_governor_result(summary_text, self.policy, summarizer_raw, governor_raw)
+
+    async def _worker(self):
+        while True:
+            incident = await self._queue.get()
+            t0 = time.time()
+            try:
+                result = await self._escalate(incident["payload"])
+                result["elapsed_sec"] = round(time.time() - t0, 3)
+                self.stats_counters["succeeded"] += 1
+            except CircuitOpen as e:
+                result = {"error": str(e)}
+                self.stats_counters["short_circuited"] += 1
+            except Exception as e:
+                result = {"error": f"{type(e).__name__}: {e}"}
+                self.stats_counters["failed"] += 1
+            finally:
+                self._open.pop(incident["key"], None)
+                self._done_at[incident["key"]] = time.monotonic()
+            self._results[incident["key"]] = result
+            await self._annotate(incident["alert_ids"], result)
+
+    async def _annotate(self, alert_ids: List[int], result: dict):
+        for alert_id in alert_ids:
+            try:
+                await asyncio.to_thread(self.store.annotate, alert_id, {"neuralseek_async": result})
+            except Exception as e:
+                print(f"[WARN] could not attach NeuralSeek result to alert {alert_id}: {e}")
+
+    def stats(self):
+        return dict(self.stats_counters,
+                    pending=self._queue.qsize() if self._queue else 0,
+                    in_flight=len(self._open),
+                    endpoints={name: ep.state() for name, ep in self._endpoints.items()})
+
+
+def event_payload_for(rec: dict) -> Dict[str, Any]:
+    """Alert record -> the event vars build_event_payload() sends in ns_test.py."""
+    return {
+        "people_count": int(rec.get("people_count") or 0),
+        "weapons_detected": list(rec.get("labels") or []),
+        "actions_detected": [],
+        "danger_score": float(rec.get("danger_score") or 1.0),
+        "danger_level": str(rec.get("frame_level") or "high").lower(),
+        "transcript": "",
+        "snapshots_b64": [],
+        "camera": rec.get("camera"),
+        "timestamp": rec.get("timestamp"),
+    }
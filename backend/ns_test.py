@@ -111,11 +111,7 @@ def build_event_payload(args) -> Dict[str, Any]:
     }
 
 
-def run_neuralseek_governor(ns: NeuralSeekClient, event_payload: dict, policy: dict,
-                            incident_agent: str, governor_agent: str) -> Dict[str, Any]:
-    # 1) Incident_Summarizer
-    summarizer_raw = ns.call_agent(agent=incident_agent, vars_dict=event_payload)
-
+def extract_summary(summarizer_raw) -> str:
     # extract summary (common shapes)
     summary_text = None
     if isinstance(summarizer_raw, dict):
@@ -124,13 +120,29 @@ def run_neuralseek_governor(ns: NeuralSeekClient, event_payload: dict, policy: d
             or summarizer_raw.get("output")
     if not summary_text:
         summary_text = "Possible risk detected based on recent frames and transcript."
+    return summary_text
 
-    # 2) Governor
+
+def governor_vars(event_payload: dict, summary_text: str, policy: dict) -> Dict[str, Any]:
     gov_vars = dict(event_payload)
     gov_vars["summary"] = summary_text
     gov_vars["policy"] = policy
-    governor_raw = ns.call_agent(agent=governor_agent, vars_dict=gov_vars)
+    return gov_vars
+
+
+def run_neuralseek_governor(ns: NeuralSeekClient, event_payload: dict, policy: dict,
+                            incident_agent: str, governor_agent: str) -> Dict[str, Any]:
+    # 1) Incident_Summarizer
+    summarizer_raw = ns.call_agent(agent=incident_agent, vars_dict=event_payload)
+    summary_text = extract_summary(summarizer_raw)
+
+    # 2) Governor
+    governor_raw = ns.call_agent(agent=governor_agent,
+                                 vars_dict=governor_vars(event_payload, summary_text, policy))
+    return normalize_governor_result(summary_text, policy, summarizer_raw, governor_raw)
+
 
+def normalize_governor_result(summary_text: str, policy: dict, summarizer_raw, governor_raw) -> Dict[str, Any]:
     # normalize result
     ns_body = governor_raw.get("neuralseek") if isinstance(governor_raw, dict) else None
     if not ns_body and isinstance(governor_raw, dict):
@@ -0,0 +1,220 @@
+# rules.py — per-camera label / danger rules compiled to class-id lookup tables
+import json
+import os
+import threading
+from pathlib import Path
+from typing import Dict, List, Optional
+
+import numpy as np
+
+LEVELS = ("LOW", "MEDIUM", "HIGH")
+LEVEL_INDEX = {lvl: i for i, lvl in enumerate(LEVELS)}
+
+DEFAULT_RULES = {
+    "levels": {
+        "HIGH": ["knife", "gun", "pistol", "rifle", "revolver", "firearm"],
+        "MEDIUM": ["scissors"],
+    },
+    "colors": {"LOW": [60, 180, 75], "MEDIUM": [0, 215, 255], "HIGH": [0, 0, 255]},   # BGR
+    "track": None,   # class names to keep; None = every class
+}
+
+# model spellings folded onto the names the rules / features use
+ALIASES = {"motorcycle": "motorbike"}
+
+
+def canonical(s: str) -> str:
+    n = str(s).strip().lower()
+    return ALIASES.get(n, n)
+
+
+class CompiledRules:
+    """One RuleSet against one model's `names`: everything the hot path needs, by class id."""
+
+    def __init__(self, labels: List[str], keys: List[str], level, colors, keep, keep_unknown: bool,
+                 level_colors):
+        self.labels = labels          # model's own label per class id
+        self.keys = keys              # canonical names (what rules matched on)
+        self.level = level            # int8 [n] index into LEVELS
+        self.colors = colors          # list of BGR tuples per class id
+        self.keep = keep              # bool [n]
+        self.keep_unknown = keep_unknown
+        self.level_colors = level_colors   # BGR per LEVELS index
+        self.size = len(labels)
+        ids = np.flatnonzero(keep)
+        # classes= for predict(); None when everything is kept anyway
+        self.class_ids: Optional[List[int]] = None if keep_unknown or keep.all() else ids.tolist()
+
+
+class RuleSet:
+    """
+    Validated rules for one camera. `levels` maps HIGH / MEDIUM to class
+    names (anything else is LOW), `colors` gives the BGR box colour per
+    level; both are merged per level onto DEFAULT_RULES, so a level left
+    out keeps its defaults (give it [] to empty it). `track` (optional)
+    limits which classes are kept at all; classes with a level above LOW
+    are always kept. Immutable: a change builds a new RuleSet, so compiled
+    tables never go stale.
+    """
+
+    def __init__(self, data: Optional[dict] = None):
+        data = dict(DEFAULT_RULES if data is None else data)
+        given = data.get("levels") or {}
+        if not isinstance(given, dict):
+            raise ValueError("levels must map HIGH/MEDIUM to label lists")
+        self.by_name: Dict[str, int] = {}
+        for lvl, names in given.items():
+            lvl = str(lvl).upper()
+            if lvl not in LEVEL_INDEX:
+                raise ValueError(f"unknown level {lvl!r} (use {', '.join(LEVELS)})")
+            for n in names or ():
+                key = canonical(n)
+                self.by_name[key] = max(self.by_name.get(key, 0), LEVEL_INDEX[lvl])
+        # levels not given keep their default labels, unless a given level already names them
+        explicit = set(self.by_name)
+        for lvl, names in DEFAULT_RULES["levels"].items():
+            if any(str(k).upper() == lvl for k in given):
+                continue
+            for n in names:
+                key = canonical(n)
+                if key not in explicit:
+                    self.by_name[key] = max(self.by_name.get(key, 0), LEVEL_INDEX[lvl])
+        colors = dict(DEFAULT_RULES["colors"])
+        for lvl, bgr in (data.get("colors") or {}).items():
+            lvl = str(lvl).upper()
+            if lvl not in LEVEL_INDEX or len(bgr) != 3:
+                raise ValueError(f"colors.{lvl} must be [b, g, r] for a known level")
+            colors[lvl] = [int(max(0, min(255, c))) for c in bgr]
+        self.level_colors = tuple(tuple(colors[lvl]) for lvl in LEVELS)
+        track = data.get("track")
+        self.track = None if track is None else {canonical(n) for n in track}
+        self.data = {"levels": {lvl: sorted(n for n, i in self.by_name.items() if i == LEVEL_INDEX[lvl])
+                                for lvl in ("HIGH", "MEDIUM")},
+                     "colors": {lvl: list(c) for lvl, c in zip(LEVELS, self.level_colors)},
+                     "track": sorted(self.track) if self.track is not None else None}
+        self._compiled: Dict[int, tuple] = {}
+        self._lock = threading.Lock()
+
+    def compile(self, names) -> CompiledRules:
+        """Tables for a model's `names` (dict or list), built once per names object."""
+        entry = self._compiled.get(id(names))
+        if entry is not None and entry[0] is names:
+            return entry[1]
+        items = names.items() if isinstance(names, dict) else enumerate(names or ())
+        items = {int(k): str(v) for k, v in items}
+        size = (max(items) + 1) if items else 0
+        labels = [items.get(i, str(i)) for i in range(size)]
+        keys = [canonical(l) for l in labels]
+        level = np.array([self.by_name.get(k, 0) for k in keys], dtype=np.int8)
+        keep = np.array([self.track is None or k in self.track for k in keys], dtype=bool) | (level > 0)
+        colors = [self.level_colors[int(l)] for l in level]
+        table = CompiledRules(labels, keys, level, colors, keep, keep_unknown=self.track is None,
+                              level_colors=self.level_colors)
+        with self._lock:
+            self._compiled[id(names)] = (names, table)
+        return table
+
+
+class RuleBook:
+    """
+    Default RuleSet plus per-camera overrides, persisted to `path` as JSON.
+    Readers just take the current RuleSet object; updates swap in a new one.
+    """
+
+    def __init__(self, path: Optional[str] = None):
+        self.path = Path(path) if path else None
+        self.default = RuleSet()
+        self.cameras: Dict[str, RuleSet] = {}
+        self.version = 0
+        self._lock = threading.Lock()
+        if self.path is not None and self.path.exists():
+            try:
+                self.load_dict(json.loads(self.path.read_text(encoding="utf-8")), save=False)
+            except Exception as e:
+                print(f"[WARN] ignoring rules file {self.path}: {e}")
+
+    def get(self, cam_id: Optional[str] = None) -> RuleSet:
+        return self.cameras.get(cam_id, self.default) if cam_id is not None else self.default
+
+    def set(self, cam_id: Optional[str], data: dict) -> RuleSet:
+        rules = RuleSet(data)   # raises ValueError before anything changes
+        with self._lock:
+            if cam_id in (None, "default"):
+                self.default = rules
+            else:
+                self.cameras = dict(self.cameras, **{cam_id: rules})
+            self._changed()
+        return rules
+
+    def delete(self, cam_id: str) -> bool:
+        with self._lock:
+            if cam_id not in self.cameras:
+                return False
+            self.cameras = {c: r for c, r in self.cameras.items() if c != cam_id}
+            self._changed()
+        return True
+
+    def to_dict(self):
+        return {"default": self.default.data,
+                "cameras": {c: r.data for c, r in self.cameras.items()}}
+
+    def load_dict(self, data: dict, save: bool = True):
+        """Replace everything (e.g. rules pushed from a supervisor or coordinator)."""
+        default = RuleSet(data.get("default")) if data.get("default") is not None else RuleSet()
+        cameras = {str(c): RuleSet(d) for c, d in (data.get("cameras") or {}).items()}
+        with self._lock:
+            self.default, self.cameras = default, cameras
+            self._changed(save)
+
+    def _changed(self, save: bool = True):
+        self.version += 1
+        if save and self.path is not None:
+            tmp = self.path.with_suffix(".tmp")
+            tmp.write_text(json.dumps(self.to_dict(), indent=2), encoding="utf-8")
+            os.replace(tmp, self.path)
+
+    def predict_classes(self, names, cam_ids) -> Optional[List[int]]:
+        """
+        classes= for one predict() over frames of `cam_ids`: union of what they
+        keep. Each camera's ids are cached by RuleSet.compile (per names object);
+        only the union is built per batch, so nothing grows with camera subsets.
+        """
+        if names is None:
+            return None
+        union = set()
+        for cam in set(cam_ids) or {None}:
+            ids = self.get(cam).compile(names).class_ids
+            if ids is None:
+                return None
+            union.update(ids)
+        return sorted(union)
+
+
+class RulesFile:
+    """A rules JSON file re-read when its mtime changes (checked at most every `interval` s)."""
+
+    def __init__(self, path: str, interval: float = 2.0):
+        self.path = Path(path)
+        self.interval = interval
+        self._mtime = None
+        self._checked = 0.0
+
+    def poll(self, now: float) -> Optional[dict]:
+        """New contents when the file changed since the last poll, else None."""
+        if now - self._checked < self.interval:
+            return None
+        self._checked = now
+        try:
+            mtime = self.path.stat().st_mtime
+        except OSError:
+            return None
+        if mtime == self._mtime:
+            return None
+        self._mtime = mtime   # a bad edit is reported once, not every poll
+        try:
+            data = json.loads(self.path.read_text(encoding="utf-8"))
+            RuleSet(data)   # validate before anyone swaps to it
+        except Exception as e:
+            print(f"[WARN] rules file {self.path}: {e}; keeping previous rules")
+            return None
+        return data
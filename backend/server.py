@@ -2,15 +2,20 @@
 import asyncio
 import json
 import os
+import socket
+import threading
 import time
+from concurrent.futures import ThreadPoolExecutor
+from contextlib import contextmanager
+from datetime import datetime
 from pathlib import Path
-from typing import Dict, Optional
+from typing import Dict, List, Optional
 
 import cv2
 import numpy as np
-from fastapi import FastAPI, WebSocket, WebSocketDisconnect
+from fastapi import FastAPI, Header, HTTPException, WebSocket, WebSocketDisconnect
 from fastapi.middleware.cors import CORSMiddleware
-from fastapi.responses import JSONResponse, PlainTextResponse
+from fastapi.responses import FileResponse, JSONResponse, PlainTextResponse
 from pydantic import BaseModel
 
 from fractions import Fraction
@@ -18,21 +23,67 @@ from aiortc import RTCPeerConnection, RTCSessionDescription, MediaStreamTrack
 from aiortc.contrib.media import MediaRelay
 from av import VideoFrame
 
+from alert_store import AlertSink, AlertStore, parse_since
+from abr import LAYERS, BitrateController, LayerCache
+from adaptive import AdaptiveScheduler
+from batching import SKIPPED, BatchScheduler, LatestSlot
+from capture import CaptureThread, FrameRing
+from rules import LEVEL_INDEX, LEVELS, RuleBook
+from clips import ClipRecorder, report_to_sink
+from cluster import Coordinator, NodeAgent, proxy_signaling
+from hw_codec import (encoder_status, install_encode_timer, install_hw_encoder, open_capture,
+                      prefer_h264)
+from metrics import CONTENT_TYPE, RateMeter, Registry, gpu_memory_samples
+from shm_ring import SharedFrameRing
+from supervisor import WorkerSupervisor
+
 # ---------- paths / constants ----------
 BASE_DIR = Path(__file__).resolve().parent
 
 # ---------- YOLO ----------
-try:
-    from ultralytics import YOLO
-except Exception as e:
-    YOLO = None
-    print("[WARN] ultralytics not available; stream will be raw video only.", e)
+# ultralytics / torch load on the model thread, not here (see inference_backends)
+import inference_backends
+from inference_backends import load_backend, ultralytics_available
+from model_manager import ModelManager
+if not ultralytics_available():
+    print("[WARN] ultralytics not installed; stream will be raw video only.")
 
 # ===== settings =====
 WEBRTC_SHARED_SECRET = os.getenv("WEBRTC_SHARED_SECRET", "CHANGE_ME_SHARED_SECRET")
+CLUSTER_TOKEN = os.getenv("CLUSTER_TOKEN", WEBRTC_SHARED_SECRET)
 DEFAULT_SOURCE = int(os.getenv("VIDEO_SOURCE", "0"))     # camera index or RTSP/URL
 IMG_SIZE = int(os.getenv("IMG_SIZE", "640"))
 FPS = int(os.getenv("FPS", "30"))
+FRAME_RING_SLOTS = int(os.getenv("FRAME_RING_SLOTS", "3"))
+MAX_BATCH = int(os.getenv("MAX_BATCH", "16"))                  # frames per predict() call
+BATCH_MAX_WAIT_MS = float(os.getenv("BATCH_MAX_WAIT_MS", "10"))  # wait for stragglers
+# motion-gated inference: full rate on motion/threats, every Nth frame when quiet
+ADAPTIVE_INFERENCE = os.getenv("ADAPTIVE_INFERENCE", "0") == "1"
+ADAPTIVE_MOTION_THRESH = float(os.getenv("ADAPTIVE_MOTION_THRESH", "0.004"))  # changed-pixel fraction
+ADAPTIVE_STABLE_INTERVAL = int(os.getenv("ADAPTIVE_STABLE_INTERVAL", "5"))
+ADAPTIVE_IDLE_INTERVAL = int(os.getenv("ADAPTIVE_IDLE_INTERVAL", "30"))
+# per-viewer resolution/fps ladder from RTCP loss + client-reported stats
+ADAPTIVE_BITRATE = os.getenv("ADAPTIVE_BITRATE", "1") == "1"
+ABR_INTERVAL_SEC = float(os.getenv("ABR_INTERVAL_SEC", "2"))
+# hardware codecs, each falling back to software automatically
+HW_DECODE = os.getenv("HW_DECODE", "none")   # none | auto | cuda | vaapi | qsv | videotoolbox
+HW_ENCODE = os.getenv("HW_ENCODE", "none")   # none | auto | h264_nvenc | h264_qsv | h264_v4l2m2m | ...
+# supervisor mode: >0 runs cameras in that many worker processes (round-robin groups),
+# annotated frames come back through shared memory; this process only signals + encodes
+WORKER_PROCESSES = int(os.getenv("WORKER_PROCESSES", "0"))
+WORKER_DEVICES = [d.strip() for d in os.getenv("WORKER_DEVICES", "").split(",") if d.strip()]  # YOLO_DEVICE per worker
+WORKER_METRICS_PORT = int(os.getenv("WORKER_METRICS_PORT", "0"))   # worker i serves /metrics on port + i
+SHM_RING_SLOTS = int(os.getenv("SHM_RING_SLOTS", "4"))
+SHM_MAX_FRAME = tuple(int(v) for v in os.getenv("SHM_MAX_FRAME", "1920x1080").lower().split("x"))  # WxH
+# cluster: a "coordinator" assigns cameras to nodes by load, proxies /ws to the owning node
+# and stores every node's alerts; a "node" runs whatever cameras it is assigned
+CLUSTER_ROLE = os.getenv("CLUSTER_ROLE", "").lower()   # "" | coordinator | node
+CLUSTER_COORDINATOR_URL = os.getenv("CLUSTER_COORDINATOR_URL", "http://127.0.0.1:8000")
+CLUSTER_NODE_ID = os.getenv("CLUSTER_NODE_ID", socket.gethostname())
+CLUSTER_NODE_URL = os.getenv("CLUSTER_NODE_URL", "http://127.0.0.1:8000")   # how the coordinator reaches this node
+CLUSTER_CAPACITY = int(os.getenv("CLUSTER_CAPACITY", "4"))   # cameras this node takes before overcommit
+CLUSTER_HEARTBEAT_SEC = float(os.getenv("CLUSTER_HEARTBEAT_SEC", "2"))
+CLUSTER_NODE_TIMEOUT = float(os.getenv("CLUSTER_NODE_TIMEOUT", "10"))   # missed heartbeats -> reassign
 
 # resolve defaults relative to this backend module so they still work after repo restructuring
 DEFAULT_WEIGHTS = os.getenv(
@@ -44,38 +95,59 @@ ALERTS_JSONL_PATH = os.getenv(
     "ALERTS_JSONL",
     str((BASE_DIR / "alerts.jsonl").resolve())
 )
+# day-partitioned alert segments; ALERTS_JSONL is read (frozen at its first-seen size) as the oldest
+ALERTS_DIR = os.getenv("ALERTS_DIR", str((BASE_DIR / "alerts").resolve()))
+ALERTS_TAIL_CACHE = int(os.getenv("ALERTS_TAIL_CACHE", "1000"))
 MAX_ALERTS_RETURNED = int(os.getenv("MAX_ALERTS_RETURNED", "250"))
+ALERT_COALESCE_SEC = float(os.getenv("ALERT_COALESCE_SEC", "10"))  # same camera+labels
+ALERT_QUEUE_SIZE = int(os.getenv("ALERT_QUEUE_SIZE", "1024"))
+ALERT_FLUSH_SEC = float(os.getenv("ALERT_FLUSH_SEC", "0.5"))
+# NeuralSeek escalation of HIGH alerts (enabled when NEURALSEEK_* credentials are set)
+NS_WORKERS = int(os.getenv("NEURALSEEK_WORKERS", "4"))
+NS_DEBOUNCE_SEC = float(os.getenv("NEURALSEEK_DEBOUNCE_SEC", "30"))
+NS_RATE_PER_SEC = float(os.getenv("NEURALSEEK_RATE_PER_SEC", "2"))
+# evidence clips: annotated frames kept as encoded packets (the camera's own packets when HW_DECODE
+# opens it through PyAV), muxed to MP4 on HIGH alerts
+CLIP_RECORDING = os.getenv("CLIP_RECORDING", "0") == "1"
+CLIPS_DIR = os.getenv("CLIPS_DIR", str((BASE_DIR / "clips").resolve()))
+CLIP_PREROLL_SEC = float(os.getenv("CLIP_PREROLL_SEC", "10"))
+CLIP_POSTROLL_SEC = float(os.getenv("CLIP_POSTROLL_SEC", "5"))
+CLIP_MAX_SEC = float(os.getenv("CLIP_MAX_SEC", "60"))
+CLIP_FPS = float(os.getenv("CLIP_FPS", "10"))
+CLIP_CODEC = os.getenv("CLIP_CODEC", "libx264")
+CLIP_BITRATE = int(os.getenv("CLIP_BITRATE", "1000000"))
 YOLO_DEVICE = os.getenv("YOLO_DEVICE", None)  # "cpu", "mps", "cuda", or index
+# torch | onnx | tensorrt | tensorrt-int8 | openvino | auto (exports cached next to the weights)
+INFERENCE_BACKEND = os.getenv("INFERENCE_BACKEND", "torch")
+INT8_CALIB_DATA = os.getenv("INT8_CALIB_DATA", None)  # dataset yaml for tensorrt-int8
+PRELOAD_MODEL = os.getenv("PRELOAD_MODEL", "1") == "1"  # load + warm YOLO_WEIGHTS at startup
+START_ON_BOOT = os.getenv("START_ON_BOOT", "0") == "1"   # open VIDEO_SOURCE at startup, alongside the model load
+CAPTURE_OPEN_PARALLEL = int(os.getenv("CAPTURE_OPEN_PARALLEL", "8"))   # cameras / RTSP opened at once
+# letterbox, inference, drawing and I420 conversion on the GPU (torch + CUDA); only boxes come back
+GPU_PIPELINE = os.getenv("GPU_PIPELINE", "0") == "1"
+
+# Danger levels / colours / class filters: per-camera rules (PUT /rules/{camera}),
+# compiled per model into class-id tables so the frame path only indexes arrays
+RULES_PATH = os.getenv("RULES_PATH", str((BASE_DIR / "rules.json").resolve()))
+rulebook = RuleBook(RULES_PATH)
+
+# solid colour planes for overlay_safe, built once per (shape, colour)
+_tint_planes: Dict[tuple, np.ndarray] = {}
 
-# Danger label config
-DANGER_CONFIG = {
-    "HIGH": {"knife", "gun", "pistol", "rifle", "revolver", "firearm"},
-    "MEDIUM": {"scissors"},
-}
-COLORS = {"LOW": (60, 180, 75), "MEDIUM": (0, 215, 255), "HIGH": (0, 0, 255)}
-
-def canonical(s: str) -> str:
-    return s.strip().lower()
-
-def danger_level_for_label(name: str) -> str:
-    n = canonical(name)
-    if n in DANGER_CONFIG["HIGH"]:
-        return "HIGH"
-    if n in DANGER_CONFIG["MEDIUM"]:
-        return "MEDIUM"
-    return "LOW"
-
-def highest_danger_level(levels) -> str:
-    if "HIGH" in levels: return "HIGH"
-    if "MEDIUM" in levels: return "MEDIUM"
-    return "LOW"
+def _tint_plane(shape, color):
+    key = (shape, tuple(color))
+    plane = _tint_planes.get(key)
+    if plane is None:
+        plane = np.empty(shape, dtype=np.uint8); plane[:] = color
+        _tint_planes[key] = plane
+    return plane
 
 def overlay_safe(frame, text, color=(0,0,255), alpha=0.35):
     try:
         if frame.dtype != np.uint8:
             frame = np.clip(frame, 0, 255).astype(np.uint8)
-        overlay = frame.copy(); overlay[:] = color
-        cv2.addWeighted(overlay, alpha, frame, 1 - alpha, 0, frame)
+        # blend in place against a cached plane instead of copying the frame
+        cv2.addWeighted(_tint_plane(frame.shape, color), alpha, frame, 1 - alpha, 0, frame)
         h, _ = frame.shape[:2]
         cv2.putText(frame, text, (30, int(0.12*h)),
                     cv2.FONT_HERSHEY_SIMPLEX, 1.5, (255,255,255), 4, cv2.LINE_AA)
@@ -92,6 +164,19 @@ app.add_middleware(
     allow_headers=["*"],
 )
 relay = MediaRelay()
+alert_store = AlertStore(ALERTS_DIR, legacy_path=ALERTS_JSONL_PATH, tail_size=ALERTS_TAIL_CACHE)
+# frame loops only ever enqueue; the sink thread group-commits to alert_store
+alert_sink = AlertSink(alert_store, max_queue=ALERT_QUEUE_SIZE, flush_sec=ALERT_FLUSH_SEC,
+                       coalesce_sec=ALERT_COALESCE_SEC)
+
+# ---------- metrics ----------
+metrics = Registry()
+# stages: decode (source wait + decode), capture_wait (ring + batch wait), preprocess,
+# inference, postprocess, draw, convert (BGR -> I420), encode_send (per room)
+STAGE_SECONDS = metrics.histogram("surveilens_stage_seconds",
+                                  "Per-frame time spent in each pipeline stage")
+ENCODE_SECONDS = metrics.histogram("surveilens_encode_seconds",
+                                   "aiortc video encoder call duration by codec")
 
 class PipelineState(BaseModel):
     running: bool = False
@@ -99,15 +184,231 @@ class PipelineState(BaseModel):
 
 state = PipelineState()
 
+class SourcePipeline:
+    """
+    One camera: capture thread -> FrameRing -> shared BatchScheduler -> annotated
+    output -> a single producer VideoTrack that every room subscribes to through
+    `relay`, so capture + inference + annotation run once per frame regardless
+    of how many viewers are connected.
+    """
+    def __init__(self, cam_id: str, source):
+        self.cam_id = cam_id
+        self.source = source
+        self.cap, self.decode_path = open_capture(source, HW_DECODE)
+        if not self.cap.isOpened():
+            raise RuntimeError(f"Unable to open video source: {source}")
+        try: self.cap.set(cv2.CAP_PROP_FPS, FPS)
+        except Exception: pass
+        self.ring = FrameRing(FRAME_RING_SLOTS)
+        self.capture = CaptureThread(self.cap, self.ring, name=f"capture-{cam_id}",
+                                     on_read=self._on_read)
+        self.capture_rate = RateMeter()
+        self.infer_rate = RateMeter()
+        self.output_rate = RateMeter()
+        self.output = LatestSlot()   # newest annotated VideoFrame
+        self.layers = LayerCache()   # per-viewer downscaled copies of it
+        self.yuv = None              # reused I420 conversion buffer
+        self.shm: Optional[SharedFrameRing] = None   # worker process: publish here instead
+        self.inferred = 0
+        self.last_detections = []    # carried forward on frames the scheduler skips
+        self.last_table = None       # CompiledRules those detections were made with
+        self.adaptive = AdaptiveScheduler(
+            motion_thresh=ADAPTIVE_MOTION_THRESH, stable_interval=ADAPTIVE_STABLE_INTERVAL,
+            idle_interval=ADAPTIVE_IDLE_INTERVAL,
+        ) if ADAPTIVE_INFERENCE else None
+        self.clips = ClipRecorder(
+            cam_id, CLIPS_DIR, preroll=CLIP_PREROLL_SEC, postroll=CLIP_POSTROLL_SEC,
+            fps=CLIP_FPS, codec=CLIP_CODEC, bitrate=CLIP_BITRATE, max_sec=CLIP_MAX_SEC,
+            on_done=report_to_sink(lambda: alert_sink),
+        ) if CLIP_RECORDING else None
+        if self.clips is not None and hasattr(self.cap, "stream_info"):
+            # PyAV demux: keep the camera's own packets instead of encoding a second stream
+            if self.clips.attach_source(self.cap.stream_info()):
+                self.cap.packet_sink = self.clips.push_packet
+        self.track = None
+
+    def _on_read(self, seconds: float):
+        STAGE_SECONDS.observe(seconds, stage="decode", camera=self.cam_id)
+        self.capture_rate.tick()
+
+    def start(self):
+        self.capture.start()
+        return self
+
+    def get_track(self):
+        if self.track is None or self.track.readyState == "ended":
+            self.track = VideoTrack(self)
+        return self.track
+
+    def stop(self):
+        if self.track is not None:
+            try: self.track.stop()
+            except Exception: pass
+            self.track = None
+        self.capture.stop()
+        self.output.close()
+        if self.clips is not None:
+            self.clips.close()   # writes out a clip still recording
+        try: self.cap.release()
+        except Exception: pass
+
+    def stats(self):
+        return {
+            "source": self.source,
+            "decode": self.decode_path,
+            "stages": {
+                "capture": {"frames": self.capture.frames, "dropped": self.capture.read_errors,
+                            "state": self.capture.state},
+                # stale frames the scheduler skipped in favour of a newer one
+                "inference": {"frames": self.inferred, "dropped": self.ring.dropped},
+            },
+            "adaptive": self.adaptive.stats() if self.adaptive else None,
+            "clips": self.clips.stats() if self.clips else None,
+        }
+
+class RemoteSource:
+    """
+    Signaling-process stand-in for a SourcePipeline running in a worker.
+    Once a viewer asks for it, a reader thread copies each new frame out of
+    the camera's SharedFrameRing into `output`, so VideoTrack / ViewerTrack
+    and the relay work exactly as for a local pipeline.
+    """
+    def __init__(self, cam_id: str, source, ring: SharedFrameRing, worker: int):
+        self.cam_id = cam_id
+        self.source = source
+        self.ring = ring
+        self.worker = worker
+        self.output = LatestSlot()
+        self.layers = LayerCache()
+        self.output_rate = RateMeter()
+        self.track = None
+        self._stop = threading.Event()
+        self._thread: Optional[threading.Thread] = None
+
+    def _run(self):
+        seq = self.ring.latest - 1   # start from the current frame
+        poll = min(0.005, 0.25 / FPS)
+        copy = lambda view: VideoFrame.from_ndarray(view, format="yuv420p")
+        while not self._stop.is_set():
+            got = self.ring.read(seq, copy)
+            if got is None:
+                self._stop.wait(poll)
+                continue
+            seq, frame, ts = got
+            self.output.put((frame, ts))
+            self.output_rate.tick()
+
+    def get_track(self):
+        if self._thread is None:
+            self._thread = threading.Thread(target=self._run, name=f"shm-read-{self.cam_id}", daemon=True)
+            self._thread.start()
+        if self.track is None or self.track.readyState == "ended":
+            self.track = VideoTrack(self)
+        return self.track
+
+    def stop(self):
+        if self.track is not None:
+            try: self.track.stop()
+            except Exception: pass
+            self.track = None
+        self._stop.set()
+        if self._thread is not None:
+            self._thread.join(1.0)
+        self.output.close()
+
 # Global capture / model
-_cap = None
-_cap_lock = asyncio.Lock()
+_sources: Dict[str, SourcePipeline] = {}   # cam id (room name) -> pipeline
+_scheduler: Optional[BatchScheduler] = None
+_remote_sources: Dict[str, RemoteSource] = {}   # supervisor mode
+_supervisor: Optional[WorkerSupervisor] = None
+coordinator = Coordinator(node_timeout=CLUSTER_NODE_TIMEOUT,
+                          state_path=os.path.join(ALERTS_DIR, "cluster-alerts.json")) \
+    if CLUSTER_ROLE == "coordinator" else None
+if coordinator is not None:
+    # node alerts stored before a restart must still dedupe a resent batch
+    coordinator.restore_alerts(lambda after: alert_store.query(None, None, None, None, after))
+node_agent: Optional[NodeAgent] = None
+
+_gpu = None   # GpuPipeline when GPU_PIPELINE is on and CUDA is usable in this process
+_capture_start: Optional[asyncio.Task] = None   # in-flight capture start shared by all callers
+_encoder_probe: Optional[asyncio.Task] = None   # hw encoder probe started at boot
 
-_yolo = None
 _yolo_conf = DEFAULT_CONF
 _yolo_weights = DEFAULT_WEIGHTS
+_backend = INFERENCE_BACKEND
 _source = DEFAULT_SOURCE
 
+# ---------- startup phases ----------
+class StartupPhases:
+    """Wall time of each startup phase for /ready; phases overlap, so these don't add up."""
+    def __init__(self):
+        self.t0 = time.time()
+        self.phases: Dict[str, dict] = {}
+        self._lock = threading.Lock()
+
+    @contextmanager
+    def phase(self, name: str):
+        t0 = time.time()
+        with self._lock:
+            self.phases[name] = {"state": "running", "started_sec": round(t0 - self.t0, 3)}
+        try:
+            yield
+        except Exception as e:
+            self._end(name, t0, "failed", f"{type(e).__name__}: {e}")
+            raise
+        self._end(name, t0, "done")
+
+    def _end(self, name: str, t0: float, result: str, error: Optional[str] = None):
+        with self._lock:
+            entry = dict(self.phases.get(name, {}), state=result, sec=round(time.time() - t0, 3))
+            if error:
+                entry["error"] = error
+            self.phases[name] = entry
+
+    def snapshot(self) -> Dict[str, dict]:
+        now = time.time()
+        with self._lock:
+            out = {n: dict(p) for n, p in self.phases.items()}
+        for p in out.values():
+            if p["state"] == "running":
+                p["sec"] = round(now - self.t0 - p["started_sec"], 3)
+        return out
+
+startup = StartupPhases()
+
+def _model_phases() -> Dict[str, dict]:
+    """import / load / warm-up of the serving model, as ModelManager recorded them."""
+    out = {}
+    if inference_backends.IMPORT_SEC is not None:
+        out["import"] = {"state": "done", "sec": round(inference_backends.IMPORT_SEC, 3)}
+    cur = models.current
+    if cur is not None:
+        out["model_load"] = {"state": "done", "sec": round(cur.load_sec, 3), "backend": cur.name,
+                             "artifact_cached": not cur.exported}
+        out["warmup"] = {"state": "done", "sec": round(cur.warmup_sec or 0.0, 3)}
+    elif models.loading:
+        out["model_load"] = {"state": "running", "sec": round(time.time() - models.loading["since"], 3)}
+    elif models.last_error:
+        out["model_load"] = {"state": "failed", "error": models.last_error}
+    return out
+
+def _readiness():
+    waiting = []
+    if coordinator is None and WORKER_PROCESSES == 0 and ultralytics_available() \
+            and (PRELOAD_MODEL or state.running) and models.current is None:
+        waiting.append("model")
+    if _encoder_probe is None or not _encoder_probe.done():
+        waiting.append("encoder")
+    want_cameras = START_ON_BOOT if CLUSTER_ROLE == "" else bool(node_agent and node_agent.assigned)
+    if want_cameras and not state.running:
+        waiting.append("cameras")
+    return not waiting, {
+        "ready": not waiting,
+        "waiting": waiting,
+        "since_start_sec": round(time.time() - startup.t0, 3),
+        "phases": dict(startup.snapshot(), **_model_phases()),
+    }
+
 # ---------- helpers ----------
 def _status_payload():
     uptime = None
@@ -118,145 +419,632 @@ def _status_payload():
         "uptime_sec": uptime,
         "pid": os.getpid(),
         "args": {"VIDEO_SOURCE": _source, "IMG_SIZE": IMG_SIZE, "FPS": FPS,
-                 "YOLO_WEIGHTS": _yolo_weights, "YOLO_CONF": _yolo_conf},
+                 "YOLO_WEIGHTS": _yolo_weights, "YOLO_CONF": _yolo_conf,
+                 "INFERENCE_BACKEND": _backend,
+                 "MAX_BATCH": MAX_BATCH, "BATCH_MAX_WAIT_MS": BATCH_MAX_WAIT_MS},
+        "inference_backend": models.current.info() if models.current is not None else None,
+        "model": models.status(),
+        "sources": {cam_id: src.stats() for cam_id, src in _sources.items()},
+        "rooms": {room: {"camera": entry.get("camera"), "abr": entry["track"].abr.stats()}
+                  for room, entry in list(rooms.items()) if isinstance(entry.get("track"), ViewerTrack)},
+        "batching": _scheduler.stats() if _scheduler else None,
+        "workers": _supervisor.stats() if _supervisor else None,
+        "cluster": (coordinator.stats() if coordinator else node_agent.stats() if node_agent else None),
+        "alert_sink": alert_sink.stats(),
+        "encode": encoder_status(),
+        "gpu_pipeline": str(_gpu.device) if _gpu is not None else None,
+        "neuralseek": escalations.stats() if escalations else None,
     }
 
 
-def _read_alerts_from_file(limit: int = MAX_ALERTS_RETURNED):
-    if not os.path.exists(ALERTS_JSONL_PATH):
-        return []
-    rows = []
+def _query_alerts(limit: int = MAX_ALERTS_RETURNED, since: Optional[str] = None,
+                  severity: Optional[str] = None, label: Optional[str] = None):
     try:
-        with open(ALERTS_JSONL_PATH, "r", encoding="utf-8") as f:
-            for line in f:
-                line = line.strip()
-                if not line:
-                    continue
-                try:
-                    rows.append(json.loads(line))
-                except Exception:
-                    continue
+        return alert_store.query(limit=limit, since=parse_since(since),
+                                 severity=severity, label=label)
     except Exception as e:
-        print(f"[WARN] Failed to read alerts JSONL: {e}")
+        print(f"[WARN] Failed to query alerts: {e}")
         return []
-    if limit and limit > 0:
-        rows = rows[-limit:]
-    return list(reversed(rows))
 
-def _load_model(weights: str):
-    global _yolo
-    if YOLO is None:
+def _load_backend(weights: str, backend: str):
+    return load_backend(weights, backend, imgsz=IMG_SIZE, device=YOLO_DEVICE,
+                        batch=MAX_BATCH, int8_data=INT8_CALIB_DATA)
+
+# loads + warms in the background; the old model serves until the new one is ready
+models = ModelManager(_load_backend, imgsz=IMG_SIZE, warmup_batch=MAX_BATCH, conf=DEFAULT_CONF)
+
+def _load_model(weights: str, backend: str = INFERENCE_BACKEND):
+    if WORKER_PROCESSES > 0:
+        # workers own the model; they load it on start, running ones swap now
+        if _supervisor is not None:
+            _supervisor.set_model(weights, backend, _yolo_conf)
+        return
+    if not ultralytics_available():
         print("[WARN] ultralytics not installed; skipping model load.")
-        _yolo = None
         return
-    if (_yolo is None) or (weights != _yolo_weights):
-        print(f"[INFO] Loading YOLO weights: {weights}")
-        _yolo = YOLO(weights)
-        if YOLO_DEVICE:
-            try:
-                _yolo.to(YOLO_DEVICE)
-            except Exception as e:
-                print(f"[WARN] Could not move model to {YOLO_DEVICE}: {e}")
+    models.request(weights, backend)
+
+def _infer_batch(images, sources):
+    model = models.current   # read once: a swap lands between batches, never inside one
+    if model is None:
+        return [None] * len(images)
+    # only the classes some camera in this batch keeps (None = all); filtered per camera afterwards
+    classes = rulebook.predict_classes(getattr(model.model, "names", None), [s.cam_id for s in sources])
+    if _gpu is not None:
+        try:
+            return _gpu.infer(model, images, _yolo_conf, classes)
+        except Exception as e:
+            _disable_gpu(e)
+    # one predict() call for the whole batch; ultralytics batches list inputs
+    return model.predict(images, imgsz=IMG_SIZE, conf=_yolo_conf, classes=classes)
+
+def _disable_gpu(error):
+    global _gpu
+    _gpu = None
+    print(f"[WARN] GPU pipeline failed ({type(error).__name__}: {error}); back to CPU pre/post-processing")
+
+def _emit_frame_alert(src: SourcePipeline, ts: float, detections):
+    hits = [d for d in detections if d["level"] == "HIGH"]
+    labels = sorted({d["label"] for d in hits})
+    record = {
+        "timestamp": datetime.fromtimestamp(ts).astimezone().isoformat(),
+        "camera": src.cam_id,
+        "source": str(src.source),
+        "frame_level": "HIGH",
+        "labels": labels,
+        "detections": hits,
+        "people_count": sum(1 for d in detections if d["label"] == "person"),
+    }
+    clip = src.clips.reserve(ts) if src.clips is not None else None
+    if clip:
+        record["clip"] = clip   # on the record before the sink can serialize it
+    # one alert per camera + label set per ALERT_COALESCE_SEC while the object stays in view;
+    # repeats land on it as repeat_count / last_seen
+    if alert_sink.submit(record, key=(src.cam_id, tuple(labels))):
+        if clip:
+            src.clips.trigger(ts, clip, record)
+    elif clip:
+        src.clips.extend(ts)   # still in view: keep the open clip's post-roll going
+
+def _to_video_frame(img, src: Optional[SourcePipeline] = None):
+    """
+    BGR ndarray -> yuv420p VideoFrame via a reused I420 buffer, so the encoder
+    skips its own colour conversion. from_ndarray copies, so the caller's
+    buffers (ring slot, I420 scratch) can be reused right after.
+    """
+    h, w = img.shape[:2]
+    if h % 2 or w % 2:
+        return VideoFrame.from_ndarray(img, format="bgr24")
+    buf = src.yuv if src is not None else None
+    if buf is None or buf.shape != (h * 3 // 2, w):
+        buf = np.empty((h * 3 // 2, w), dtype=np.uint8)
+        if src is not None:
+            src.yuv = buf
+    cv2.cvtColor(img, cv2.COLOR_BGR2YUV_I420, dst=buf)
+    return VideoFrame.from_ndarray(buf, format="yuv420p")
+
+_blank_i420 = None
+
+def _blank_video_frame():
+    global _blank_i420
+    if _blank_i420 is None:
+        _blank_i420 = cv2.cvtColor(np.zeros((480, 640, 3), dtype=np.uint8), cv2.COLOR_BGR2YUV_I420)
+    return VideoFrame.from_ndarray(_blank_i420, format="yuv420p")
+
+def _admit_frame(src: SourcePipeline, img) -> bool:
+    return src.adaptive is None or src.adaptive.should_infer(img)
+
+def _observe_inference(src: SourcePipeline, ts: float, res):
+    cam = src.cam_id
+    if _scheduler is not None and _scheduler.batch_started:
+        STAGE_SECONDS.observe(max(0.0, _scheduler.batch_started - ts), stage="capture_wait", camera=cam)
+    # ultralytics reports per-image ms for its own stages (batch time / batch size)
+    speed = getattr(res, "speed", None) or {}
+    for stage in ("preprocess", "inference"):
+        if speed.get(stage) is not None:
+            STAGE_SECONDS.observe(speed[stage] / 1000.0, stage=stage, camera=cam)
+    return (speed.get("postprocess") or 0.0) / 1000.0
 
-def _start_capture(source):
-    global _cap, state, _source
+def _publish_annotated(src: SourcePipeline, img, ts: float, res):
+    cam = src.cam_id
+    if res is SKIPPED:
+        # no inference this frame: carry the last boxes forward
+        detections, error = src.last_detections, None
+        table = src.last_table
+    else:
+        nms_sec = _observe_inference(src, ts, res)
+        t0 = time.perf_counter()
+        table = rulebook.get(cam).compile(getattr(res, "names", None) or {})
+        src.last_table = table
+        detections, error = _extract_detections(res, table)
+        STAGE_SECONDS.observe(nms_sec + time.perf_counter() - t0, stage="postprocess", camera=cam)
+        src.last_detections = detections
+        src.inferred += 1
+        src.infer_rate.tick()
+        if src.adaptive is not None:
+            src.adaptive.observe(len(detections), any(d["level"] != "LOW" for d in detections))
+    t0 = time.perf_counter()
+    i420 = None
+    if _gpu is not None:
+        # draw + I420 on the device; "draw" covers both, "convert" the host hand-off
+        try:
+            i420, frame_level = _draw_detections_gpu(src, img, res, detections, error, table)
+        except Exception as e:
+            _disable_gpu(e)
+    if i420 is None:
+        img, frame_level = _draw_detections(img, detections, error, table)
+    t1 = time.perf_counter()
+    STAGE_SECONDS.observe(t1 - t0, stage="draw", camera=cam)
+    if src.clips is not None:
+        if i420 is not None:
+            src.clips.push(i420, ts, format="yuv420p")
+        else:
+            src.clips.push(img, ts)
+    if frame_level == "HIGH" and res is not SKIPPED:
+        _emit_frame_alert(src, ts, detections)
+    if src.shm is not None:
+        if i420 is not None:
+            src.shm.commit(ts)   # already converted into the slot
+        else:
+            _write_shared(src, img, ts)
+    else:
+        frame = VideoFrame.from_ndarray(i420, format="yuv420p") if i420 is not None else _to_video_frame(img, src)
+        src.output.put((frame, ts))   # capture time rides along for the track's PTS
+    STAGE_SECONDS.observe(time.perf_counter() - t1, stage="convert", camera=cam)
+    src.output_rate.tick()
+
+_shm_resized = set()   # cameras already warned about
+
+def _write_shared(src: SourcePipeline, img, ts: float):
+    """Worker process: BGR -> I420 straight into the next shared ring slot."""
+    h, w = img.shape[:2]
+    fh, fw = src.shm.fit(h, w)
+    if (fh, fw) != (h & ~1, w & ~1):
+        if src.cam_id not in _shm_resized:
+            print(f"[WARN] {src.cam_id}: {w}x{h} exceeds SHM_MAX_FRAME; sending {fw}x{fh}")
+            _shm_resized.add(src.cam_id)
+        img = cv2.resize(img, (fw, fh), interpolation=cv2.INTER_AREA)
+    slot = src.shm.begin(fh, fw)
+    cv2.cvtColor(img[:fh, :fw], cv2.COLOR_BGR2YUV_I420, dst=slot)
+    src.shm.commit(ts)
+
+def _parse_source(src):
+    # allow "0" as string
+    try:
+        return int(src) if isinstance(src, str) and src.isdigit() else src
+    except Exception:
+        return src
+
+def _camera_specs(sources: List):
+    specs = []
+    for i, entry in enumerate(sources):
+        if isinstance(entry, dict):
+            cam_id = str(entry.get("id") or f"cam-{i + 1}")
+            specs.append((cam_id, _parse_source(entry.get("source", DEFAULT_SOURCE))))
+        else:
+            specs.append((f"cam-{i + 1}", _parse_source(entry)))
+    return specs
+
+def _start_capture(sources: List, max_batch: int = MAX_BATCH, max_wait_ms: float = BATCH_MAX_WAIT_MS,
+                   rings: Optional[Dict[str, SharedFrameRing]] = None):
+    """
+    sources: list of camera index/URL or {"id": room, "source": ...}; ids default to cam-1..N.
+    rings: worker process only, camera id -> ring the supervisor reads frames from.
+    """
+    global state, _source, _scheduler
     if state.running:
         return
-    _source = source
-    _cap = cv2.VideoCapture(source)
-    if not _cap.isOpened():
-        raise RuntimeError(f"Unable to open video source: {source}")
-    try: _cap.set(cv2.CAP_PROP_FPS, FPS)
-    except Exception: pass
+    specs = _camera_specs(sources)
+    if WORKER_PROCESSES > 0:
+        _start_workers(specs, max_batch, max_wait_ms)
+        return
+    _init_gpu()
+    # RTSP opens take a second or more each; open them side by side, keep spec order
+    with ThreadPoolExecutor(max_workers=max(1, min(CAPTURE_OPEN_PARALLEL, len(specs))),
+                            thread_name_prefix="capture-open") as pool:
+        futures = [pool.submit(SourcePipeline, cam_id, src) for cam_id, src in specs]
+    opened, errors = [], []
+    for f in futures:
+        try: opened.append(f.result())
+        except Exception as e: errors.append(e)
+    if errors:
+        for p in opened: p.stop()
+        raise errors[0]
+
+    _source = specs[0][1] if len(specs) == 1 else [src for _, src in specs]
+    _scheduler = BatchScheduler(_infer_batch, _publish_annotated,
+                                max_batch=max_batch, max_wait=max_wait_ms / 1000.0,
+                                admit=_admit_frame)
+    for p in opened:
+        p.shm = (rings or {}).get(p.cam_id)
+        _sources[p.cam_id] = p
+        _scheduler.add(p)
+        p.start()
+    _scheduler.start()
     state.running = True
     state.started_at = time.time()
 
+def _init_gpu():
+    """Only in the process that runs inference (never a supervisor holding aiortc state)."""
+    global _gpu
+    if not GPU_PIPELINE or _gpu is not None:
+        return
+    import gpu_pipeline
+    if not gpu_pipeline.available(YOLO_DEVICE):
+        print(f"[WARN] GPU_PIPELINE=1 but no CUDA device for YOLO_DEVICE={YOLO_DEVICE}; using the CPU path")
+        return
+    try:
+        _gpu = gpu_pipeline.GpuPipeline(YOLO_DEVICE, IMG_SIZE)
+    except Exception as e:
+        print(f"[WARN] GPU pipeline unavailable: {e}")
+
+def _start_workers(specs, max_batch: int, max_wait_ms: float):
+    global state, _source, _supervisor
+    sup = WorkerSupervisor(WORKER_PROCESSES, SHM_RING_SLOTS, SHM_MAX_FRAME,
+                           on_alert=lambda record, key: alert_sink.submit(record, key=key),
+                           on_clip=lambda path, fields: alert_sink.clip_done(path, fields),
+                           devices=WORKER_DEVICES, metrics_port=WORKER_METRICS_PORT)
+    sup.start(specs, _yolo_weights, _backend, _yolo_conf, max_batch, max_wait_ms,
+              rules=rulebook.to_dict())
+    _supervisor = sup
+    _source = specs[0][1] if len(specs) == 1 else [src for _, src in specs]
+    for cam_id, src in specs:
+        _remote_sources[cam_id] = RemoteSource(cam_id, src, sup.rings[cam_id],
+                                               sup.worker_for(cam_id).index)
+    state.running = True
+    state.started_at = time.time()
+    print(f"[INFO] {len(specs)} camera(s) across {len(sup.handles)} worker process(es)")
+
+def _source_for_room(room: str):
+    # rooms named after a camera get that camera; anything else gets the first one
+    pool = _remote_sources if _supervisor is not None else _sources
+    if room in pool:
+        return pool[room]
+    return next(iter(pool.values()), None)
+
 def _stop_capture():
-    global _cap, state
-    if _cap is not None:
-        try: _cap.release()
-        except: pass
-        _cap = None
+    global state, _scheduler, _supervisor
+    for cam_id in list(_remote_sources.keys()):
+        _remote_sources.pop(cam_id).stop()
+    if _supervisor is not None:
+        _supervisor.stop()
+        _supervisor = None
+    if _scheduler is not None:
+        _scheduler.stop()
+        _scheduler = None
+    for cam_id in list(_sources.keys()):
+        _sources.pop(cam_id).stop()
     state.running = False
 
+def _apply_assignment(specs) -> List[str]:
+    """
+    Cluster node: run exactly `specs`, opening / closing only the cameras that
+    changed (supervisor mode restarts its workers instead). Returns the
+    camera ids that stopped here.
+    """
+    want = {cam: _parse_source(src) for cam, src in specs}
+    running = {cam: p.source for cam, p in (_remote_sources or _sources).items()}
+    if want == running:
+        return []
+    gone = [cam for cam in running if cam not in want or want[cam] != running[cam]]
+    if not state.running or _supervisor is not None or _scheduler is None:
+        _stop_capture()
+        if want:
+            _start_capture([{"id": cam, "source": src} for cam, src in want.items()])
+        return gone
+    for cam in gone:
+        p = _sources.pop(cam)
+        _scheduler.remove(p)
+        p.stop()
+    for cam, src in want.items():
+        if cam in _sources:
+            continue
+        try:
+            p = SourcePipeline(cam, src)
+        except Exception as e:
+            print(f"[WARN] cluster: cannot open {cam} ({src}): {e}")
+            continue
+        _sources[cam] = p
+        _scheduler.add(p)
+        p.start()
+        print(f"[INFO] cluster: now serving {cam}")
+    if not _sources:
+        _stop_capture()
+    return gone
+
 # ---------- request bodies ----------
 class StartBody(BaseModel):
     source: Optional[str | int] = None
+    # multi-camera mode: list of index/URL or {"id": room, "source": ...}
+    sources: Optional[List[str | int | dict]] = None
+    max_batch: Optional[int] = None
+    max_wait_ms: Optional[float] = None
     yolo_weights: Optional[str] = None
     conf: Optional[float] = None
+    backend: Optional[str] = None   # see INFERENCE_BACKEND
 
 # ---------- WebRTC video track ----------
+def _extract_detections(res, table=None):
+    """
+    YOLO result (or exception) -> ([{label, cls, conf, bbox, level}], error name or None).
+    `table` is the camera's CompiledRules (default rules when omitted).
+    """
+    if isinstance(res, Exception):
+        return [], type(res).__name__
+    if res is None or res.boxes is None or len(res.boxes) == 0:
+        return [], None
+    try:
+        if table is None:
+            table = rulebook.default.compile(getattr(res, "names", None) or {})
+        # one device->host copy for the whole result: x1 y1 x2 y2 [id] conf cls
+        data = res.boxes.data
+        arr = data.cpu().numpy() if hasattr(data, "cpu") else np.asarray(data)
+        cls = arr[:, -1].astype(np.int64)
+        known = (cls >= 0) & (cls < table.size)
+        keep = known.copy()
+        keep[known] = table.keep[cls[known]]
+        if table.keep_unknown:
+            keep |= ~known
+        if not keep.all():
+            arr, cls, known = arr[keep], cls[keep], known[keep]
+        lvl = np.zeros(len(cls), dtype=np.int8)
+        lvl[known] = table.level[cls[known]]
+        boxes = arr[:, :4].astype(np.int32).tolist()
+        confs = np.round(arr[:, -2].astype(np.float64), 3).tolist()   # float32 would round to 0.8870000243
+        labels = table.labels
+        return [{"label": labels[c] if k else str(c), "cls": c, "conf": cf, "bbox": bb, "level": LEVELS[lv]}
+                for c, k, cf, bb, lv in zip(cls.tolist(), known.tolist(), confs, boxes, lvl.tolist())], None
+    except Exception as e:
+        return [], type(e).__name__
+
+def _box_styles(detections, table=None):
+    """
+    ([(bbox, caption, BGR)], frame_level, level_colors) for drawing, CPU or GPU.
+    Colours / levels come from `table` (CompiledRules) by class id when given.
+    """
+    level_colors = table.level_colors if table is not None else rulebook.default.level_colors
+    top = 0
+    boxes = []
+    for d in detections:
+        c = d.get("cls", -1)
+        if table is not None and 0 <= c < table.size:
+            lv, color = int(table.level[c]), table.colors[c]
+        else:
+            lv = LEVEL_INDEX[d["level"]]
+            color = level_colors[lv]
+        top = max(top, lv)
+        boxes.append((d["bbox"], f"{d['label']} {d['conf']:.2f} [{d['level']}]", color))
+    return boxes, LEVELS[top], level_colors
+
+def _draw_detections(img, detections, error=None, table=None):
+    """Draw boxes (or the inference error) plus the HIGH overlay; returns (img, frame_level)."""
+    boxes, frame_level, level_colors = _box_styles(detections, table)
+    if error:
+        # draw a tiny hint if inference failed (keeps stream alive)
+        cv2.putText(img, f"YOLO error: {error}",
+                    (10, 24), cv2.FONT_HERSHEY_SIMPLEX, 0.6, (0,0,255), 2, cv2.LINE_AA)
+    for (x1, y1, x2, y2), caption, color in boxes:
+        cv2.rectangle(img, (x1, y1), (x2, y2), color, 2)
+        cv2.putText(img, caption, (x1, max(0, y1 - 8)),
+                    cv2.FONT_HERSHEY_SIMPLEX, 0.6, color, 2, cv2.LINE_AA)
+
+    if frame_level == "HIGH":
+        img = overlay_safe(img, "DANGEROUS OBJECT DETECTED", color=level_colors[2], alpha=0.35)
+    return img, frame_level
+
+def _draw_detections_gpu(src: SourcePipeline, img, res, detections, error=None, table=None):
+    """GPU_PIPELINE: draw on the device copy of the frame; returns (I420 host array, frame_level)."""
+    frame = getattr(res, "gpu_frame", None)
+    if frame is None:   # skipped / failed frame: nothing on the device yet
+        frame = _gpu.upload(img, src.cam_id)
+    boxes, frame_level, level_colors = _box_styles(detections, table)
+    banner = ("DANGEROUS OBJECT DETECTED", level_colors[2], 0.35) if frame_level == "HIGH" else None
+    _gpu.draw(frame, boxes, error, banner)
+    if src.shm is not None:
+        h, w = frame.shape[:2]
+        fh, fw = src.shm.fit(h, w)
+        if (fh, fw) != (h & ~1, w & ~1):
+            frame = _gpu.resize(frame, fh, fw)
+        slot = src.shm.begin(fh, fw)
+        return _gpu.to_i420(frame, src.cam_id, out=slot), frame_level
+    return _gpu.to_i420(frame, src.cam_id), frame_level
+
+VIDEO_CLOCK = 90000   # RTP video clock; PTS derive from capture time on this base
+VIDEO_TIME_BASE = Fraction(1, VIDEO_CLOCK)
+
 class VideoTrack(MediaStreamTrack):
+    """
+    Producer track for one SourcePipeline; only ever read by the relay.
+    Paced against a monotonic deadline (at most FPS, no drift from per-frame
+    work) and stamped with the frame's capture time. Woken by the output
+    slot's listener, so no thread is parked per frame and nothing blocks the loop.
+    """
     kind = "video"
-    def __init__(self):
+    def __init__(self, src):   # SourcePipeline or RemoteSource
         super().__init__()
-        self._ts = 0
-        self._time_base = Fraction(1, FPS)
+        self._src = src
+        self._seq = 0
+        self._period = 1.0 / FPS
+        self._deadline: Optional[float] = None
+        self._t0: Optional[float] = None   # capture time that maps to PTS 0
+        self._last_pts = -1
+        self._loop = None
+        self._event: Optional[asyncio.Event] = None
+
+    def _on_output(self):
+        # batch-inference thread: a new annotated frame is ready
+        if self._loop is not None:
+            self._loop.call_soon_threadsafe(self._event.set)
+
+    async def _next_output(self, timeout: float):
+        got = self._src.output.get_newer(self._seq, 0)
+        if got is None:
+            self._event.clear()
+            got = self._src.output.get_newer(self._seq, 0)   # re-check after clear
+        if got is None:
+            try: await asyncio.wait_for(self._event.wait(), timeout)
+            except asyncio.TimeoutError: return None
+            got = self._src.output.get_newer(self._seq, 0)
+        return got
+
+    def _pts_for(self, ts: Optional[float]) -> int:
+        step = int(VIDEO_CLOCK / FPS)
+        if ts is None:
+            pts = self._last_pts + step if self._last_pts >= 0 else 0
+        else:
+            if self._t0 is None:
+                # continue on from any blank frames already sent
+                self._t0 = ts - (self._last_pts + step) / VIDEO_CLOCK if self._last_pts >= 0 else ts
+            pts = int(round((ts - self._t0) * VIDEO_CLOCK))
+            if pts <= self._last_pts:
+                pts = self._last_pts + 1
+        self._last_pts = pts
+        return pts
 
     async def recv(self):
-        await asyncio.sleep(1 / FPS)
-
-        async with _cap_lock:
-            if not state.running or _cap is None:
-                h, w = 480, 640
-                img = np.zeros((h, w, 3), dtype=np.uint8)
-            else:
-                ok, img = _cap.read()
-                if not ok or img is None:
-                    h, w = 480, 640
-                    img = np.zeros((h, w, 3), dtype=np.uint8)
-
-        # ----- YOLO inference & drawing -----
-        hazards = []
-        if _yolo is not None:
-            try:
-                # run fast inference (no verbose)
-                res = _yolo.predict(img, imgsz=IMG_SIZE, conf=_yolo_conf, verbose=False)[0]
-                names = res.names if hasattr(res, "names") else {}
-                if res.boxes is not None and len(res.boxes) > 0:
-                    for box in res.boxes:
-                        cls_id = int(box.cls.item())
-                        label = names.get(cls_id, str(cls_id)) if isinstance(names, dict) else str(cls_id)
-                        conf = float(box.conf.item()) if box.conf is not None else 0.0
-                        x1, y1, x2, y2 = map(int, box.xyxy[0].tolist())
-                        level = danger_level_for_label(label)
-                        hazards.append(level)
-                        color = COLORS[level]
-                        cv2.rectangle(img, (x1, y1), (x2, y2), color, 2)
-                        caption = f"{label} {conf:.2f} [{level}]"
-                        cv2.putText(img, caption, (x1, max(0, y1 - 8)),
-                                    cv2.FONT_HERSHEY_SIMPLEX, 0.6, color, 2, cv2.LINE_AA)
-            except Exception as e:
-                # draw a tiny hint if inference failed (keeps stream alive)
-                cv2.putText(img, f"YOLO error: {type(e).__name__}",
-                            (10, 24), cv2.FONT_HERSHEY_SIMPLEX, 0.6, (0,0,255), 2, cv2.LINE_AA)
-
-        frame_level = highest_danger_level(hazards)
-        if frame_level == "HIGH":
-            img = overlay_safe(img, "DANGEROUS OBJECT DETECTED", color=COLORS["HIGH"], alpha=0.35)
-
-        # convert to AV frame with timestamps
-        frame = VideoFrame.from_ndarray(img, format="bgr24")
-        frame.pts = self._ts
-        frame.time_base = self._time_base
-        self._ts += 1
+        if self._loop is None:
+            self._loop = asyncio.get_running_loop()
+            self._event = asyncio.Event()
+            self._src.output.listeners.append(self._on_output)
+
+        now = time.monotonic()
+        if self._deadline is None or now - self._deadline > self._period:
+            self._deadline = now   # first frame, or fell behind: resync instead of bursting
+        elif self._deadline > now:
+            await asyncio.sleep(self._deadline - now)
+        self._deadline += self._period
+
+        # newest annotated frame from the batch scheduler
+        got = await self._next_output(0.5) if state.running else None
+        if got is None:
+            frame, ts = _blank_video_frame(), None
+        else:
+            (frame, ts), self._seq = got
+
+        frame.pts = self._pts_for(ts)
+        frame.time_base = VIDEO_TIME_BASE
         return frame
 
-# Room -> { "pc": RTCPeerConnection, "track": VideoTrack }
+    def stop(self):
+        super().stop()
+        if self._on_output in self._src.output.listeners:
+            self._src.output.listeners.remove(self._on_output)
+
+class ViewerTrack(MediaStreamTrack):
+    """
+    Per-room wrapper around the relay proxy. Sends the layer its
+    BitrateController picked (downscaled and/or every Nth frame) while the
+    shared pipeline keeps running at full resolution. aiortc's sender calls
+    recv(), encodes, sends the RTP packets, then calls recv() again, so the
+    gap between calls is that room's encode + RTP send time.
+    """
+    kind = "video"
+    def __init__(self, inner, room: str, src):
+        super().__init__()
+        self._inner = inner
+        self.room = room
+        self.cam_id = src.cam_id
+        self._layers = src.layers
+        self.abr = BitrateController(FPS, source_rate=src.output_rate.rate)
+        self.source_height = 0
+        self._handed = None
+        self._n = 0
+        self.rate = RateMeter()
+
+    async def recv(self):
+        if self._handed is not None:
+            STAGE_SECONDS.observe(time.perf_counter() - self._handed, stage="encode_send",
+                                  camera=self.cam_id, room=self.room)
+        scale, every = LAYERS[self.abr.layer]
+        while True:
+            frame = await self._inner.recv()
+            self._n += 1
+            if every == 1 or self._n % every == 0:
+                break
+        self.source_height = frame.height
+        if scale < 1.0:
+            # swscale off the event loop; the cache makes it once per frame per layer
+            frame = await asyncio.to_thread(self._layers.get, frame, scale)
+        self._handed = time.perf_counter()
+        self.rate.tick()
+        return frame
+
+    def stop(self):
+        super().stop()
+        self._inner.stop()
+
+async def _abr_loop(room: str, pc: RTCPeerConnection, sender, track: ViewerTrack):
+    """Feeds RTCP receiver reports into the room's BitrateController every ABR_INTERVAL_SEC."""
+    while rooms.get(room, {}).get("pc") is pc and pc.connectionState not in ("failed", "closed"):
+        await asyncio.sleep(ABR_INTERVAL_SEC)
+        try:
+            report = await sender.getStats()
+            for stat in report.values():
+                if getattr(stat, "type", None) == "remote-inbound-rtp":
+                    track.abr.report_rtcp(getattr(stat, "fractionLost", None),
+                                          getattr(stat, "roundTripTime", None))
+        except Exception:
+            pass
+        before = track.abr.layer
+        if track.abr.tick(track.source_height) != before:
+            scale, _every = LAYERS[track.abr.layer]
+            print(f"[INFO] room {room}: layer {before} -> {track.abr.layer} "
+                  f"(scale {scale}, {track.abr.sent_fps():.0f} fps)")
+
+# Room -> { "pc": RTCPeerConnection, "track": ViewerTrack over the relay proxy, "camera" }
 rooms: Dict[str, dict] = {}
 
-async def create_or_get_publisher(room: str):
-    if not state.running:
-        _start_capture(_source)
+def _start_capture_timed(sources):
+    with startup.phase("cameras"):
+        _start_capture(sources)
 
+async def _ensure_capture():
+    """Start capture once; the boot sequence and concurrent registrations share one start."""
+    global _capture_start
+    if state.running:
+        return
+    if CLUSTER_ROLE == "node":
+        raise RuntimeError("No camera assigned to this node")
+    if _capture_start is None or _capture_start.done():
+        sources = _source if isinstance(_source, list) else [_source]
+        # opening cameras / RTSP blocks; keep it off the event loop
+        _capture_start = asyncio.ensure_future(asyncio.to_thread(_start_capture_timed, sources))
+    await asyncio.shield(_capture_start)
+
+async def create_or_get_publisher(room: str):
+    """
+    Peer connection for `room` with its offer already set. ICE gathering runs
+    (inside setLocalDescription) while the cameras open; the viewer track is
+    attached to the pre-made video sender once the room's source is up.
+    """
     if room in rooms and rooms[room].get("pc"):
         return rooms[room]["pc"]
 
+    capture = asyncio.ensure_future(_ensure_capture())
+    if _encoder_probe is not None:
+        await asyncio.shield(_encoder_probe)   # so prefer_h264 sees the real encoder
     pc = RTCPeerConnection()
-    track = VideoTrack()
-    pc.addTrack(track)
+    sender = pc.addTransceiver("video", direction="sendonly").sender
+    if encoder_status()["active"] != "software":
+        prefer_h264(pc, sender)
+    try:
+        await pc.setLocalDescription(await pc.createOffer())
+        await capture
+        src = _source_for_room(room)
+        if src is None:
+            raise RuntimeError("No video source running")
+    except BaseException:
+        capture.cancel()   # the shared start itself is shielded
+        await pc.close()
+        raise
+
+    # unbuffered: a slow viewer skips to the newest frame instead of queueing
+    track = ViewerTrack(relay.subscribe(src.get_track(), buffered=False), room, src)
+    sender.replaceTrack(track)
 
-    rooms[room] = {"pc": pc, "track": track}
+    rooms[room] = {"pc": pc, "track": track, "camera": src.cam_id}
+    if ADAPTIVE_BITRATE:
+        asyncio.create_task(_abr_loop(room, pc, sender, track))
 
     @pc.on("connectionstatechange")
     async def _on_state():
@@ -270,29 +1058,42 @@ async def create_or_get_publisher(room: str):
 # ---------- REST controls ----------
 @app.post("/pipeline/start")
 def api_pipeline_start(body: StartBody | None = None):
-    global _yolo_weights, _yolo_conf
+    global _yolo_weights, _yolo_conf, _backend
     # parse settings
-    src = body.source if body and (body.source is not None) else _source
-    try:
-        # allow "0" as string
-        src = int(src) if isinstance(src, str) and src.isdigit() else src
-    except Exception:
-        pass
+    if body and body.sources:
+        sources = list(body.sources)
+    else:
+        src = body.source if body and (body.source is not None) else _source
+        sources = src if isinstance(src, list) else [src]
+    max_batch = body.max_batch if body and body.max_batch else MAX_BATCH
+    max_wait_ms = body.max_wait_ms if body and (body.max_wait_ms is not None) else BATCH_MAX_WAIT_MS
 
     if body and body.yolo_weights: _yolo_weights = body.yolo_weights
     if body and (body.conf is not None): _yolo_conf = float(body.conf)
+    if body and body.backend: _backend = body.backend.lower()
 
-    # (re)load model if available
-    _load_model(_yolo_weights)
-    _start_capture(src)
+    if coordinator is not None:
+        # nodes pick up cameras + model settings on their next heartbeat
+        coordinator.set_model(_yolo_weights, _backend, _yolo_conf)
+        coordinator.set_cameras(_camera_specs(sources))
+        state.running, state.started_at = True, time.time()
+        return _status_payload()
+    # (re)load model in the background if the weights/backend changed
+    _load_model(_yolo_weights, _backend)
+    _start_capture(sources, max_batch=max_batch, max_wait_ms=max_wait_ms)
     return _status_payload()
 
 @app.post("/pipeline/stop")
-def api_pipeline_stop():
-    _stop_capture()
+async def api_pipeline_stop():
+    if coordinator is not None:
+        coordinator.set_cameras([])
+        state.running = False
+        return _status_payload()
+    # joins capture/inference threads; keep that off the event loop
+    await asyncio.to_thread(_stop_capture)
     for r in list(rooms.keys()):
         pc = rooms[r]["pc"]
-        try: asyncio.create_task(pc.close())
+        try: await pc.close()
         except: pass
         rooms.pop(r, None)
     return _status_payload()
@@ -301,24 +1102,184 @@ def api_pipeline_stop():
 def api_pipeline_status():
     return _status_payload()
 
+# ---------- cluster ----------
+class HeartbeatBody(BaseModel):
+    node_id: str
+    url: str
+    capacity: int = 1
+    load: dict = {}
+
+class NodeAlertsBody(BaseModel):
+    node_id: str
+    alerts: List[dict] = []
+    patches: List[dict] = []   # {"id": node alert id, "fields"} for alerts already forwarded
+
+def _check_cluster(token: Optional[str]):
+    if coordinator is None:
+        raise HTTPException(404, "not a cluster coordinator")
+    if token != CLUSTER_TOKEN:
+        raise HTTPException(403, "bad cluster token")
+
+@app.post("/cluster/heartbeat")
+def api_cluster_heartbeat(body: HeartbeatBody, x_cluster_token: Optional[str] = Header(None)):
+    _check_cluster(x_cluster_token)
+    return coordinator.heartbeat(body.node_id, body.url, body.capacity, body.load)
+
+@app.post("/cluster/alerts")
+def api_cluster_alerts(body: NodeAlertsBody, x_cluster_token: Optional[str] = Header(None)):
+    _check_cluster(x_cluster_token)
+    # one fsync'd write per batch before the ack; node coalescing already applied
+    ack = coordinator.accept_alerts(body.node_id, body.alerts,
+                                    lambda recs: alert_store.append_many(recs, fsync=True))
+    if body.patches:
+        coordinator.accept_patches(body.node_id, body.patches, alert_store.annotate)
+    return {"ack": ack}
+
+# ---------- rules ----------
+class RulesBody(BaseModel):
+    # both merge per level onto the defaults: an omitted level keeps its default labels / colour
+    levels: Optional[Dict[str, List[str]]] = None   # HIGH / MEDIUM -> labels; anything else is LOW
+    colors: Optional[Dict[str, List[int]]] = None   # level -> [b, g, r]
+    track: Optional[List[str]] = None     # keep (and predict) only these labels; None = all
+
+def _rules_changed():
+    # workers / nodes compile their own tables from the same config
+    if _supervisor is not None:
+        _supervisor.set_rules(rulebook.to_dict())
+    if coordinator is not None:
+        coordinator.rules = rulebook.to_dict()
+
+@app.get("/rules")
+def api_rules():
+    return dict(rulebook.to_dict(), version=rulebook.version)
+
+@app.put("/rules/{camera}")
+def api_set_rules(camera: str, body: RulesBody):
+    """camera "default" replaces the rules every camera without its own uses."""
+    try:
+        rules = rulebook.set(camera, body.dict())
+    except (ValueError, TypeError) as e:
+        raise HTTPException(400, str(e))
+    _rules_changed()
+    return {"camera": camera, "rules": rules.data, "version": rulebook.version}
+
+@app.delete("/rules/{camera}")
+def api_delete_rules(camera: str):
+    if not rulebook.delete(camera):
+        raise HTTPException(404, "no rules for that camera")
+    _rules_changed()
+    return {"camera": camera, "rules": rulebook.get(camera).data, "version": rulebook.version}
+
+def _node_load():
+    cams = list(_sources.values()) + list(_remote_sources.values())
+    return {
+        "cameras": len(cams),
+        "configured_fps": FPS,
+        "output_fps": round(sum(p.output_rate.rate() for p in cams), 2),
+        "infer_fps": round(sum(p.infer_rate.rate() for p in _sources.values()), 2),
+        "rooms": len(rooms),
+        "avg_batch": _scheduler.stats()["avg_batch"] if _scheduler else None,
+        "workers": len(_supervisor.handles) if _supervisor else 0,
+    }
+
+async def _apply_node_assignment(specs, model: dict, rules: Optional[dict] = None):
+    global _yolo_weights, _backend, _yolo_conf
+    if rules is not None and rules != rulebook.to_dict():
+        rulebook.load_dict(rules)
+        _rules_changed()
+    if model.get("conf") is not None:
+        _yolo_conf = float(model["conf"])
+    if model.get("weights") and (model["weights"], model.get("backend") or _backend) != (_yolo_weights, _backend):
+        _yolo_weights, _backend = model["weights"], model.get("backend") or _backend
+        _load_model(_yolo_weights, _backend)
+    gone = await asyncio.to_thread(_apply_assignment, specs)
+    # viewers of cameras moved elsewhere reconnect through the coordinator
+    for room, entry in list(rooms.items()):
+        if entry.get("camera") in gone:
+            try: await entry["pc"].close()
+            except: pass
+            rooms.pop(room, None)
+
+@metrics.collector
+def _pipeline_metrics():
+    fps, frames, dropped, errors, skipped, depth, layers = [], [], [], [], [], [], []
+    for cam, src in list(_sources.items()):
+        for stage, meter in (("capture", src.capture_rate), ("inference", src.infer_rate),
+                             ("output", src.output_rate)):
+            fps.append(({"camera": cam, "stage": stage}, meter.rate()))
+            frames.append(({"camera": cam, "stage": stage}, meter.count))
+        dropped.append(({"camera": cam}, src.ring.dropped))
+        errors.append(({"camera": cam}, src.capture.read_errors))
+        if src.adaptive is not None:
+            skipped.append(({"camera": cam}, src.adaptive.frames - src.adaptive.inferred))
+        depth.append(({"queue": "frame_ring", "camera": cam}, src.ring.unread))
+    for cam, src in list(_remote_sources.items()):
+        fps.append(({"camera": cam, "stage": "output", "worker": src.worker}, src.output_rate.rate()))
+        frames.append(({"camera": cam, "stage": "output", "worker": src.worker}, src.output_rate.count))
+    for room, entry in list(rooms.items()):
+        track = entry.get("track")
+        if isinstance(track, ViewerTrack):
+            fps.append(({"camera": track.cam_id, "room": room, "stage": "sent"}, track.rate.rate()))
+            layers.append(({"camera": track.cam_id, "room": room}, track.abr.layer))
+    sink = alert_sink.stats()
+    depth.append(({"queue": "alert_sink"}, sink["queued"]))
+    depth.append(({"queue": "ws_alerts"}, sum(q.qsize() for q in list(alert_hub.subscribers))))
+    if escalations is not None:
+        depth.append(({"queue": "neuralseek"}, escalations.stats()["pending"]))
+    yield ("surveilens_configured_fps", "gauge", "FPS setting", [({}, FPS)])
+    yield ("surveilens_achieved_fps", "gauge", "Measured frames per second by camera/stage (and room)", fps)
+    yield ("surveilens_frames_total", "counter", "Frames through each stage", frames)
+    yield ("surveilens_dropped_frames_total", "counter", "Frames replaced before inference picked them up", dropped)
+    yield ("surveilens_capture_errors_total", "counter", "Failed capture reads", errors)
+    yield ("surveilens_inference_skipped_total", "counter", "Frames the adaptive scheduler did not infer", skipped)
+    yield ("surveilens_queue_depth", "gauge", "Items waiting in internal queues", depth)
+    yield ("surveilens_alerts_dropped_total", "counter", "Alerts dropped on a full sink queue", [({}, sink["dropped"])])
+    yield ("surveilens_rooms", "gauge", "Connected viewer rooms", [({}, len(rooms))])
+    yield ("surveilens_viewer_layer", "gauge", "Adaptive bitrate layer per room (0 = full quality)", layers)
+    allocated, reserved = gpu_memory_samples()
+    if allocated:
+        yield ("surveilens_gpu_memory_allocated_bytes", "gauge", "torch CUDA memory allocated", allocated)
+        yield ("surveilens_gpu_memory_reserved_bytes", "gauge", "torch CUDA memory reserved", reserved)
+
+@app.get("/metrics")
+def api_metrics():
+    # Prometheus text exposition format
+    return PlainTextResponse(metrics.render(), media_type=CONTENT_TYPE)
+
 
 @app.get("/alerts")
-def api_alerts(limit: int = MAX_ALERTS_RETURNED):
-    data = _read_alerts_from_file(limit)
+def api_alerts(limit: int = MAX_ALERTS_RETURNED, since: Optional[str] = None,
+               severity: Optional[str] = None, label: Optional[str] = None):
+    data = _query_alerts(limit, since, severity, label)
     return JSONResponse(data, headers={"Cache-Control": "no-store"})
 
 
 @app.get("/alerts.jsonl")
-def api_alerts_file(limit: int = MAX_ALERTS_RETURNED):
-    data = _read_alerts_from_file(limit)
+def api_alerts_file(limit: int = MAX_ALERTS_RETURNED, since: Optional[str] = None,
+                    severity: Optional[str] = None, label: Optional[str] = None):
+    data = _query_alerts(limit, since, severity, label)
     body = "\n".join(json.dumps(item, ensure_ascii=False) for item in data)
     return PlainTextResponse(body, headers={"Cache-Control": "no-store"})
 
+@app.get("/clips/{camera}/{name}")
+def api_clip(camera: str, name: str):
+    root = Path(CLIPS_DIR).resolve()
+    path = (root / camera / name).resolve()
+    if root not in path.parents or path.suffix != ".mp4" or not path.is_file():
+        raise HTTPException(404, "clip not found")
+    return FileResponse(str(path), media_type="video/mp4")
+
 # Friendly aliases used by your page
 @app.post("/start")
 def api_start_alias(body: StartBody | None = None): return api_pipeline_start(body)
 @app.post("/stop")
-def api_stop_alias(): return api_pipeline_stop()
+async def api_stop_alias(): return await api_pipeline_stop()
+@app.get("/ready")
+def api_ready():
+    """Readiness probe: 200 once model, encoder and (START_ON_BOOT) cameras are up, else 503."""
+    ready, body = _readiness()
+    return JSONResponse(body, status_code=200 if ready else 503)
+
 @app.get("/status")
 def api_status_alias(): return api_pipeline_status()
 
@@ -335,9 +1296,17 @@ async def ws_signaling(ws: WebSocket):
             await ws.close(); return
         room = (msg.get("room") or "cam-1").strip()
 
+        if coordinator is not None:
+            node = coordinator.owner(room)
+            if node is None:
+                await ws.send_json({"type": "error", "room": room, "message": "no live node serves this room"})
+                return
+            await proxy_signaling(ws, node, reg)   # media then flows viewer <-> node directly
+            return
+
         pc = await create_or_get_publisher(room)
-        offer = await pc.createOffer()
-        await pc.setLocalDescription(offer)
+        if pc.signalingState == "stable":   # existing room pc; a new one already has its offer
+            await pc.setLocalDescription(await pc.createOffer())
         await _await_ice_complete(pc)
         await ws.send_json({"type": "offer", "room": room, "sdp": pc.localDescription.sdp})
 
@@ -348,15 +1317,207 @@ async def ws_signaling(ws: WebSocket):
             if m.get("type") == "answer":
                 answer = RTCSessionDescription(sdp=m["sdp"], type="answer")
                 await pc.setRemoteDescription(answer)
+            elif m.get("type") == "stats":
+                # receiver-side stats from webrtc.js startStats()
+                entry = rooms.get(room)
+                if entry and isinstance(entry.get("track"), ViewerTrack):
+                    entry["track"].abr.report_client(m)
+    except WebSocketDisconnect:
+        pass
+    except Exception:
+        pass
+    finally:
+        try: await ws.close()
+        except: pass
+
+# ---------- alert streaming ----------
+class AlertHub:
+    """
+    Pushes new alerts to every /ws/alerts subscriber. One pump task queries the
+    store once per change (tail cache, ids > cursor) and fans the same
+    serialized message out; the periodic wake also catches external writers.
+    """
+    def __init__(self, store: AlertStore, queue_size: int = 64, poll_sec: float = 2.0):
+        self.store = store
+        self.cursor = store.next_seq - 1
+        self.queue_size = queue_size
+        self.poll_sec = poll_sec
+        self.subscribers = set()
+        self._event: Optional[asyncio.Event] = None
+        self._loop = None
+
+    def start(self):
+        self._loop = asyncio.get_running_loop()
+        self._event = asyncio.Event()
+        self.store.listeners.append(self._on_append)
+        self.store.patch_listeners.append(self._on_patch)
+        return asyncio.create_task(self._pump())
+
+    def _on_append(self, _records):
+        # called from whichever thread wrote the alerts
+        if self._loop is not None and self._event is not None:
+            self._loop.call_soon_threadsafe(self._event.set)
+
+    def _on_patch(self, alert_id: int, fields: dict):
+        # late fields (e.g. neuralseek_async) for an alert clients already have
+        if self._loop is not None:
+            msg = json.dumps({"type": "alert_update", "id": alert_id, "fields": fields},
+                             ensure_ascii=False)
+            self._loop.call_soon_threadsafe(self._broadcast, msg)
+
+    def _broadcast(self, msg: str):
+        for q in list(self.subscribers):
+            try:
+                q.put_nowait(msg)
+            except asyncio.QueueFull:
+                # too slow: drop it, the client reconnects with its cursor and backfills
+                self.subscribers.discard(q)
+                while not q.empty():
+                    q.get_nowait()
+                q.put_nowait(None)
+
+    def subscribe(self) -> asyncio.Queue:
+        q = asyncio.Queue(maxsize=self.queue_size)
+        self.subscribers.add(q)
+        return q
+
+    def unsubscribe(self, q):
+        self.subscribers.discard(q)
+
+    async def _pump(self):
+        while True:
+            try:
+                await asyncio.wait_for(self._event.wait(), timeout=self.poll_sec)
+            except asyncio.TimeoutError:
+                pass
+            self._event.clear()
+            try:
+                fresh = await asyncio.to_thread(self.store.query, None, None, None, None, self.cursor)
+            except Exception as e:
+                print(f"[WARN] alert pump failed: {e}")
+                continue
+            if not fresh:
+                continue
+            fresh.reverse()   # oldest first
+            self.cursor = fresh[-1]["id"]
+            self._broadcast(json.dumps({"type": "alerts", "alerts": fresh, "cursor": self.cursor},
+                                       ensure_ascii=False))
+
+alert_hub = AlertHub(alert_store)
+escalations = None   # EscalationPool, when NeuralSeek is configured
+
+def _build_escalations():
+    try:
+        from neuralseek_worker import AsyncNeuralSeekClient, EscalationPool
+    except Exception as e:
+        print("[WARN] NeuralSeek escalation unavailable:", e)
+        return None
+    client = AsyncNeuralSeekClient(max_connections=NS_WORKERS)
+    if not client.enabled:
+        return None
+    incident_agent = (os.getenv("NEURALSEEK_INCIDENT_AGENT")
+                      or os.getenv("NEURALSEEK_AGENT_INCIDENT_SUMMARIZER") or "Incident_Summarizer")
+    governor_agent = (os.getenv("NEURALSEEK_GOVERNOR_AGENT")
+                      or os.getenv("NEURALSEEK_AGENT_GOVERNOR") or "Governor")
+    policy = {"med_threshold": float(os.getenv("NS_MED_THRESHOLD", "0.4")),
+              "high_threshold": float(os.getenv("NS_HIGH_THRESHOLD", "0.7"))}
+    return EscalationPool(client, alert_store, incident_agent, governor_agent, policy,
+                          workers=NS_WORKERS, debounce_sec=NS_DEBOUNCE_SEC,
+                          rate_per_sec=NS_RATE_PER_SEC)
+
+async def _install_encoders():
+    with startup.phase("encoder"):
+        await asyncio.to_thread(install_hw_encoder, HW_ENCODE)
+    install_encode_timer(lambda codec, sec: ENCODE_SECONDS.observe(sec, codec=codec))
+
+async def _boot_capture():
+    try:
+        await _ensure_capture()
+    except Exception as e:
+        print(f"[WARN] START_ON_BOOT: capture failed to start: {e}")
+
+@app.on_event("startup")
+async def _on_startup():
+    # model load (its own thread), encoder probe and camera open all run at once;
+    # nothing here waits for them, /ready reports when they are done
+    global escalations, node_agent, _encoder_probe
+    if coordinator is not None:
+        coordinator.set_model(_yolo_weights, _backend, _yolo_conf)
+        coordinator.rules = rulebook.to_dict()
+    elif PRELOAD_MODEL:
+        _load_model(_yolo_weights, _backend)
+    _encoder_probe = asyncio.create_task(_install_encoders())
+    if START_ON_BOOT and CLUSTER_ROLE == "":
+        asyncio.create_task(_boot_capture())
+    alert_sink.start()
+    alert_hub.start()
+    escalations = _build_escalations()
+    if escalations is not None:
+        escalations.start()
+    if CLUSTER_ROLE == "node":
+        node_agent = NodeAgent(CLUSTER_COORDINATOR_URL, CLUSTER_NODE_ID, CLUSTER_NODE_URL,
+                               CLUSTER_CAPACITY, CLUSTER_TOKEN, alert_store, _node_load,
+                               _apply_node_assignment, interval=CLUSTER_HEARTBEAT_SEC)
+        node_agent.start()
+
+@app.on_event("shutdown")
+async def _on_shutdown():
+    if node_agent is not None:
+        await node_agent.stop()
+    if _supervisor is not None:
+        await asyncio.to_thread(_stop_capture)
+    await asyncio.to_thread(alert_sink.close)
+    if escalations is not None:
+        await escalations.stop()
+
+@app.websocket("/ws/alerts")
+async def ws_alerts(ws: WebSocket, cursor: Optional[int] = None, limit: int = MAX_ALERTS_RETURNED):
+    """
+    Server-push alert feed. Sends a backfill of alerts with id > cursor (or the
+    newest `limit` when no cursor), then only new alerts as they are stored.
+    Messages: {"type": "alerts", "alerts": [...oldest first], "cursor": last_id}.
+    Clients may receive an alert twice around the backfill; dedupe by id.
+    """
+    await ws.accept()
+    q = alert_hub.subscribe()
+    try:
+        backfill = await asyncio.to_thread(alert_store.query, limit, None, None, None, cursor)
+        backfill.reverse()
+        last = backfill[-1]["id"] if backfill else (cursor if cursor is not None else alert_hub.cursor)
+        await ws.send_text(json.dumps({"type": "alerts", "alerts": backfill, "cursor": last,
+                                       "backfill": True}, ensure_ascii=False))
+        # also watch the socket so a closed client is noticed without waiting for an alert
+        recv = asyncio.create_task(ws.receive_text())
+        try:
+            while True:
+                get = asyncio.create_task(q.get())
+                done, _ = await asyncio.wait({get, recv}, return_when=asyncio.FIRST_COMPLETED)
+                if get in done:
+                    msg = get.result()
+                    if msg is None:
+                        break
+                    await ws.send_text(msg)
+                else:
+                    get.cancel()
+                if recv in done:
+                    recv.result()   # raises on disconnect
+                    recv = asyncio.create_task(ws.receive_text())   # ignore client chatter
+        finally:
+            recv.cancel()
     except WebSocketDisconnect:
         pass
     except Exception:
         pass
     finally:
+        alert_hub.unsubscribe(q)
         try: await ws.close()
         except: pass
 
 async def _await_ice_complete(pc: RTCPeerConnection, timeout=3.0):
+    # aiortc gathers inside setLocalDescription (no trickle ICE), so this is
+    # normally complete already; the listener would never fire then
+    if pc.iceGatheringState == "complete":
+        return
     done = asyncio.get_event_loop().create_future()
     @pc.on("icegatheringstatechange")
     def _on_igs():
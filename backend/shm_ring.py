@@ -0,0 +1,114 @@
+# shm_ring.py — single-writer I420 frame ring in shared memory (no pickling of frames)
+from multiprocessing import shared_memory
+from typing import Callable, Optional, Tuple
+
+import numpy as np
+
+_MAGIC = 0x53524E47        # "SRNG"
+_HEADER = 64               # magic, slots, slot_bytes, latest seq (+ padding)
+
+
+def _align(n: int, to: int = 64) -> int:
+    return (n + to - 1) // to * to
+
+
+class SharedFrameRing:
+    """
+    `slots` fixed-size I420 frames plus a per-slot seqlock in one shared
+    memory segment. The writer (a worker process) converts straight into the
+    next slot and publishes it by bumping `latest`; readers take the newest
+    frame and re-check the slot's seq after copying, so a frame overwritten
+    mid-copy is dropped instead of shown torn. Older frames are never queued.
+    """
+
+    def __init__(self, shm: shared_memory.SharedMemory, owner: bool):
+        self.shm = shm
+        self.owner = owner
+        head = np.ndarray((4,), dtype=np.int64, buffer=shm.buf)
+        if int(head[0]) != _MAGIC:
+            raise ValueError(f"{shm.name} is not a frame ring")
+        self.slots = int(head[1])
+        self.slot_bytes = int(head[2])
+        self._head = head
+        meta_off = _HEADER
+        ts_off = meta_off + _align(self.slots * 3 * 8)
+        data_off = ts_off + _align(self.slots * 8)
+        self._meta = np.ndarray((self.slots, 3), dtype=np.int64, buffer=shm.buf, offset=meta_off)  # seq, h, w
+        self._ts = np.ndarray((self.slots,), dtype=np.float64, buffer=shm.buf, offset=ts_off)
+        self._data = np.ndarray((self.slots, self.slot_bytes), dtype=np.uint8, buffer=shm.buf,
+                                offset=data_off)
+        self._pending: Optional[Tuple[int, int, int, int]] = None   # seq, slot, h, w
+
+    @classmethod
+    def create(cls, slots: int, max_width: int, max_height: int) -> "SharedFrameRing":
+        slots = max(2, slots)
+        slot_bytes = _align(max_width * max_height * 3 // 2)
+        size = _HEADER + _align(slots * 3 * 8) + _align(slots * 8) + slots * slot_bytes
+        shm = shared_memory.SharedMemory(create=True, size=size)
+        head = np.ndarray((4,), dtype=np.int64, buffer=shm.buf)
+        head[:] = (_MAGIC, slots, slot_bytes, 0)
+        return cls(shm, owner=True)
+
+    @classmethod
+    def attach(cls, name: str) -> "SharedFrameRing":
+        return cls(shared_memory.SharedMemory(name=name), owner=False)
+
+    @property
+    def name(self) -> str:
+        return self.shm.name
+
+    @property
+    def latest(self) -> int:
+        return int(self._head[3])
+
+    def fit(self, height: int, width: int) -> Tuple[int, int]:
+        """Largest even (h, w) with the same aspect that fits one slot."""
+        h, w = height & ~1, width & ~1
+        if h * w * 3 // 2 <= self.slot_bytes:
+            return h, w
+        s = (self.slot_bytes / (height * width * 1.5)) ** 0.5
+        return max(2, int(height * s) & ~1), max(2, int(width * s) & ~1)
+
+    # ----- writer -----
+    def begin(self, height: int, width: int) -> Optional[np.ndarray]:
+        """(h * 3/2, w) view of the next slot to write I420 into; None if it doesn't fit."""
+        if height % 2 or width % 2 or height * width * 3 // 2 > self.slot_bytes:
+            return None
+        seq = self.latest + 1
+        i = seq % self.slots
+        self._meta[i, 0] = -1   # readers skip a slot while it is being written
+        self._pending = (seq, i, height, width)
+        return self._data[i, :height * width * 3 // 2].reshape(height * 3 // 2, width)
+
+    def commit(self, ts: float):
+        seq, i, h, w = self._pending
+        self._pending = None
+        self._meta[i, 1] = h
+        self._meta[i, 2] = w
+        self._ts[i] = ts
+        self._meta[i, 0] = seq
+        self._head[3] = seq
+
+    # ----- reader -----
+    def read(self, after: int, copy: Callable[[np.ndarray], object], retries: int = 3):
+        """(seq, copy(view), ts) for the newest frame past `after`, else None."""
+        for _ in range(retries):
+            seq = self.latest
+            if seq <= after or seq == 0:   # 0: nothing written yet
+                return None
+            i = seq % self.slots
+            if int(self._meta[i, 0]) != seq:
+                continue
+            h, w, ts = int(self._meta[i, 1]), int(self._meta[i, 2]), float(self._ts[i])
+            out = copy(self._data[i, :h * w * 3 // 2].reshape(h * 3 // 2, w))
+            if int(self._meta[i, 0]) == seq:
+                return seq, out, ts
+        return None
+
+    def close(self):
+        self._head = self._meta = self._ts = self._data = None
+        try: self.shm.close()
+        except Exception: pass
+        if self.owner:
+            try: self.shm.unlink()
+            except FileNotFoundError: pass
@@ -0,0 +1,329 @@
+# supervisor.py — camera groups in worker processes, annotated frames back over shared memory
+import itertools
+import multiprocessing as mp
+import os
+import queue
+import shutil
+import tempfile
+import threading
+import time
+from typing import Callable, Dict, List, Optional, Tuple
+
+from shm_ring import SharedFrameRing
+
+Spec = Tuple[str, object]   # (camera id, source)
+
+
+# ---------- worker process ----------
+class _ForwardSink:
+    """
+    Stands in for server.alert_sink in a worker; coalescing and storage stay in
+    the parent. Alerts and clip completions share one queue, so a clip's status
+    never overtakes the alert that carries its path.
+    """
+
+    def __init__(self, alerts):
+        self._alerts = alerts
+        self.submitted = 0
+        self.dropped = 0
+
+    def submit(self, record: dict, key=None) -> bool:
+        try:
+            self._alerts.put_nowait(("alert", record, key))
+            self.submitted += 1
+        except queue.Full:
+            self.dropped += 1
+        return True
+
+    def clip_done(self, path: str, fields: dict):
+        try:
+            self._alerts.put(("clip", path, fields), timeout=1.0)   # rare; worth waiting for
+        except queue.Full:
+            self.dropped += 1
+
+    def stats(self):
+        return {"forwarded": self.submitted, "dropped": self.dropped, "queued": 0}
+
+
+def worker_main(index: int, cameras: List[Spec], rings: Dict[str, str], config: dict, conn, alerts):
+    """Entry point of one worker: capture + batch inference + annotation for its cameras."""
+    os.environ.update(config["env"])
+    import server   # reads settings from the environment set above
+
+    server.alert_sink = _ForwardSink(alerts)
+    server._yolo_weights, server._backend = config["weights"], config["backend"]
+    server._yolo_conf = config["conf"]
+    if config.get("metrics_port"):
+        from metrics import serve
+        serve(server.metrics, config["metrics_port"])
+    if config.get("rules") is not None:
+        server.rulebook.load_dict(config["rules"], save=False)
+    attached = {cam: SharedFrameRing.attach(name) for cam, name in rings.items()}
+    try:
+        server._load_model(server._yolo_weights, server._backend)
+        server._start_capture([{"id": cam, "source": src} for cam, src in cameras],
+                              max_batch=config["max_batch"], max_wait_ms=config["max_wait_ms"],
+                              rings=attached)
+    except Exception as e:
+        conn.send(("error", None, f"{type(e).__name__}: {e}"))
+        return
+    conn.send(("ready", None, os.getpid()))
+
+    parent = os.getppid()
+    try:
+        while os.getppid() == parent:   # orphaned: the supervisor died
+            if not conn.poll(1.0):
+                continue
+            kind, call_id, arg = conn.recv()
+            if kind == "stop":
+                break
+            if kind == "stats":
+                conn.send(("stats", call_id, server._status_payload()))
+            elif kind == "model":
+                weights, backend, conf = arg
+                server._yolo_weights, server._backend, server._yolo_conf = weights, backend, conf
+                server._load_model(weights, backend)
+            elif kind == "rules":
+                server.rulebook.load_dict(arg, save=False)
+    except (EOFError, OSError):
+        pass
+    finally:
+        server._stop_capture()
+        for ring in attached.values():
+            ring.close()
+
+
+# ---------- supervisor (signaling process) ----------
+class WorkerHandle:
+    def __init__(self, index: int, cameras: List[Spec], device: Optional[str]):
+        self.index = index
+        self.cameras = cameras
+        self.device = device
+        self.process: Optional[mp.Process] = None
+        self.conn = None
+        self.pid: Optional[int] = None
+        self.lock = threading.Lock()   # one request/reply on the pipe at a time
+        self.starting = False          # (re)spawned, handshake pending: calls return None at once
+        self.spawned_config: dict = {}
+        self.restarts = 0
+        self.started_at = 0.0
+        self.next_restart = 0.0
+        self.error: Optional[str] = None
+
+
+class WorkerSupervisor:
+    """
+    Splits cameras round-robin into `workers` groups, each running the normal
+    capture -> BatchScheduler -> annotate pipeline in its own spawned process,
+    so predict(), cv2 drawing and colour conversion get a GIL per group. Each
+    camera's annotated I420 frames come back through a SharedFrameRing owned
+    here; alerts and clip completions come back over one queue. The signaling
+    process only maps rooms to rings and encodes for its viewers. A worker
+    that dies is started again (with backoff) against the same rings.
+    """
+
+    def __init__(self, workers: int, ring_slots: int, max_size: Tuple[int, int],
+                 on_alert: Callable[[dict, object], None], devices: List[str] = (),
+                 metrics_port: int = 0, ready_timeout: float = 60.0,
+                 on_clip: Optional[Callable[[str, dict], None]] = None):
+        self.workers = max(1, workers)
+        self.ring_slots = ring_slots
+        self.max_size = max_size   # (width, height) of the largest frame a ring holds
+        self.on_alert = on_alert
+        self.on_clip = on_clip
+        self.devices = [d for d in devices if d]
+        self.metrics_port = metrics_port
+        self.ready_timeout = ready_timeout
+        self.rings: Dict[str, SharedFrameRing] = {}
+        self.handles: List[WorkerHandle] = []
+        self._ctx = mp.get_context("spawn")   # never fork a process holding CUDA / aiortc state
+        self._alerts = self._ctx.Queue(maxsize=4096)
+        self._ids = itertools.count(1)
+        self._config: dict = {}
+        self._stop = threading.Event()
+        self._threads: List[threading.Thread] = []
+        self._alerts_dir = tempfile.mkdtemp(prefix="worker-alerts-")
+
+    def start(self, specs: List[Spec], weights: str, backend: str, conf: float,
+              max_batch: int, max_wait_ms: float, rules: Optional[dict] = None):
+        groups = [specs[i::self.workers] for i in range(min(self.workers, len(specs)))]
+        w, h = self.max_size
+        # workers import server.py: keep them off the real alert store and out of supervisor mode
+        env = {"WORKER_PROCESSES": "0", "PRELOAD_MODEL": "0",
+               "ALERTS_DIR": self._alerts_dir,
+               "ALERTS_JSONL": os.path.join(self._alerts_dir, "alerts.jsonl")}
+        self._config = {"env": env, "weights": weights, "backend": backend, "conf": conf,
+                        "max_batch": max_batch, "max_wait_ms": max_wait_ms, "rules": rules}
+        try:
+            for cam, _ in specs:
+                self.rings[cam] = SharedFrameRing.create(self.ring_slots, w, h)
+            for i, cams in enumerate(groups):
+                device = self.devices[i % len(self.devices)] if self.devices else None
+                handle = WorkerHandle(i, cams, device)
+                self.handles.append(handle)
+                self._spawn(handle)
+            for handle in self.handles:
+                if not self._handshake(handle, self.ready_timeout):
+                    raise RuntimeError(f"worker {handle.index} failed to start: {handle.error}")
+        except Exception:
+            self.stop()
+            raise
+        self._stop.clear()
+        for target, name in ((self._monitor, "worker-monitor"), (self._drain_alerts, "worker-alerts")):
+            t = threading.Thread(target=target, name=name, daemon=True)
+            t.start()
+            self._threads.append(t)
+        return self
+
+    def _spawn(self, handle: WorkerHandle):
+        config = dict(self._config, env=dict(self._config["env"]))
+        if handle.device is not None:
+            config["env"]["YOLO_DEVICE"] = handle.device
+        if self.metrics_port:
+            config["metrics_port"] = self.metrics_port + handle.index
+        parent_conn, child_conn = self._ctx.Pipe()
+        rings = {cam: self.rings[cam].name for cam, _ in handle.cameras}
+        handle.process = self._ctx.Process(
+            target=worker_main, name=f"surveilens-worker-{handle.index}", daemon=True,
+            args=(handle.index, handle.cameras, rings, config, child_conn, self._alerts))
+        handle.process.start()
+        child_conn.close()
+        handle.conn = parent_conn
+        handle.spawned_config = config
+        handle.started_at = time.time()
+
+    def _handshake(self, handle: WorkerHandle, timeout: float) -> bool:
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            if handle.conn.poll(0.25):
+                try:
+                    kind, _, arg = handle.conn.recv()
+                except (EOFError, OSError):
+                    break
+                if kind == "ready":
+                    handle.pid, handle.error = arg, None
+                    return True
+                handle.error = arg
+                return False
+            if not handle.process.is_alive():
+                break
+        handle.error = handle.error or f"no ready message (exit code {handle.process.exitcode})"
+        return False
+
+    def _monitor(self):
+        while not self._stop.wait(1.0):
+            for handle in self.handles:
+                if handle.process.is_alive() or self._stop.is_set():
+                    continue
+                now = time.monotonic()
+                if now < handle.next_restart:
+                    continue
+                print(f"[WARN] worker {handle.index} exited (code {handle.process.exitcode}); restarting")
+                handle.restarts += 1
+                handle.next_restart = now + min(30.0, 2.0 ** handle.restarts)
+                with handle.lock:
+                    try: handle.conn.close()
+                    except Exception: pass
+                    self._spawn(handle)
+                    handle.starting = True
+                # the handshake can take ready_timeout; _call / stats() skip this worker meanwhile
+                ok = self._handshake(handle, self.ready_timeout)
+                handle.starting = False
+                if not ok:
+                    print(f"[WARN] worker {handle.index} restart failed: {handle.error}")
+                    continue
+                # model / rules changed while it was starting: its spawn config is stale
+                cfg = handle.spawned_config
+                if any(cfg.get(k) != self._config.get(k) for k in ("weights", "backend", "conf")):
+                    self._call(handle, "model", (self._config["weights"], self._config["backend"],
+                                                 self._config["conf"]), timeout=0)
+                if cfg.get("rules") != self._config.get("rules") and self._config.get("rules") is not None:
+                    self._call(handle, "rules", self._config["rules"], timeout=0)
+
+    def _drain_alerts(self):
+        while not self._stop.is_set():
+            try:
+                kind, a, b = self._alerts.get(timeout=0.5)
+            except queue.Empty:
+                continue
+            except (EOFError, OSError):
+                return
+            try:
+                if kind == "alert":
+                    self.on_alert(a, b)
+                elif self.on_clip is not None:
+                    self.on_clip(a, b)
+            except Exception as e:
+                print(f"[WARN] worker {kind} message dropped: {e}")
+
+    # ----- control -----
+    def _call(self, handle: WorkerHandle, kind: str, arg=None, timeout: float = 1.0):
+        if handle.starting:
+            return None
+        with handle.lock:
+            if handle.starting or handle.process is None or not handle.process.is_alive():
+                return None
+            call_id = next(self._ids)
+            try:
+                handle.conn.send((kind, call_id, arg))
+                if timeout <= 0:
+                    return None
+                deadline = time.monotonic() + timeout
+                while handle.conn.poll(max(0.0, deadline - time.monotonic())):
+                    _kind, reply_id, value = handle.conn.recv()
+                    if reply_id == call_id:   # drop late replies to calls that timed out
+                        return value
+            except (EOFError, OSError, BrokenPipeError):
+                pass
+            return None
+
+    def set_model(self, weights: str, backend: str, conf: float):
+        self._config.update(weights=weights, backend=backend, conf=conf)   # restarts too
+        for handle in self.handles:
+            self._call(handle, "model", (weights, backend, conf), timeout=0)
+
+    def set_rules(self, rules: dict):
+        self._config["rules"] = rules
+        for handle in self.handles:
+            self._call(handle, "rules", rules, timeout=0)
+
+    def worker_for(self, cam_id: str) -> Optional[WorkerHandle]:
+        for handle in self.handles:
+            if any(cam == cam_id for cam, _ in handle.cameras):
+                return handle
+        return None
+
+    def stats(self):
+        out = []
+        for handle in self.handles:
+            alive = handle.process is not None and handle.process.is_alive()
+            out.append({
+                "index": handle.index, "pid": handle.pid, "alive": alive,
+                "device": handle.device, "cameras": [cam for cam, _ in handle.cameras],
+                "restarts": handle.restarts, "error": handle.error, "starting": handle.starting,
+                "uptime_sec": round(time.time() - handle.started_at, 1) if alive else None,
+                "status": self._call(handle, "stats") if alive else None,
+            })
+        return out
+
+    def stop(self, timeout: float = 5.0):
+        self._stop.set()
+        for handle in self.handles:
+            self._call(handle, "stop", timeout=0)
+        for handle in self.handles:
+            if handle.process is None:
+                continue
+            handle.process.join(timeout)
+            if handle.process.is_alive():
+                handle.process.terminate()
+                handle.process.join(1.0)
+            try: handle.conn.close()
+            except Exception: pass
+        for t in self._threads:
+            t.join(1.0)
+        self._threads = []
+        self.handles = []
+        for ring in self.rings.values():
+            ring.close()
+        self.rings = {}
+        shutil.rmtree(self._alerts_dir, ignore_errors=True)
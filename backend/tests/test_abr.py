@@ -0,0 +1,60 @@
+# test_abr.py — BitrateController layer steps
+import unittest
+
+from abr import LAYERS, BitrateController
+
+
+class BitrateControllerTest(unittest.TestCase):
+    def test_steps_down_after_consecutive_loss(self):
+        ctl = BitrateController(fps=15, down_after=2)
+        ctl.report_rtcp(0.2, None)
+        self.assertEqual(ctl.tick(720), 0)
+        self.assertEqual(ctl.tick(720), 1)
+        self.assertEqual(ctl.tick(720), 1)   # counter restarts after a step
+        self.assertEqual(ctl.tick(720), 2)
+        self.assertEqual(ctl.changes, 2)
+
+    def test_steps_up_one_layer_after_clean_ticks(self):
+        ctl = BitrateController(fps=15, up_after=3)
+        ctl.layer = 3
+        ctl.report_rtcp(0.0, 0.05)
+        for _ in range(2):
+            self.assertEqual(ctl.tick(720), 3)
+        self.assertEqual(ctl.tick(720), 2)
+
+    def test_loss_between_thresholds_holds_the_layer(self):
+        ctl = BitrateController(fps=15, down_loss=0.05, up_loss=0.01, down_after=1, up_after=1)
+        ctl.layer = 2
+        ctl.report_rtcp(0.03, None)
+        for _ in range(5):
+            self.assertEqual(ctl.tick(720), 2)
+
+    def test_never_below_min_height(self):
+        ctl = BitrateController(fps=15, down_after=1, min_height=120)
+        ctl.report_rtcp(0.5, None)
+        for _ in range(len(LAYERS) * 2):
+            ctl.tick(240)
+        self.assertGreaterEqual(240 * LAYERS[ctl.layer][0], 120)
+        self.assertEqual(LAYERS[ctl.layer][0], 0.5)
+
+    def test_starved_client_is_congestion(self):
+        ctl = BitrateController(fps=30, down_after=1)
+        ctl.report_client({"fps": 10, "packetsLost": 0, "packetsReceived": 100})
+        self.assertEqual(ctl.tick(720), 1)
+
+    def test_slow_source_is_not_a_starved_viewer(self):
+        ctl = BitrateController(fps=30, down_after=1, up_after=1, source_rate=lambda: 12.0)
+        ctl.layer = 1
+        ctl.report_client({"fps": 12, "packetsLost": 0, "packetsReceived": 100})
+        self.assertEqual(ctl.sent_fps(), 12.0)
+        self.assertEqual(ctl.tick(720), 0)
+
+    def test_client_loss_is_per_interval(self):
+        ctl = BitrateController(fps=15)
+        ctl.report_client({"packetsLost": 100, "packetsReceived": 1000})
+        ctl.report_client({"packetsLost": 110, "packetsReceived": 1090})
+        self.assertAlmostEqual(ctl.client["interval_loss"], 0.1)
+
+
+if __name__ == "__main__":
+    unittest.main()
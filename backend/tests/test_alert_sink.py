@@ -0,0 +1,59 @@
+# test_alert_sink.py — AlertSink coalescing, repeat counts and drops
+import tempfile
+import unittest
+
+from alert_store import AlertSink, AlertStore
+
+
+class AlertSinkTest(unittest.TestCase):
+    def setUp(self):
+        self._tmp = tempfile.TemporaryDirectory()
+        self.store = AlertStore(self._tmp.name)
+
+    def tearDown(self):
+        self._tmp.cleanup()
+
+    def test_repeats_inside_the_window_fold_into_the_first_alert(self):
+        sink = AlertSink(None, coalesce_sec=10.0)
+        self.assertTrue(sink.submit({"n": 0}, key=("cam", ("knife",)), now=0.0))
+        self.assertFalse(sink.submit({"n": 1}, key=("cam", ("knife",)), now=5.0))
+        self.assertTrue(sink.submit({"n": 2}, key=("cam", ("gun",)), now=5.0))
+        self.assertTrue(sink.submit({"n": 3}, key=("cam", ("knife",)), now=10.0))   # window over
+        self.assertTrue(sink.submit({"n": 4}, key=None, now=10.0))
+        self.assertTrue(sink.submit({"n": 5}, key=None, now=10.0))
+        self.assertEqual(sink.stats()["coalesced"], 1)
+
+    def test_full_queue_drops_and_forgets_the_run(self):
+        sink = AlertSink(self.store, max_queue=1, coalesce_sec=10.0)   # not started: nothing drains
+        self.assertTrue(sink.submit({"n": 0}, key="a", now=0.0))
+        self.assertFalse(sink.submit({"n": 1}, key="b", now=0.0))      # queue full
+        self.assertEqual(sink.dropped, 1)
+        self.assertFalse(sink.submit({"n": 2}, key="b", now=1.0))      # dropped again, not coalesced
+        self.assertEqual((sink.dropped, sink.coalesced), (2, 0))
+        self.assertFalse(sink.submit({"n": 3}, key="a", now=1.0))      # "a" was queued: coalesced
+        self.assertEqual(sink.coalesced, 1)
+
+    def test_writer_commits_and_annotates_repeats(self):
+        sink = AlertSink(self.store, flush_sec=0.01, coalesce_sec=60.0)
+        sink.submit({"n": 0, "timestamp": "2024-01-01T00:00:00+00:00"}, key="k")
+        sink.submit({"n": 1, "timestamp": "2024-01-01T00:00:01+00:00"}, key="k")
+        sink.submit({"n": 2, "timestamp": "2024-01-01T00:00:02+00:00"}, key="k")
+        sink.start()
+        sink.close()
+        (stored,) = self.store.query()
+        self.assertEqual(stored["n"], 0)
+        self.assertEqual(stored["repeat_count"], 2)
+        self.assertEqual(stored["last_seen"], "2024-01-01T00:00:02+00:00")
+        self.assertEqual(sink.stats()["committed"], 1)
+
+    def test_clip_status_reaches_the_stored_alert(self):
+        sink = AlertSink(self.store, flush_sec=0.01)
+        sink.submit({"n": 0, "clip": "clips/a.mp4"}, key="k")
+        sink.clip_done("clips/a.mp4", {"clip_status": "ok"})
+        sink.start()
+        sink.close()
+        self.assertEqual(self.store.query()[0]["clip_status"], "ok")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,85 @@
+# test_alert_store.py — AlertStore ids, offsets and reload
+# run from backend/: python -m unittest discover -s tests
+import json
+import os
+import tempfile
+import unittest
+from pathlib import Path
+
+from alert_store import AlertStore
+
+
+def _rec(i, level="low", labels=("person",)):
+    return {"timestamp": f"2024-01-01T00:00:{i:02d}+00:00", "frame_level": level, "labels": list(labels), "n": i}
+
+
+class AlertStoreTest(unittest.TestCase):
+    def setUp(self):
+        self._tmp = tempfile.TemporaryDirectory()
+        self.dir = self._tmp.name
+
+    def tearDown(self):
+        self._tmp.cleanup()
+
+    def _segment(self):
+        (path,) = Path(self.dir).glob("alerts-*.jsonl")
+        return path
+
+    def test_ids_are_contiguous_and_survive_reload(self):
+        store = AlertStore(self.dir)
+        ids = [r["id"] for r in store.append_many([_rec(i) for i in range(5)])]
+        self.assertEqual(ids, [0, 1, 2, 3, 4])
+        self.assertEqual(store.append(_rec(5))["id"], 5)
+
+        again = AlertStore(self.dir, tail_size=2)   # most reads go through the segment index
+        self.assertEqual(again.next_seq, 6)
+        self.assertEqual([r["n"] for r in again.query()], [5, 4, 3, 2, 1, 0])
+        self.assertEqual([r["id"] for r in again.query(after=1, before=4)], [3, 2])
+
+    def test_offsets_point_at_their_lines(self):
+        store = AlertStore(self.dir)
+        store.append_many([_rec(i) for i in range(3)])
+        seg = store._segments[-1]
+        with open(seg.path, "rb") as f:
+            for line_no in range(len(seg)):
+                self.assertEqual(seg.read(f, line_no)["n"], line_no)
+        self.assertEqual(seg.size, os.path.getsize(seg.path))
+
+    def test_filters_use_the_index(self):
+        store = AlertStore(self.dir, tail_size=1)
+        store.append_many([_rec(0), _rec(1, "high", ("knife",)), _rec(2), _rec(3, "high", ("gun",))])
+        self.assertEqual([r["id"] for r in store.query(severity="high")], [3, 1])
+        self.assertEqual([r["id"] for r in store.query(label="kni")], [1])
+        self.assertEqual([r["id"] for r in store.query(limit=2)], [3, 2])
+
+    def test_reload_with_torn_last_line(self):
+        store = AlertStore(self.dir)
+        store.append_many([_rec(0), _rec(1)])
+        path = self._segment()
+        with open(path, "ab") as f:
+            f.write(b'{"timestamp": "2024-01-01T00:00:02+00:00", "n": 9')   # crash mid-write
+        store = AlertStore(self.dir)
+        self.assertEqual(store.next_seq, 2)
+        self.assertEqual(store.append(_rec(2))["id"], 2)
+
+        seg = store._segments[-1]
+        with open(seg.path, "rb") as f:
+            self.assertEqual(seg.read(f, 2)["n"], 2)
+        lines = path.read_bytes().split(b"\n")
+        self.assertEqual(json.loads(lines[3])["n"], 2)   # the torn line stays on its own line
+
+        again = AlertStore(self.dir, tail_size=1)
+        self.assertEqual(again.next_seq, 3)
+        self.assertEqual([(r["id"], r["n"]) for r in again.query()], [(2, 2), (1, 1), (0, 0)])
+
+    def test_annotate_is_merged_on_read(self):
+        store = AlertStore(self.dir)
+        store.append_many([_rec(0), _rec(1)])
+        store.annotate(0, {"repeat_count": 3})
+        self.assertEqual(store.query(after=-1, before=1)[0]["repeat_count"], 3)
+        again = AlertStore(self.dir, tail_size=1)
+        self.assertEqual([r.get("repeat_count") for r in again.query()], [None, 3])
+
+
+if __name__ == "__main__":
+    unittest.main()
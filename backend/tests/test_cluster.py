@@ -0,0 +1,112 @@
+# test_cluster.py — Coordinator camera assignment, node reaping and alert acks
+import tempfile
+import time
+import unittest
+from pathlib import Path
+
+from alert_store import AlertStore
+from cluster import Coordinator
+
+
+def _cams(n):
+    return [(f"cam{i}", f"rtsp://cam{i}") for i in range(n)]
+
+
+class CoordinatorAssignTest(unittest.TestCase):
+    def _owned(self, coord, node_id):
+        return sorted(c for c, n in coord.assignment.items() if n == node_id)
+
+    def test_cameras_fill_free_capacity(self):
+        coord = Coordinator()
+        coord.set_cameras(_cams(3))
+        coord.heartbeat("a", "http://a:8000", capacity=2, load={})
+        self.assertEqual(len(self._owned(coord, "a")), 3)   # only node: overcommitted
+        reply = coord.heartbeat("b", "http://b:8000", capacity=2, load={})
+        self.assertEqual(reply["cameras"], [])               # working assignments stay put
+
+        coord.set_cameras(_cams(4))
+        self.assertEqual(self._owned(coord, "b"), ["cam3"])
+
+    def test_silent_node_is_reaped_and_its_cameras_move(self):
+        coord = Coordinator(node_timeout=5.0)
+        coord.set_cameras(_cams(2))
+        coord.heartbeat("a", "http://a:8000", capacity=1, load={})
+        coord.heartbeat("b", "http://b:8000", capacity=1, load={})
+        self.assertEqual(self._owned(coord, "a"), ["cam0", "cam1"])
+        coord.nodes["a"].last_seen = time.monotonic() - 10.0
+        reply = coord.heartbeat("b", "http://b:8000", capacity=1, load={})
+        self.assertEqual(sorted(c["id"] for c in reply["cameras"]), ["cam0", "cam1"])
+        self.assertFalse(coord.nodes["a"].alive)
+        self.assertEqual(coord.reassigned, 2)
+        self.assertEqual(coord.owner("cam0").node_id, "b")
+
+    def test_lagging_node_scores_worse(self):
+        coord = Coordinator()
+        coord.heartbeat("a", "http://a:8000", capacity=4,
+                        load={"configured_fps": 15, "cameras": 1, "output_fps": 3.0})
+        coord.heartbeat("b", "http://b:8000", capacity=4, load={})
+        coord.set_cameras(_cams(1))
+        self.assertEqual(coord.assignment["cam0"], "b")
+
+
+class CoordinatorAlertsTest(unittest.TestCase):
+    def setUp(self):
+        self._tmp = tempfile.TemporaryDirectory()
+        self.dir = Path(self._tmp.name)
+        self.store = AlertStore(str(self.dir / "alerts"))
+
+    def tearDown(self):
+        self._tmp.cleanup()
+
+    def _coordinator(self):
+        coord = Coordinator(state_path=str(self.dir / "cluster-alerts.json"))
+        coord.restore_alerts(lambda after: self.store.query(None, None, None, None, after))
+        return coord
+
+    def _accept(self, coord, ids, node="n1"):
+        return coord.accept_alerts(node, [{"id": i, "labels": ["knife"]} for i in ids],
+                                   self.store.append_many)
+
+    def test_resent_alerts_are_acked_not_stored_again(self):
+        coord = self._coordinator()
+        self.assertEqual(self._accept(coord, [1, 0]), 1)
+        self.assertEqual(self._accept(coord, [1, 2]), 2)   # ack for 0..1 was lost
+        stored = self.store.query()
+        self.assertEqual([r["node_alert_id"] for r in stored], [2, 1, 0])
+        self.assertEqual({r["node"] for r in stored}, {"n1"})
+
+    def test_failed_store_is_not_acked(self):
+        coord = self._coordinator()
+
+        def fail(_recs):
+            raise OSError("disk full")
+        with self.assertRaises(OSError):
+            coord.accept_alerts("n1", [{"id": 0}], fail)
+        self.assertEqual(self._accept(coord, [0]), 0)
+        self.assertEqual(len(self.store.query()), 1)
+
+    def test_high_water_survives_a_restart(self):
+        self._accept(self._coordinator(), [0, 1])
+        self.assertEqual(self._accept(self._coordinator(), [0, 1, 2]), 2)
+        self.assertEqual(len(self.store.query()), 3)
+
+    def test_restart_without_state_file_rescans_the_store(self):
+        self._accept(self._coordinator(), [0, 1], node="n1")
+        self._accept(self._coordinator(), [5], node="n2")
+        (self.dir / "cluster-alerts.json").unlink()
+        coord = self._coordinator()
+        self.assertEqual(self._accept(coord, [1], node="n1"), 1)
+        self.assertEqual(self._accept(coord, [5, 6], node="n2"), 6)
+        self.assertEqual(len(self.store.query()), 4)
+
+    def test_patches_follow_their_alert(self):
+        coord = self._coordinator()
+        self._accept(coord, [7])
+        applied = coord.accept_patches("n1", [{"id": 7, "fields": {"clip_status": "ok"}},
+                                              {"id": 99, "fields": {"x": 1}}], self.store.annotate)
+        self.assertEqual(applied, 1)
+        self.assertEqual(self.store.query()[0]["clip_status"], "ok")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,69 @@
+# test_rules.py — RuleSet level merging and RuleBook.predict_classes
+import unittest
+
+from rules import DEFAULT_RULES, LEVEL_INDEX, RuleBook, RuleSet
+
+NAMES = {0: "person", 1: "knife", 2: "scissors", 3: "gun", 4: "motorcycle", 5: "car"}
+
+
+class RuleSetTest(unittest.TestCase):
+    def test_defaults(self):
+        rules = RuleSet()
+        self.assertEqual(rules.by_name["knife"], LEVEL_INDEX["HIGH"])
+        self.assertEqual(rules.by_name["scissors"], LEVEL_INDEX["MEDIUM"])
+        self.assertNotIn("person", rules.by_name)
+
+    def test_omitted_level_keeps_its_defaults(self):
+        rules = RuleSet({"levels": {"MEDIUM": ["car"]}})
+        self.assertEqual(rules.data["levels"]["MEDIUM"], ["car"])   # given level replaces
+        self.assertEqual(rules.data["levels"]["HIGH"], sorted(DEFAULT_RULES["levels"]["HIGH"]))
+
+    def test_empty_list_empties_a_level(self):
+        rules = RuleSet({"levels": {"HIGH": []}})
+        self.assertEqual(rules.data["levels"]["HIGH"], [])
+        self.assertEqual(rules.data["levels"]["MEDIUM"], ["scissors"])
+
+    def test_named_label_is_not_readded_at_its_default_level(self):
+        rules = RuleSet({"levels": {"MEDIUM": ["knife"]}})
+        self.assertEqual(rules.by_name["knife"], LEVEL_INDEX["MEDIUM"])
+        self.assertIn("gun", rules.data["levels"]["HIGH"])
+
+    def test_colors_merge_per_level_and_clamp(self):
+        rules = RuleSet({"colors": {"high": [300, -5, 10]}})
+        self.assertEqual(rules.level_colors[LEVEL_INDEX["HIGH"]], (255, 0, 10))
+        self.assertEqual(rules.level_colors[LEVEL_INDEX["LOW"]], tuple(DEFAULT_RULES["colors"]["LOW"]))
+
+    def test_invalid_rules_raise(self):
+        for bad in ({"levels": {"CRITICAL": ["x"]}}, {"levels": ["knife"]}, {"colors": {"HIGH": [1, 2]}}):
+            with self.assertRaises(ValueError):
+                RuleSet(bad)
+
+    def test_compile_keeps_tracked_and_dangerous_classes(self):
+        table = RuleSet({"track": ["person"], "levels": {"HIGH": ["knife"]}}).compile(NAMES)
+        self.assertEqual(table.class_ids, [0, 1, 2])   # person, knife, default MEDIUM scissors
+        self.assertEqual(table.keys[4], "motorbike")   # alias
+        self.assertIsNone(RuleSet().compile(NAMES).class_ids)   # no track filter: everything
+
+
+class RuleBookTest(unittest.TestCase):
+    def test_predict_classes_is_the_union_over_the_batch(self):
+        book = RuleBook()
+        book.set("a", {"track": ["person"], "levels": {"HIGH": [], "MEDIUM": []}})
+        book.set("b", {"track": ["car"], "levels": {"HIGH": ["gun"], "MEDIUM": []}})
+        self.assertEqual(book.predict_classes(NAMES, ["a"]), [0])
+        self.assertEqual(book.predict_classes(NAMES, ["a", "b", "a"]), [0, 3, 5])
+        self.assertIsNone(book.predict_classes(NAMES, ["a", "unset"]))   # default keeps all
+        self.assertIsNone(book.predict_classes(None, ["a"]))
+
+    def test_rule_changes_apply_to_the_next_batch(self):
+        book = RuleBook()
+        book.set("a", {"track": ["person"], "levels": {"HIGH": [], "MEDIUM": []}})
+        self.assertEqual(book.predict_classes(NAMES, ["a"]), [0])
+        book.set("a", {"track": ["car"], "levels": {"HIGH": [], "MEDIUM": []}})
+        self.assertEqual(book.predict_classes(NAMES, ["a"]), [5])
+        book.delete("a")
+        self.assertIsNone(book.predict_classes(NAMES, ["a"]))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,71 @@
+# test_shm_ring.py — SharedFrameRing commit / read and the per-slot seqlock
+import unittest
+
+import numpy as np
+
+from shm_ring import SharedFrameRing
+
+
+def _write(ring, value, ts, h=4, w=6):
+    view = ring.begin(h, w)
+    view[:] = value
+    ring.commit(ts)
+
+
+class SharedFrameRingTest(unittest.TestCase):
+    def setUp(self):
+        self.ring = SharedFrameRing.create(slots=2, max_width=8, max_height=8)
+
+    def tearDown(self):
+        self.ring.close()
+
+    def test_nothing_to_read_before_the_first_commit(self):
+        self.assertEqual(self.ring.latest, 0)
+        self.assertIsNone(self.ring.read(0, np.array))
+
+    def test_reader_gets_the_newest_committed_frame(self):
+        reader = SharedFrameRing.attach(self.ring.name)
+        try:
+            for n in range(1, 4):
+                _write(self.ring, n, ts=float(n))
+            seq, frame, ts = reader.read(0, np.array)
+            self.assertEqual((seq, ts), (3, 3.0))
+            self.assertEqual(frame.shape, (6, 6))   # I420: h * 3/2 rows
+            self.assertTrue((frame == 3).all())
+            self.assertIsNone(reader.read(seq, np.array))   # nothing newer
+        finally:
+            reader.close()
+
+    def test_slot_being_written_is_skipped(self):
+        _write(self.ring, 1, ts=1.0)
+        self.ring.begin(4, 6)   # seq 2 in progress, not yet published
+        seq, frame, _ts = self.ring.read(0, np.array)
+        self.assertEqual(seq, 1)
+        self.ring.commit(2.0)
+        self.assertEqual(self.ring.read(seq, np.array)[0], 2)
+
+    def test_frame_overwritten_mid_copy_is_not_returned_torn(self):
+        _write(self.ring, 1, ts=1.0)
+        overwritten = []
+
+        def copy(view):
+            out = np.array(view)
+            if not overwritten:
+                # the writer laps the reader: seq 2 lands in the other slot, seq 3 starts in ours
+                _write(self.ring, 2, ts=2.0)
+                self.ring.begin(4, 6)
+                overwritten.append(True)
+            return out
+
+        seq, frame, _ts = self.ring.read(0, copy)
+        self.assertEqual(seq, 2)   # retried onto the next intact frame
+        self.assertTrue((frame == 2).all())
+
+    def test_oversized_or_odd_frames_are_refused(self):
+        self.assertIsNone(self.ring.begin(16, 16))
+        self.assertIsNone(self.ring.begin(3, 6))
+        self.assertEqual(self.ring.fit(16, 16), (8, 8))
+
+
+if __name__ == "__main__":
+    unittest.main()
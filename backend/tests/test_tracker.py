@@ -0,0 +1,88 @@
+# test_tracker.py — SimpleTracker assignment, ageing and velocity prediction
+import unittest
+from unittest import mock
+
+import numpy as np
+
+import danger_yolo_live as live
+from danger_yolo_live import SimpleTracker, assign_max_iou, iou_matrix
+
+
+def _det(x1, y1, x2, y2, cls="person", conf=0.9):
+    return {"bbox": (x1, y1, x2, y2), "conf": conf, "class_name": cls}
+
+
+def _ids(tracks):
+    return sorted(t.track_id for t in tracks)
+
+
+class SimpleTrackerTest(unittest.TestCase):
+    def test_moving_object_keeps_its_id(self):
+        tracker = SimpleTracker(iou_thresh=0.3)
+        (first,) = tracker.update([_det(0, 0, 10, 10)], 0.0, "ATM")
+        (moved,) = tracker.update([_det(2, 0, 12, 10)], 0.1, "ATM")
+        self.assertEqual(moved.track_id, first.track_id)
+        self.assertEqual(moved.bbox, (2, 0, 12, 10))
+
+    def test_one_detection_per_track(self):
+        tracker = SimpleTracker()
+        tracker.update([_det(0, 0, 10, 10), _det(100, 0, 110, 10)], 0.0, "ATM")
+        tracks = tracker.update([_det(1, 0, 11, 10), _det(101, 0, 111, 10), _det(50, 50, 60, 60)],
+                                0.1, "ATM")
+        self.assertEqual(_ids(tracks), [1, 2, 3])
+        by_id = {t.track_id: t.bbox for t in tracks}
+        self.assertEqual(by_id[1], (1, 0, 11, 10))
+        self.assertEqual(by_id[2], (101, 0, 111, 10))
+
+    def test_classes_never_match_each_other(self):
+        tracker = SimpleTracker()
+        tracker.update([_det(0, 0, 10, 10, cls="person")], 0.0, "ATM")
+        tracks = tracker.update([_det(0, 0, 10, 10, cls="knife")], 0.1, "ATM")
+        self.assertEqual(_ids(tracks), [1, 2])
+
+    def test_tracks_age_out(self):
+        tracker = SimpleTracker(max_age=1.0)
+        tracker.update([_det(0, 0, 10, 10)], 0.0, "ATM")
+        self.assertEqual(len(tracker.update([], 0.5, "ATM")), 1)
+        self.assertEqual(tracker.update([], 2.0, "ATM"), [])
+        self.assertEqual(tracker._n, 0)
+
+    def test_capacity_grows(self):
+        tracker = SimpleTracker(capacity=2)
+        tracks = tracker.update([_det(i * 20, 0, i * 20 + 10, 10) for i in range(5)], 0.0, "ATM")
+        self.assertEqual(_ids(tracks), [1, 2, 3, 4, 5])
+        self.assertEqual(tracker._n, 5)
+
+    def test_skipped_frames_match_the_predicted_box(self):
+        tracker = SimpleTracker(iou_thresh=0.3, max_age=5.0)
+        tracker.update([_det(0, 0, 10, 10)], 0.0, "ATM")
+        tracker.update([_det(4, 0, 14, 10)], 1.0, "ATM")
+        tracker.update([_det(8, 0, 18, 10)], 2.0, "ATM")   # smoothed velocity: 3 px/s
+        for ts in (3.0, 4.0):
+            (tr,) = tracker.predict(ts, "ATM")
+        self.assertAlmostEqual(tr.bbox[0], 14.0, places=4)
+        # 3 s after the last detection the stale box (8..18) no longer overlaps; the prediction does
+        (tr,) = tracker.update([_det(20, 0, 30, 10)], 5.0, "ATM")
+        self.assertEqual(tr.track_id, 1)
+
+
+class AssignmentTest(unittest.TestCase):
+    def test_iou_matrix(self):
+        ious = iou_matrix([[0, 0, 10, 10]], [[0, 0, 10, 10], [5, 0, 15, 10], [20, 20, 30, 30]])
+        np.testing.assert_allclose(ious, [[1.0, 1 / 3, 0.0]], rtol=1e-5)
+        self.assertEqual(iou_matrix(np.zeros((0, 4)), [[0, 0, 1, 1]]).shape, (0, 1))
+
+    def test_matches_are_one_to_one_and_above_threshold(self):
+        ious = np.array([[0.9, 0.8], [0.85, 0.1]], dtype=np.float32)
+        for lsa in (live.linear_sum_assignment, None):   # Hungarian (if installed) and greedy
+            with mock.patch.object(live, "linear_sum_assignment", lsa):
+                matches = assign_max_iou(ious, 0.3)
+            rows, cols = zip(*matches)
+            self.assertEqual(len(set(rows)), len(rows))
+            self.assertEqual(len(set(cols)), len(cols))
+            self.assertTrue(all(ious[r, c] >= 0.3 for r, c in matches))
+        self.assertEqual(assign_max_iou(np.zeros((0, 3), dtype=np.float32), 0.3), [])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,260 @@
+# zones.py — polygon zones per camera: rasterized zone-bit mask, incremental per-zone counts / dwell
+import json
+from typing import Dict, List, Optional, Sequence, Tuple
+
+import cv2
+import numpy as np
+
+MAX_ZONES = 32   # one bit each in the mask
+
+# legacy TrackState fields mirroring dwell in any zone of a kind
+KIND_FIELDS = {"atm": "time_in_atm_roi", "parking": "time_in_parking_roi"}
+
+
+class Zone:
+    """A named polygon (pixel coords). `kind` groups zones for features (atm, parking, door, ...)."""
+
+    def __init__(self, name: str, kind: str, polygon, dwell: bool = True):
+        pts = np.asarray(polygon, dtype=np.float64).reshape(-1, 2)
+        if len(pts) < 3:
+            raise ValueError(f"zone {name!r} needs at least 3 points")
+        self.name = str(name)
+        self.kind = str(kind).lower()
+        self.polygon = pts
+        self.dwell = bool(dwell)   # accumulate time spent inside
+
+    @classmethod
+    def rect(cls, name: str, kind: str, rect, dwell: bool = True) -> "Zone":
+        x1, y1, x2, y2 = rect
+        return cls(name, kind, [(x1, y1), (x2, y1), (x2, y2), (x1, y2)], dwell)
+
+    @classmethod
+    def from_dict(cls, d: dict) -> "Zone":
+        if "rect" in d:
+            return cls.rect(d["name"], d.get("kind", "zone"), d["rect"], d.get("dwell", True))
+        return cls(d["name"], d.get("kind", "zone"), d["polygon"], d.get("dwell", True))
+
+    def to_dict(self):
+        return {"name": self.name, "kind": self.kind, "polygon": self.polygon.tolist(), "dwell": self.dwell}
+
+
+def load_zones(path: str) -> List[Zone]:
+    """[{name, kind, polygon | rect, dwell?}, ...] or {"zones": [...]} from a JSON file."""
+    with open(path, encoding="utf-8") as f:
+        data = json.load(f)
+    if isinstance(data, dict):
+        data = data.get("zones", [])
+    return [Zone.from_dict(d) for d in data]
+
+
+class ZoneMap:
+    """
+    Zones rasterized once into a uint32 mask at 1/`cell` resolution, bit i
+    set where zone i covers the cell, so the zones containing a point are
+    one array read whatever their shape or number. Points outside the mask
+    read 0. `cell` trades edge precision for memory.
+    """
+
+    def __init__(self, zones: Sequence[Zone], cell: int = 4):
+        if len(zones) > MAX_ZONES:
+            raise ValueError(f"at most {MAX_ZONES} zones per camera")
+        names = [z.name for z in zones]
+        if len(set(names)) != len(names):
+            raise ValueError("zone names must be unique")
+        self.zones = list(zones)
+        self.cell = max(1, int(cell))
+        self.index = {z.name: i for i, z in enumerate(self.zones)}
+        if self.zones:
+            hi = np.max([z.polygon.max(axis=0) for z in self.zones], axis=0)
+            w, h = int(hi[0]) // self.cell + 2, int(hi[1]) // self.cell + 2
+        else:
+            w = h = 1
+        self.mask = np.zeros((h, w), dtype=np.uint32)
+        layer = np.zeros((h, w), dtype=np.uint8)
+        for i, z in enumerate(self.zones):
+            layer[:] = 0
+            # 2 fractional bits so sub-cell vertices still land where they should
+            pts = np.round(np.maximum(z.polygon, 0) * (4.0 / self.cell)).astype(np.int32)
+            cv2.fillPoly(layer, [pts], 1, lineType=cv2.LINE_8, shift=2)
+            self.mask[layer.view(bool)] |= np.uint32(1 << i)
+        self.kind_bits: Dict[str, int] = {}
+        for i, z in enumerate(self.zones):
+            self.kind_bits[z.kind] = self.kind_bits.get(z.kind, 0) | (1 << i)
+        self.dwell_bits = sum(1 << i for i, z in enumerate(self.zones) if z.dwell)
+        self._members: Dict[int, Tuple[int, ...]] = {0: ()}
+
+    def bits_at(self, x: float, y: float) -> int:
+        col, row = int(x) // self.cell, int(y) // self.cell
+        if 0 <= row < self.mask.shape[0] and 0 <= col < self.mask.shape[1] and x >= 0 and y >= 0:
+            return int(self.mask[row, col])
+        return 0
+
+    def members(self, bits: int) -> Tuple[int, ...]:
+        """Zone indices in `bits` (cached per distinct combination)."""
+        out = self._members.get(bits)
+        if out is None:
+            out = self._members[bits] = tuple(i for i in range(len(self.zones)) if bits >> i & 1)
+        return out
+
+    def bounds(self) -> Optional[Tuple[float, float, float, float]]:
+        if not self.zones:
+            return None
+        pts = np.concatenate([z.polygon for z in self.zones])
+        (x1, y1), (x2, y2) = pts.min(axis=0), pts.max(axis=0)
+        return float(x1), float(y1), float(x2), float(y2)
+
+
+class _Rec:
+    __slots__ = ("track", "cls", "bits", "kind_time")
+
+    def __init__(self, track, bits: int, kind_time: Dict[str, float]):
+        self.track = track
+        self.cls = track.class_name
+        self.bits = bits
+        self.kind_time = kind_time
+
+
+class ZoneEngine:
+    """
+    Live per-zone state for one camera, updated on track events instead of
+    rebuilt per frame: `advance` credits the time since a track's last update
+    to the zones it was in, `place` moves it (enter / exit counters change
+    only when its zone bits do), `exit` drops it. Counts are per zone and
+    per kind (a track in two overlapping ATM zones counts once for "atm");
+    the longest dwell per (kind, class) is kept as a running max and only
+    rescanned when its holder leaves.
+    """
+
+    def __init__(self, zmap: ZoneMap):
+        self.map = zmap
+        self._tracks: Dict[int, _Rec] = {}
+        self._reset_counts()
+
+    def _reset_counts(self):
+        n = len(self.map.zones)
+        self.totals: Dict[str, int] = {}
+        self.zone_counts: List[Dict[str, int]] = [{} for _ in range(n)]
+        self.kind_counts: Dict[str, Dict[str, int]] = {k: {} for k in self.map.kind_bits}
+        self._max: Dict[Tuple[str, str], Tuple[float, int]] = {}   # (kind, cls) -> (sec, track id)
+
+    @staticmethod
+    def _bump(counts: Dict[str, int], cls: str, d: int):
+        counts[cls] = counts.get(cls, 0) + d
+
+    def _count(self, rec: _Rec, bits: int, d: int):
+        for i in self.map.members(bits):
+            self._bump(self.zone_counts[i], rec.cls, d)
+        for kind, kb in self.map.kind_bits.items():
+            if bits & kb:
+                self._bump(self.kind_counts[kind], rec.cls, d)
+
+    # ----- track events -----
+    def place(self, track, cx: float, cy: float):
+        """Track created or moved to (cx, cy)."""
+        bits = self.map.bits_at(cx, cy)
+        rec = self._tracks.get(track.track_id)
+        if rec is None:
+            seed = {k: getattr(track, f) for k, f in KIND_FIELDS.items() if getattr(track, f, 0.0)}
+            rec = self._tracks[track.track_id] = _Rec(track, bits, seed)
+            self._bump(self.totals, rec.cls, 1)
+            self._count(rec, bits, 1)
+            for kind, sec in seed.items():
+                self._raise_max(kind, rec, sec)
+        elif bits != rec.bits:
+            self._move(rec, bits)
+
+    def _move(self, rec: _Rec, bits: int):
+        old = rec.bits
+        for i in self.map.members(old & ~bits):
+            self._bump(self.zone_counts[i], rec.cls, -1)
+        for i in self.map.members(bits & ~old):
+            self._bump(self.zone_counts[i], rec.cls, 1)
+        for kind, kb in self.map.kind_bits.items():
+            was, now = bool(old & kb), bool(bits & kb)
+            if was != now:
+                self._bump(self.kind_counts[kind], rec.cls, 1 if now else -1)
+        rec.bits = bits
+
+    def advance(self, track, dt: float):
+        """Credit `dt` seconds at the track's current (pre-move) position."""
+        rec = self._tracks.get(track.track_id)
+        if rec is None or dt <= 0:
+            return
+        bits = rec.bits & self.map.dwell_bits
+        if not bits:
+            return
+        zt = track.zone_time
+        for i in self.map.members(bits):
+            name = self.map.zones[i].name
+            zt[name] = zt.get(name, 0.0) + dt
+        for kind, kb in self.map.kind_bits.items():
+            if bits & kb:
+                sec = rec.kind_time.get(kind, 0.0) + dt
+                rec.kind_time[kind] = sec
+                field = KIND_FIELDS.get(kind)
+                if field is not None:
+                    setattr(track, field, sec)
+                self._raise_max(kind, rec, sec)
+
+    def exit(self, track_id: int):
+        rec = self._tracks.pop(track_id, None)
+        if rec is None:
+            return
+        self._bump(self.totals, rec.cls, -1)
+        self._count(rec, rec.bits, -1)
+        for kind in rec.kind_time:
+            held = self._max.get((kind, rec.cls))
+            if held is not None and held[1] == track_id:
+                self._rescan_max(kind, rec.cls)
+
+    def _raise_max(self, kind: str, rec: _Rec, sec: float):
+        key = (kind, rec.cls)
+        held = self._max.get(key)
+        if held is None or sec >= held[0]:
+            self._max[key] = (sec, rec.track.track_id)
+
+    def _rescan_max(self, kind: str, cls: str):
+        best = None
+        for tid, rec in self._tracks.items():
+            sec = rec.kind_time.get(kind)
+            if rec.cls == cls and sec is not None and (best is None or sec > best[0]):
+                best = (sec, tid)
+        if best is None:
+            self._max.pop((kind, cls), None)
+        else:
+            self._max[(kind, cls)] = best
+
+    def set_map(self, zmap: ZoneMap):
+        """Zones changed (e.g. a re-estimated ROI): re-place every track, keep dwell so far."""
+        self.map = zmap
+        self._reset_counts()
+        recs = list(self._tracks.values())
+        self._tracks = {}
+        for rec in recs:
+            cx, cy = bbox_center(rec.track.bbox)
+            bits = zmap.bits_at(cx, cy)
+            rec.bits = bits
+            self._tracks[rec.track.track_id] = rec
+            self._bump(self.totals, rec.cls, 1)
+            self._count(rec, bits, 1)
+            for kind, sec in rec.kind_time.items():
+                self._raise_max(kind, rec, sec)
+
+    # ----- readers -----
+    def count(self, kind: Optional[str] = None, classes: Sequence[str] = ()) -> int:
+        """Live tracks of `classes` in any zone of `kind` (None: anywhere in frame)."""
+        counts = self.totals if kind is None else self.kind_counts.get(kind, {})
+        return sum(counts.get(c, 0) for c in classes)
+
+    def max_dwell(self, kind: str, classes: Sequence[str]) -> float:
+        return max((self._max[(kind, c)][0] for c in classes if (kind, c) in self._max), default=0.0)
+
+    def summary(self) -> Dict[str, Dict[str, int]]:
+        """{zone name: {class: live count}} for zones with anyone in them."""
+        return {self.map.zones[i].name: {c: n for c, n in counts.items() if n}
+                for i, counts in enumerate(self.zone_counts) if any(counts.values())}
+
+
+def bbox_center(bbox):
+    x1, y1, x2, y2 = bbox
+    return (x1 + x2) / 2.0, (y1 + y2) / 2.0
@@ -1,4 +1,4 @@
-import { API_BASE } from "./env.js";
+import { API_BASE, ALERTS_STREAM_URL } from "./env.js";
 import { toLocal } from "./ui-helpers.js";
 
 const timeFilterEl = document.getElementById("alerts-time");
@@ -13,6 +13,13 @@ let sourceLabel = null;
 let configured = true;
 let lastDigest = null;
 
+// push stream state: alerts carry a monotonically increasing `id` used as cursor
+const MAX_ALERTS_KEPT = 1000;
+let alertIds = new Set();
+let cursor = null;
+let stream = null;
+let reconnectDelay = 1000;
+
 const ALERT_SOURCES = [
   { url: `${API_BASE}/alerts`, parser: "json", label: "Live alerts API" },
   { url: `${API_BASE}/alerts.jsonl`, parser: "text", label: "alerts.jsonl (API host)" },
@@ -119,6 +126,31 @@ function digestAlerts(list) {
   return list.map((a) => `${a.timestamp || a.created_at}-${(a.labels || []).join(".")}`).join("|");
 }
 
+function sortAlerts(list) {
+  return list.sort((a, b) => {
+    const ta = Date.parse(a.timestamp || a.created_at || 0);
+    const tb = Date.parse(b.timestamp || b.created_at || 0);
+    return (tb || 0) - (ta || 0);
+  });
+}
+
+function applyDelta(fresh) {
+  const added = fresh.filter((a) => a.id == null || !alertIds.has(a.id));
+  if (!added.length) return false;
+  added.forEach((a) => {
+    if (a.id != null) {
+      alertIds.add(a.id);
+      cursor = cursor == null ? a.id : Math.max(cursor, a.id);
+    }
+  });
+  alerts = sortAlerts(added.concat(alerts));
+  if (alerts.length > MAX_ALERTS_KEPT) {
+    alerts.slice(MAX_ALERTS_KEPT).forEach((a) => alertIds.delete(a.id));
+    alerts = alerts.slice(0, MAX_ALERTS_KEPT);
+  }
+  return true;
+}
+
 function renderTable() {
   const filtered = applyFilters();
   if (!configured) {
@@ -168,11 +200,8 @@ async function pollAlerts() {
     const next = await loadAlerts();
     const digest = digestAlerts(next);
     if (digest !== lastDigest) {
-      alerts = next.sort((a, b) => {
-        const ta = Date.parse(a.timestamp || a.created_at || 0);
-        const tb = Date.parse(b.timestamp || b.created_at || 0);
-        return (tb || 0) - (ta || 0);
-      });
+      alerts = sortAlerts(next);
+      alertIds = new Set(alerts.map((a) => a.id).filter((id) => id != null));
       lastDigest = digest;
     }
   } catch (err) {
@@ -186,13 +215,66 @@ async function pollAlerts() {
   renderTable();
 }
 
+function startPolling() {
+  if (pollingId) return;
+  pollAlerts();
+  pollingId = setInterval(pollAlerts, 3000);
+}
+
+function connectStream() {
+  const url = cursor == null ? ALERTS_STREAM_URL : `${ALERTS_STREAM_URL}?cursor=${cursor}`;
+  let opened = false;
+  try {
+    stream = new WebSocket(url);
+  } catch (err) {
+    console.warn("alerts stream", err);
+    startPolling();
+    return;
+  }
+  stream.onopen = () => {
+    opened = true;
+    reconnectDelay = 1000;
+    sourceLabel = "Live alerts stream";
+    configured = true;
+  };
+  stream.onmessage = (event) => {
+    let message;
+    try {
+      message = JSON.parse(event.data);
+    } catch {
+      return;
+    }
+    if (message.type === "alert_update") {
+      // late fields such as neuralseek_async for an alert we already show
+      const target = alerts.find((a) => a.id === message.id);
+      if (target) {
+        Object.assign(target, message.fields || {});
+        renderTable();
+      }
+      return;
+    }
+    if (message.type !== "alerts") return;
+    const changed = applyDelta(Array.isArray(message.alerts) ? message.alerts : []);
+    if (changed || message.backfill) renderTable();
+  };
+  stream.onclose = () => {
+    stream = null;
+    // server without the push channel: fall back to polling
+    if (!opened) {
+      startPolling();
+      return;
+    }
+    setTimeout(connectStream, reconnectDelay);
+    reconnectDelay = Math.min(reconnectDelay * 2, 30000);
+  };
+}
+
 function init() {
   [timeFilterEl, severityFilterEl, searchInputEl].forEach((el) => {
     el?.addEventListener("input", renderTable);
     el?.addEventListener("change", renderTable);
   });
-  pollAlerts();
-  pollingId = setInterval(pollAlerts, 3000);
+  connectStream();
 }
 
 init();
@@ -61,11 +61,14 @@ async function refreshStatus() {
 async function handleStart() {
   startBtn.disabled = true;
   try {
+    // comma-separated sources start multi-camera mode (rooms cam-1..N)
+    const sources = (sourceInput.value.trim() || "0").split(",").map((s) => s.trim()).filter(Boolean);
     const payload = {
-      source: sourceInput.value.trim() || "0",
       yolo_weights: weightsInput.value.trim() || "yolo11n.pt",
       conf: parseFloat(confInput.value || "0.25"),
     };
+    if (sources.length > 1) payload.sources = sources;
+    else payload.source = sources[0] || "0";
     await startDetection(payload);
     toast("Pipeline start requested");
   } catch (err) {
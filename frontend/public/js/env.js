@@ -1,5 +1,6 @@
 export const API_BASE = "http://localhost:8000";
 export const SIGNALING_URL = "ws://localhost:8000/ws";
+export const ALERTS_STREAM_URL = "ws://localhost:8000/ws/alerts";
 export const DEFAULT_SECRET = "CHANGE_ME_SHARED_SECRET";
 
 export function getQueryParams() {
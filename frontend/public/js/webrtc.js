@@ -58,6 +58,15 @@ export function connectViewer({
             if (deltaTime > 0) {
               const bitrate = (deltaBytes * 8) / deltaTime; // bits per second
               onBitrate?.(bitrate / 1000);
+              // lets the server step this viewer's resolution / fps up or down
+              send({
+                type: "stats",
+                kbps: bitrate / 1000,
+                fps: report.framesPerSecond,
+                packetsLost: report.packetsLost,
+                packetsReceived: report.packetsReceived,
+                freezeCount: report.freezeCount,
+              });
             }
             bytesPrev = report.bytesReceived;
             timePrev = report.timestamp;